@@ -17,6 +17,8 @@
 /// Quantum Runtime Library APIs
 #include <quantum_tensor_network_backend.h>
 
+#include "../../src/circuits/include/shot_matrix.h"
+
 const int total_qubits = 2;
 qbit qubit_register[total_qubits];
 
@@ -108,19 +110,20 @@ int main() {
   quantum_8086.displayProbabilities(probability_map);
 
   std::cout << std::endl << "testing . . .  getSamples" << std::endl;
-  std::vector<std::vector<bool>> measurement_samples;
   unsigned total_samples = 10;
-  measurement_samples = quantum_8086.getSamples(total_samples, qids);
-  for (auto measurement : measurement_samples) {
-    for (auto result : measurement) {
-      std::cout << result;
+  std::vector<std::vector<bool>> samples =
+      quantum_8086.getSamples(total_samples, qids);
+  ShotMatrix measurement_samples = ShotMatrix::fromSamples(samples);
+  for (std::size_t shot = 0; shot < measurement_samples.numShots(); ++shot) {
+    for (unsigned i = 0; i < measurement_samples.numBits(); ++i) {
+      std::cout << measurement_samples.get(shot, i);
     }
     std::cout << std::endl;
   }
 
   std::cout << std::endl << "testing . . .  samplesToHistogram" << std::endl;
   iqsdk::QssMap<unsigned int> distribution =
-      iqsdk::TensorNetworkSimulator::samplesToHistogram(measurement_samples);
+      iqsdk::TensorNetworkSimulator::samplesToHistogram(samples);
   std::cout << "Using " << total_samples
             << " samples, the distribution of states is:" << std::endl;
   for (const auto &entry : distribution) {
@@ -130,6 +133,13 @@ int main() {
     std::cout << entry.first << " : " << weight << std::endl;
   }
 
+  std::cout << std::endl << "testing . . .  ShotMatrix::toQssMap" << std::endl;
+  if (measurement_samples.toQssMap() != distribution) {
+    std::cout << "toQssMap differs from samplesToHistogram" << std::endl;
+    return 1;
+  }
+  std::cout << "toQssMap matches samplesToHistogram" << std::endl;
+
   std::cout << std::endl << "testing . . .  getAmplitudes - vec" << std::endl;
   std::vector<std::complex<double>> amplitudes =
       quantum_8086.getAmplitudes(qids);
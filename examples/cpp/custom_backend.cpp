@@ -20,11 +20,23 @@
 #include <iostream>
 #include <quantum_custom_backend.h>
 #include <qureg.hpp>
+#include <stdexcept>
 #include <string.h>
 
+#include "../../src/circuits/include/gate_fusion.h"
+#include "../../src/circuits/include/precision.h"
+
 // The purpose of this program is to showcase the use of a custom backend. In
 // this example we use the Intel Quantum Simulator (IQS) as the underlying
 // simulation engine, but access it as a custom backend.
+//
+// Gates are not applied one by one: GateFusion (gate_fusion.h) multiplies
+// runs of gates on at most two qubits into one matrix, so each Trotter step
+// of mbl_q3_1ts costs a few passes over the state instead of one per gate.
+//
+// The first argument selects the precision (precision.h): "double" (the
+// default) stores ComplexDP, "single" stores ComplexSP, and "mixed" stores
+// ComplexSP but sums probabilities and norms in double.
 
 const int N = 3;
 qbit q[N];
@@ -67,33 +79,36 @@ quantum_kernel void mbl_q3_1ts() {
   RX(q[2], 2.56278001524);
 }
 
-class CustomBackend : public iqsdk::CustomInterface {
+// Type is ComplexDP or ComplexSP.
+template <typename Type> class CustomBackend : public iqsdk::CustomInterface {
 public:
-  iqs::QubitRegister<ComplexDP> psi;
+  iqs::QubitRegister<Type> psi;
   iqs::RandomNumberGenerator<double> rng;
-  CustomBackend(int num_qubits)
-      : psi(iqs::QubitRegister<ComplexDP>(num_qubits, "base", 0)) {
+  // Pending gates; flush() before reading psi.
+  GateFusion fusion;
+  // Sum probabilities and norms in double, see precision.h.
+  bool accumulate_in_double;
+  CustomBackend(int num_qubits, bool accumulate_in_double = false)
+      : psi(iqs::QubitRegister<Type>(num_qubits, "base", 0)),
+        fusion([this](const std::vector<unsigned> &qubits,
+                      const ComplexMatrix &m) { ApplyMatrix(qubits, m); }),
+        accumulate_in_double(accumulate_in_double) {
     int seed = 0;
     rng.SetSeedStreamPtrs(seed);
   }
 
   void RXY(qbit q, double theta, double phi) {
-    psi.ApplyRotationXY(q, theta, phi);
+    fusion.add(q, rotationXYMatrix(theta, phi));
   }
 
-  void RZ(qbit q, double angle) { psi.ApplyRotationZ(q, angle); }
+  void RZ(qbit q, double angle) { fusion.add(q, rotationZMatrix(angle)); }
 
   void CPhase(qbit ctrl, qbit target, double angle) {
-    psi.ApplyCPhaseRotation(ctrl, target, -angle);
+    fusion.add(ctrl, target, cphaseMatrix(angle));
   }
 
   void SwapA(qbit q1, qbit q2, double angle) {
-    iqs::TinyMatrix<ComplexDP, 2, 2, 32> gate_matrix;
-    gate_matrix(0, 0) = gate_matrix(1, 1) = {0.5 * (1.0 + std::cos(angle)),
-                                             0.5 * std::sin(angle)};
-    gate_matrix(0, 1) = gate_matrix(1, 0) = {0.5 * (1.0 - std::cos(angle)),
-                                             -0.5 * std::sin(angle)};
-    psi.ApplyISwapRotation(q1, q2, gate_matrix);
+    fusion.add(q1, q2, swapAMatrix(angle));
   }
 
   void PrepZ(qbit q) {
@@ -103,9 +118,10 @@ public:
   }
 
   cbit MeasZ(qbit q) {
+    fusion.flush();
     cbit measurement;
     double rand_value, probability;
-    probability = psi.GetProbability(q);
+    probability = qubitProbability(psi, q, accumulate_in_double);
     rng.UniformRandomNumbers(&rand_value, 1, 0, 1, "state");
     if (rand_value > probability) {
       measurement = false;
@@ -114,15 +130,32 @@ public:
       measurement = true;
       psi.CollapseQubit(q, true);
     }
-    psi.Normalize();
+    normalizeState(psi, accumulate_in_double);
     return measurement;
   }
+
+  // A fused block, with qubits[0] the most significant bit of its index.
+  void ApplyMatrix(const std::vector<unsigned> &qubits, const ComplexMatrix &m) {
+    if (qubits.size() == 1) {
+      iqs::TinyMatrix<Type, 2, 2, 32> gate_matrix;
+      for (unsigned i = 0; i < 2; i++)
+        for (unsigned j = 0; j < 2; j++)
+          gate_matrix(i, j) = Type(m[i * 2 + j]);
+      psi.Apply1QubitGate(qubits[0], gate_matrix);
+    } else {
+      iqs::TinyMatrix<Type, 4, 4, 32> gate_matrix;
+      for (unsigned i = 0; i < 4; i++)
+        for (unsigned j = 0; j < 4; j++)
+          gate_matrix(i, j) = Type(m[i * 4 + j]);
+      psi.Apply2QubitGate(qubits[0], qubits[1], gate_matrix);
+    }
+  }
 };
 
-int main() {
+template <typename Type> int run(bool accumulate_in_double) {
   iqsdk::CustomSimulator *custom_simulator =
-      iqsdk::CustomSimulator::createSimulator<CustomBackend>("my_custom_device",
-                                                             N);
+      iqsdk::CustomSimulator::createSimulator<CustomBackend<Type>>(
+          "my_custom_device", N, accumulate_in_double);
   // Alternative way:
   // Name this whatever you want (except for the reserved backend identifiers)
   // clang-format off
@@ -137,17 +170,35 @@ int main() {
   iqsdk::CustomInterface *custom_interface =
       custom_simulator->getCustomBackend();
   assert(custom_interface != nullptr);
-  CustomBackend *custom_iqs_instance =
-      dynamic_cast<CustomBackend *>(custom_interface);
+  CustomBackend<Type> *custom_iqs_instance =
+      dynamic_cast<CustomBackend<Type> *>(custom_interface);
   assert(custom_iqs_instance != nullptr);
   mbl_q3_1ts();
+  custom_iqs_instance->fusion.flush();
 
-  std::cout << "Single qubit probabilities" << std::endl;
+  std::cout << "Single qubit probabilities (" << custom_iqs_instance->fusion.numGates()
+            << " gates in " << custom_iqs_instance->fusion.numBlocks()
+            << " fused blocks)" << std::endl;
   for (int i = 0; i < N; ++i) {
     std::cout << "q[" << i
-              << "] = " << custom_iqs_instance->psi.GetProbability(i)
+              << "] = "
+              << qubitProbability(custom_iqs_instance->psi, i,
+                                  custom_iqs_instance->accumulate_in_double)
               << std::endl;
   }
   delete custom_simulator;
   return 0;
 }
+
+int main(int argc, char *argv[]) {
+  Precision precision;
+  try {
+    precision = parsePrecision(argc > 1 ? argv[1] : "double");
+  } catch (const std::invalid_argument &error) {
+    std::cerr << "Error: " << error.what() << std::endl;
+    return 1;
+  }
+  if (precision == Precision::Double)
+    return run<ComplexDP>(false);
+  return run<ComplexSP>(precision == Precision::Mixed);
+}
@@ -15,6 +15,8 @@
 // Here we show how to personalize the simulator backend in two ways.
 // 1) by using the API for custom-noise IQS backend
 // 2) by writing a custom backend with the IQSDK API so that its behavior is as for 1).
+// 3) optionally, by a custom backend that evolves the density matrix under the
+//    same noise model, which gives the ensemble average of 2) exactly in one run.
 //
 //===----------------------------------------------------------------------===//
 
@@ -22,9 +24,11 @@
 
 #include <cassert>
 #include <cstdlib>
+#include <cstring>
 #include <functional>
 #include <iostream>
 #include <cmath>
+#include <stdexcept>
 #include <string.h>
 
 // For the custom backend API, also including the IQS header.
@@ -34,13 +38,22 @@
 // For the custom-noise IQS backend.
 #include <quantum_full_state_simulator_backend.h>
 
+#include "../../src/circuits/include/density_matrix.h"
+#include "../../src/circuits/include/ensemble_average.h"
+#include "../../src/circuits/include/gate_fusion.h"
+#include "../../src/circuits/include/gate_classifier.h"
+#include "../../src/circuits/include/noise_channel.h"
+#include "../../src/circuits/include/noise_registry.h"
+
 //===----------------------------------------------------------------------===//
 // clang-format off
 // The purpose of this is to showcase using a custom backend. Here, we use IQS
 // clang-format on
 
 const double k_depol_rate = 0.02;
+const double k_angle_tolerance = 1e-4;
 const int default_num_ensemble_states = 10000;
+const int max_iqs_workers = 64;
 const std::size_t k_rng_seed = 12347;
 
 const int N = 5;
@@ -96,15 +109,21 @@ quantum_kernel void circuit() {
 
 //===----------------------------------------------------------------------===//
 // -- Read the chi matrices once.
-// In general one would need to write a function to parse the process matrix.
-// For convenience, we use the utility function defined in "quantum_full_state_simulator_backend.h".
-// Recall that the path is relative to the "chimatrix_directory" in the platform configuration file.
-const std::vector<std::complex<double>> _chi_vector_yppi2 =
-  iqsdk::ParseChiMatrixFromCsvFiles(1, "/qds_yppi2/qpt_real.csv", "/qds_yppi2/qpt_imag.csv");
-const std::vector<std::complex<double>> _chi_vector_ynpi2 =
-  iqsdk::ParseChiMatrixFromCsvFiles(1, "/qds_ynpi2/qpt_real.csv", "/qds_ynpi2/qpt_imag.csv");
-const std::vector<std::complex<double>> _chi_vector_cz =
-  iqsdk::ParseChiMatrixFromCsvFiles(2, "/qds_cz/qpt_real.csv", "/qds_cz/qpt_imag.csv");
+// The process-wide registry parses every model under noise_models/ the first
+// time it is used; both backends below share the same immutable matrices.
+// They are looked up on first use rather than before main, so main() can
+// report a missing model.
+struct ChiMatrices {
+  const std::vector<std::complex<double>> &yppi2, &ynpi2, &cz;
+};
+
+const ChiMatrices &chiMatrices() {
+  static const NoiseModelRegistry &noise_models = NoiseModelRegistry::instance();
+  static const ChiMatrices chi = {noise_models.get("good/qds_yppi2").chi,
+                                  noise_models.get("good/qds_ynpi2").chi,
+                                  noise_models.get("good/qds_cz").chi};
+  return chi;
+}
 
 //===----------------------------------------------------------------------===//
 // Here we use the API for custom-noise IQS backend.
@@ -125,38 +144,32 @@ iqsdk::IqsCustomOp CustomPrep(unsigned q) {return iqsdk::k_iqs_ideal_op;}
 // gamma is the rotation angle.
 iqsdk::IqsCustomOp CustomRotZ(unsigned q, double gamma) {return iqsdk::k_iqs_ideal_op;}
 
+// Gates with a calibrated process matrix, looked up by angle with one hash
+// probe. Ry(-pi/2) appears both as (phi = pi/2, gamma = -pi/2) and as
+// (phi = 3pi/2, gamma = pi/2).
+const GateClassifier<iqsdk::IqsCustomOp> &noiseOps() {
+  static const ChiMatrices &chi = chiMatrices();
+  static const GateClassifier<iqsdk::IqsCustomOp> noise_ops(k_angle_tolerance, {
+    {GateType::RotationXY, M_PI/2, M_PI/2, {0, 0, 0, 0, chi.yppi2, "yppi2", 0, 0, 0, 0}},
+    {GateType::RotationXY, M_PI/2, -M_PI/2, {0, 0, 0, 0, chi.ynpi2, "ynpi2", 0, 0, 0, 0}},
+    {GateType::RotationXY, 3*M_PI/2, M_PI/2, {0, 0, 0, 0, chi.ynpi2, "ynpi2", 0, 0, 0, 0}},
+    {GateType::CPhase, 0, M_PI, {0, 0, 0, 0, chi.cz, "cz", 0, 0, 0, 0}}});
+  return noise_ops;
+}
+
+//                                        pre-op depolarizing noise
+//                                              vvvvvvvvvvvv
+const iqsdk::IqsCustomOp k_depol_op = {0, k_depol_rate, 0, 0, {}, "", 0, 0, 0, 0};
+
 // 1-qubit gate representing a rotation around an axis in the XY plane.
 // phi determine the axis, gamma the rotation angle.
 iqsdk::IqsCustomOp CustomRotXY(unsigned q, double phi, double gamma) {
-  bool is_yppi2 = false; // Ry(+pi/2)
-  is_yppi2 = is_yppi2 || (std::abs(phi - M_PI/2) < 1e-4 && std::abs(gamma - M_PI/2) < 1e-4);
-  bool is_ynpi2 = false; // Ry(-pi/2)
-  is_ynpi2 = is_ynpi2 || (std::abs(phi - M_PI/2) < 1e-4 && std::abs(gamma + M_PI/2) < 1e-4);   // phi =  pi/2 , gamma = -pi/2
-  is_ynpi2 = is_ynpi2 || (std::abs(phi - 3*M_PI/2) < 1e-4 && std::abs(gamma - M_PI/2) < 1e-4); // phi = -pi/2 , gamma = 3/2 pi
-  if (is_yppi2) {
-    iqsdk::IqsCustomOp op = {0, 0, 0, 0, _chi_vector_yppi2, "yppi2", 0, 0, 0, 0};
-    return op;
-  } else if (is_ynpi2) {
-    iqsdk::IqsCustomOp op = {0, 0, 0, 0, _chi_vector_ynpi2, "ynpi2", 0, 0, 0, 0};
-    return op;
-  } else {
-    //                    pre-op depolarizing noise
-    //                          vvvvvvvvvvvv
-    iqsdk::IqsCustomOp op = {0, k_depol_rate, 0, 0, {}, "", 0, 0, 0, 0};
-    return op;
-  }
+  return noiseOps().lookup(GateType::RotationXY, phi, gamma, k_depol_op);
 }
 
 // 2-qubit gate corresponding to a phase applied to q2 controlled by q1 being in |1>.
 iqsdk::IqsCustomOp CustomCPhaseRot(unsigned q1, unsigned q2, double gamma) {
-  bool is_cphase = false; // CZ
-  is_cphase = std::abs(gamma - M_PI) < 1e-4;
-  if (is_cphase) {
-    iqsdk::IqsCustomOp op = {0, 0, 0, 0, _chi_vector_cz, "cz", 0, 0, 0, 0};
-    return op;
-  }
-  else
-    return iqsdk::k_iqs_ideal_op;
+  return noiseOps().lookup(GateType::CPhase, 0, gamma, iqsdk::k_iqs_ideal_op);
 }
 
 //===----------------------------------------------------------------------===//
@@ -166,36 +179,58 @@ class CustomBackend : public iqsdk::CustomInterface {
 public:
   iqs::QubitRegister<ComplexDP> psi;
   iqs::RandomNumberGenerator<double> rng;
-  iqs::CM4x4<ComplexDP> chi_yppi2, chi_ynpi2, chi_depol;
-  iqs::CM16x16<ComplexDP> chi_cz;
+  // Kraus branches compiled once from the chi matrices, see noise_channel.h.
+  NoiseChannel channel_yppi2, channel_ynpi2, channel_cz;
+  // Same calibrated gates as noiseOps() above.
+  GateClassifier<const NoiseChannel *> calibrated_channels;
+  // Depolarizing noise of the other rotations, compiled once; the ideal
+  // rotation is applied after it, so any angle costs no compilation.
+  NoiseChannel channel_depol;
+  // Qubits no gate has touched since construction or reset(), still |0>.
+  std::vector<bool> prepared;
+  // Ideal gates and sampled mixed-unitary branches are fused into blocks of
+  // up to two qubits, see gate_fusion.h; flush() before reading psi.
+  // Declared last: ~GateFusion flushes into ApplyMatrix, which uses psi and
+  // prepared, so they must outlive it.
+  GateFusion fusion;
 
   CustomBackend(int num_qubits)
-      : psi(iqs::QubitRegister<ComplexDP>(num_qubits, "base", 0)) {
+      : psi(iqs::QubitRegister<ComplexDP>(num_qubits, "base", 0)),
+        calibrated_channels(k_angle_tolerance), prepared(num_qubits, true),
+        fusion([this](const std::vector<unsigned> &qubits, const ComplexMatrix &m) {
+          ApplyMatrix(m, qubits[0], qubits.size() > 1 ? qubits[1] : 0);
+        }) {
     rng.SetSeedStreamPtrs(k_rng_seed);
     psi.SetRngPtr(&rng);
 
+    channel_yppi2 = compileChannel(chiMatrices().yppi2, 1);
+    channel_ynpi2 = compileChannel(chiMatrices().ynpi2, 1);
+    channel_cz = compileChannel(chiMatrices().cz, 2);
+    calibrated_channels.add(GateType::RotationXY, M_PI/2, M_PI/2, &channel_yppi2);
+    calibrated_channels.add(GateType::RotationXY, M_PI/2, -M_PI/2, &channel_ynpi2);
+    calibrated_channels.add(GateType::RotationXY, 3*M_PI/2, M_PI/2, &channel_ynpi2);
+    calibrated_channels.add(GateType::CPhase, 0, M_PI, &channel_cz);
+    //
+    iqs::CM4x4<ComplexDP> depol = iqs::Get1QubitDepolarizingChiMatrix<ComplexDP>(k_depol_rate);
+    ComplexMatrix chi_depol;
     for (unsigned i_row=0; i_row<4; i_row++)
     for (unsigned i_col=0; i_col<4; i_col++)
-    {
-        this->chi_yppi2(i_row, i_col) = _chi_vector_yppi2[i_row*4 + i_col];
-        this->chi_ynpi2(i_row, i_col) = _chi_vector_ynpi2[i_row*4 + i_col];
-    }
-    for (unsigned i_row=0; i_row<16; i_row++)
-    for (unsigned i_col=0; i_col<16; i_col++)
-    {
-        this->chi_cz(i_row, i_col) = _chi_vector_cz[i_row*16 + i_col];
-    }
-    this->chi_yppi2.SolveEigenSystem();
-    this->chi_ynpi2.SolveEigenSystem();
-    this->chi_cz.SolveEigenSystem();
-    //
-    chi_depol = iqs::Get1QubitDepolarizingChiMatrix<ComplexDP>(k_depol_rate);
-    chi_depol.SolveEigenSystem();
+        chi_depol.push_back(depol(i_row, i_col));
+    channel_depol = compileChannel(chi_depol, 1);
+  }
+
+  // Back to |0...0> for the next trajectory without reallocating: one
+  // memset of the amplitudes, after which every PrepZ is free.
+  void reset() {
+    fusion.clear();
+    std::memset(static_cast<void *>(psi.RawState()), 0, psi.LocalSize() * sizeof(ComplexDP));
+    psi[0] = 1;
+    prepared.assign(prepared.size(), true);
   }
 
   void PrepZ(qbit q) {
     // Preparation via measurement and, possibly, bit flip.
-    double prob = psi.GetProbability(q);
+    fusion.flush();
     double r = 1;
     if (psi.GetRngPtr() != nullptr)
     {
@@ -205,6 +240,12 @@ public:
     {
       r = (double) std::rand()/RAND_MAX;
     }
+    // Already |0>: nothing to measure (r is still drawn, so the random
+    // stream does not depend on this).
+    if (prepared[q])
+      return;
+    double prob = psi.GetProbability(q);
+    prepared[q] = true;
     //
     if (r>prob) {
       psi.CollapseQubit(q, false); // --> |0>
@@ -218,46 +259,35 @@ public:
 
   // Ideal RotZ.
   void RZ(qbit q, double angle) {
-    psi.ApplyRotationZ(q, angle);
+    fusion.add(q, rotationZMatrix(angle));
   }
 
   // Depolarizing noise (p=0.01) followed by ideal RotXY.
   // Exception: if Ry(+90) or Ry(-90) take the process matrix specification from CSV files.
   void RXY(qbit q, double phi, double theta) {
-    bool is_yppi2 = false; // Ry(+pi/2)
-    is_yppi2 = is_yppi2 || (std::abs(phi - M_PI/2) < 1e-4 && std::abs(theta - M_PI/2) < 1e-4);
-    bool is_ynpi2 = false; // Ry(-pi/2)
-    is_ynpi2 = is_ynpi2 || (std::abs(phi - M_PI/2) < 1e-4 && std::abs(theta + M_PI/2) < 1e-4);   // phi =  pi/2 , gamma = -pi/2
-    is_ynpi2 = is_ynpi2 || (std::abs(phi - 3*M_PI/2) < 1e-4 && std::abs(theta - M_PI/2) < 1e-4); // phi = -pi/2 , gamma = 3/2 pi
-    if (is_yppi2)
-        psi.ApplyChannel(q, chi_yppi2);
-    else if (is_ynpi2)
-        psi.ApplyChannel(q, chi_ynpi2);
-    else {
-        psi.ApplyChannel(q, chi_depol);
-        psi.ApplyRotationXY(q, phi, theta);
+    if (const NoiseChannel *const *channel =
+            calibrated_channels.find(GateType::RotationXY, phi, theta)) {
+      ApplyNoiseChannel(**channel, q);
+      return;
     }
+    ApplyNoiseChannel(channel_depol, q);
+    fusion.add(q, rotationXYMatrix(phi, theta));
   }
 
   void CPhase(qbit ctrl, qbit target, double angle) {
-    bool is_cphase = false; // CZ
-    is_cphase = std::abs(angle - M_PI) < 1e-4;
-    if (is_cphase)
-      psi.ApplyChannel(ctrl, target, chi_cz);
+    if (const NoiseChannel *const *channel =
+            calibrated_channels.find(GateType::CPhase, 0, angle))
+      ApplyNoiseChannel(**channel, ctrl, target);
     else
-      psi.ApplyCPhaseRotation(ctrl, target, -angle);
+      fusion.add(ctrl, target, cphaseMatrix(angle));
   }
 
   void SwapA(qbit q1, qbit q2, double angle) {
-    iqs::TinyMatrix<ComplexDP, 2, 2, 32> gate_matrix;
-    gate_matrix(0, 0) = gate_matrix(1, 1) = {
-        0.5 * (1.0 + std::cos(angle)), 0.5 * std::sin(angle)};
-    gate_matrix(0, 1) = gate_matrix(1, 0) = {
-        0.5 * (1.0 - std::cos(angle)), -0.5 * std::sin(angle)};
-    psi.ApplyISwapRotation(q1, q2, gate_matrix);
+    fusion.add(q1, q2, swapAMatrix(angle));
   }
 
   cbit MeasZ(qbit q) {
+    fusion.flush();
     cbit measurement;
     double rand_value, probability;
     probability = psi.GetProbability(q);
@@ -272,94 +302,335 @@ public:
     psi.Normalize();
     return measurement;
   }
+
+  // Picks one Kraus branch of `channel` and applies it as a single gate.
+  // For two-qubit channels `q1` is the first qubit of the Pauli basis.
+  void ApplyNoiseChannel(const NoiseChannel &channel, qbit q1, qbit q2 = 0) {
+    double rand_value;
+    rng.UniformRandomNumbers(&rand_value, 1, 0, 1, "state");
+    if (channel.mixed_unitary) {
+      const ComplexMatrix &branch = channel.branches[channel.alias.sample(rand_value)];
+      if (channel.num_qubits == 1)
+        fusion.add(q1, branch);
+      else
+        fusion.add(q1, q2, branch);
+      return;
+    }
+
+    // The branch probabilities depend on the state, so it must be current.
+    fusion.flush();
+    // p_k = tr(K_k^dag K_k rho) on the reduced state of the target qubits.
+    ComplexMatrix rho = ReducedDensityMatrix(channel.num_qubits, q1, q2);
+    std::vector<double> probs(channel.effects.size());
+    double total = 0;
+    for (std::size_t k = 0; k < probs.size(); k++) {
+      unsigned dim = 1u << channel.num_qubits;
+      for (unsigned a = 0; a < dim; a++)
+        for (unsigned b = 0; b < dim; b++)
+          probs[k] += (channel.effects[k][a * dim + b] * rho[b * dim + a]).real();
+      total += probs[k];
+    }
+    // Measured chi matrices are only trace preserving up to ~1e-4.
+    std::size_t k = 0;
+    for (double cumulative = probs[0]; k + 1 < probs.size() && cumulative < rand_value * total;)
+      cumulative += probs[++k];
+    ApplyMatrix(channel.branches[k], q1, q2);
+    psi.Normalize();
+  }
+
+  void ApplyMatrix(const ComplexMatrix &m, qbit q1, qbit q2) {
+    prepared[q1] = false;
+    if (m.size() != 4)
+      prepared[q2] = false;
+    if (m.size() == 4) {
+      iqs::TinyMatrix<ComplexDP, 2, 2, 32> gate_matrix;
+      for (unsigned i = 0; i < 2; i++)
+        for (unsigned j = 0; j < 2; j++)
+          gate_matrix(i, j) = m[i * 2 + j];
+      psi.Apply1QubitGate(q1, gate_matrix);
+    } else {
+      iqs::TinyMatrix<ComplexDP, 4, 4, 32> gate_matrix;
+      for (unsigned i = 0; i < 4; i++)
+        for (unsigned j = 0; j < 4; j++)
+          gate_matrix(i, j) = m[i * 4 + j];
+      psi.Apply2QubitGate(q1, q2, gate_matrix);
+    }
+  }
+
+  // Reduced density matrix of q1 (and q2), in the |b1 b2> basis.
+  ComplexMatrix ReducedDensityMatrix(unsigned num_qubits, qbit q1, qbit q2) {
+    std::size_t offsets[4] = {0, std::size_t(1) << q1};
+    if (num_qubits == 2) {
+      offsets[1] = std::size_t(1) << q2;
+      offsets[2] = std::size_t(1) << q1;
+      offsets[3] = offsets[1] | offsets[2];
+    }
+    const unsigned dim = 1u << num_qubits;
+    const std::size_t mask = offsets[dim - 1] | offsets[1];
+    ComplexMatrix rho(dim * dim);
+    ComplexDP amps[4];
+    for (std::size_t i = 0; i < psi.LocalSize(); i++) {
+      if (i & mask)
+        continue;
+      for (unsigned a = 0; a < dim; a++)
+        amps[a] = psi[i | offsets[a]];
+      for (unsigned a = 0; a < dim; a++)
+        for (unsigned b = 0; b < dim; b++)
+          rho[a * dim + b] += amps[a] * std::conj(amps[b]);
+    }
+    return rho;
+  }
+};
+
+//===----------------------------------------------------------------------===//
+// Same noise model as CustomBackend, but on the density matrix: every channel
+// is applied exactly instead of sampling one Kraus branch, so one run gives
+// the ensemble average. Needs 4^N complex numbers, fine for small N.
+
+class DensityMatrixBackend : public iqsdk::CustomInterface {
+public:
+  DensityMatrix rho;
+  iqs::RandomNumberGenerator<double> rng;
+  // Superoperators of the calibrated gates, see density_matrix.h.
+  ComplexMatrix superop_yppi2, superop_ynpi2, superop_cz;
+  GateClassifier<const ComplexMatrix *> calibrated_superops;
+  // Depolarizing noise of the other rotations; the ideal rotation is
+  // applied after it as rho -> U rho U^dag.
+  ComplexMatrix superop_depol;
+
+  DensityMatrixBackend(int num_qubits)
+      : rho(num_qubits), calibrated_superops(k_angle_tolerance) {
+    rng.SetSeedStreamPtrs(k_rng_seed);
+
+    superop_yppi2 = channelSuperoperator(compileChannel(chiMatrices().yppi2, 1));
+    superop_ynpi2 = channelSuperoperator(compileChannel(chiMatrices().ynpi2, 1));
+    superop_cz = channelSuperoperator(compileChannel(chiMatrices().cz, 2));
+    calibrated_superops.add(GateType::RotationXY, M_PI/2, M_PI/2, &superop_yppi2);
+    calibrated_superops.add(GateType::RotationXY, M_PI/2, -M_PI/2, &superop_ynpi2);
+    calibrated_superops.add(GateType::RotationXY, 3*M_PI/2, M_PI/2, &superop_ynpi2);
+    calibrated_superops.add(GateType::CPhase, 0, M_PI, &superop_cz);
+    //
+    iqs::CM4x4<ComplexDP> depol = iqs::Get1QubitDepolarizingChiMatrix<ComplexDP>(k_depol_rate);
+    ComplexMatrix chi_depol;
+    for (unsigned i_row=0; i_row<4; i_row++)
+    for (unsigned i_col=0; i_col<4; i_col++)
+        chi_depol.push_back(depol(i_row, i_col));
+    superop_depol = channelSuperoperator(compileChannel(chi_depol, 1));
+  }
+
+  // The ensemble average of CustomBackend's measure-and-flip is a reset.
+  void PrepZ(qbit q) {
+    rho.reset(q);
+  }
+
+  // Ideal RotZ.
+  void RZ(qbit q, double angle) {
+    std::complex<double> phase0 = std::polar(1.0, -angle / 2), phase1 = std::conj(phase0);
+    rho.applyDiagonal([&](std::size_t i) { return i >> q & 1 ? phase1 : phase0; });
+  }
+
+  void RXY(qbit q, double phi, double theta) {
+    if (const ComplexMatrix *const *superop =
+            calibrated_superops.find(GateType::RotationXY, phi, theta)) {
+      rho.applySuperoperator(**superop, q);
+      rho.normalize();
+      return;
+    }
+    rho.applySuperoperator(superop_depol, q);
+    rho.applyUnitary(rotationXYMatrix(phi, theta), q);
+  }
+
+  void CPhase(qbit ctrl, qbit target, double angle) {
+    if (const ComplexMatrix *const *superop =
+            calibrated_superops.find(GateType::CPhase, 0, angle)) {
+      rho.applySuperoperator(**superop, ctrl, target);
+      rho.normalize();
+      return;
+    }
+    // Same as ApplyCPhaseRotation(ctrl, target, -angle): |11> gets exp(-i angle).
+    std::complex<double> phase = std::polar(1.0, -angle);
+    rho.applyDiagonal([&](std::size_t i) {
+      return (i >> ctrl & 1) && (i >> target & 1) ? phase : 1.0;
+    });
+  }
+
+  void SwapA(qbit q1, qbit q2, double angle) {
+    // The ISwapRotation matrix of CustomBackend, acting on |01> and |10>.
+    std::complex<double> diag = {0.5 * (1.0 + std::cos(angle)), 0.5 * std::sin(angle)};
+    std::complex<double> off = {0.5 * (1.0 - std::cos(angle)), -0.5 * std::sin(angle)};
+    rho.applyUnitary({1, 0, 0, 0,
+                      0, diag, off, 0,
+                      0, off, diag, 0,
+                      0, 0, 0, 1}, q1, q2);
+  }
+
+  cbit MeasZ(qbit q) {
+    double rand_value, probability;
+    probability = rho.getProbability(q);
+    rng.UniformRandomNumbers(&rand_value, 1, 0, 1, "state");
+    cbit measurement = rand_value <= probability;
+    rho.collapse(q, measurement);
+    return measurement;
+  }
 };
 
 //===----------------------------------------------------------------------===//
 
+// The custom device is synchronous: ready() selects it and wait() has
+// nothing to wait for.
+struct CustomWorker {
+  iqsdk::CustomSimulator *simulator;
+  iqsdk::QRT_ERROR_T ready() { return simulator->ready(); }
+  void wait() {}
+};
+
+// Usage: custom_backend_mimicking_iqs_custom_noise [output_file]
+//          [max_ensemble_states] [num_iqs_workers] [target_std_error]
+//          [trajectory|density]
+// The custom backend and IQS average the single-qubit probabilities online
+// and stop at max_ensemble_states trajectories, or earlier once every
+// standard error is below target_std_error. The IQS trajectories run on
+// num_iqs_workers asynchronous devices. "density" replaces the trajectory
+// custom backend with DensityMatrixBackend, which needs a single run. The
+// output file holds log-spaced checkpoints.
 int main(int argc, char *argv[]) {
 
   // Set name of output file.
   std::string filename = "TEMP_out.txt";
   if (argc > 1)
     filename = argv[1];
-  // Set the number of states in the ensemble;
-  int num_ensemble_states = default_num_ensemble_states;
-  if (argc > 2)
-    num_ensemble_states = std::atoi(argv[2]);
+  EnsembleOptions options;
+  // Set the maximum number of states in the ensemble;
+  options.max_trajectories = argc > 2 ? std::atoi(argv[2]) : default_num_ensemble_states;
+  unsigned num_iqs_workers = argc > 3 ? std::atoi(argv[3]) : 1;
+  options.target_standard_error = argc > 4 ? std::atof(argv[4]) : 0;
+  std::string custom_mode = argc > 5 ? argv[5] : "trajectory";
+  if (num_iqs_workers < 1 || num_iqs_workers > max_iqs_workers) {
+    std::cerr << "Error: num_iqs_workers must be in [1, " << max_iqs_workers << "]" << std::endl;
+    return 1;
+  }
+  if (custom_mode != "trajectory" && custom_mode != "density") {
+    std::cerr << "Error: the custom backend must be \"trajectory\" or \"density\"" << std::endl;
+    return 1;
+  }
+
+  try {
+    noiseOps();
+  } catch (const std::exception &error) {
+    std::cerr << "Error: " << error.what() << std::endl;
+    return 1;
+  }
+  NoiseModelRegistry::instance().printStats();
 
   std::ofstream myfile;
   myfile.open (filename);
-  myfile << "ensemble_size\tq\tcustom\tiqs\n";
-
-  // Custom backend API.
-  iqsdk::CustomSimulator *custom_simulator =
-      iqsdk::CustomSimulator::createSimulator<CustomBackend>("my_custom_device", N);
-  iqsdk::QRT_ERROR_T status = custom_simulator->ready();
-  assert(status == iqsdk::QRT_ERROR_SUCCESS);
-  iqsdk::CustomInterface *custom_interface =
-      custom_simulator->getCustomBackend();
-  assert(custom_interface != nullptr);
-  CustomBackend *custom_iqs_instance =
-      dynamic_cast<CustomBackend *>(custom_interface);
-  assert(custom_iqs_instance != nullptr);
-
-  std::vector<double> single_state_probs(N);
-  std::vector<std::reference_wrapper<qbit>> qids;
-  for (int qubit = 0; qubit < N; ++qubit)
-    qids.push_back(std::ref(q[qubit]));
+  myfile << "backend\tensemble_size\tq\tmean\tstd_error\n";
+  auto write_checkpoint = [&](const char *backend) {
+    return [&myfile, backend](const EnsembleAverage &average) {
+      for (unsigned q = 0; q < average.numValues(); q++)
+        myfile << backend << "\t" << average.size() << "\t" << q << "\t"
+               << average[q].mean() << "\t" << average[q].standardError() << "\n";
+    };
+  };
+
+  std::vector<double> mean_custom(N), error_custom(N, 0);
+  std::size_t num_custom_states = 1;
+  iqsdk::CustomSimulator *custom_simulator = nullptr;
+  CustomBackend *custom_iqs_instance = nullptr;
+  bool success = true;
+
+  if (custom_mode == "density") {
+    // Density-matrix custom backend: one exact run.
+    custom_simulator =
+        iqsdk::CustomSimulator::createSimulator<DensityMatrixBackend>("my_density_device", N);
+    iqsdk::QRT_ERROR_T status = custom_simulator->ready();
+    assert(status == iqsdk::QRT_ERROR_SUCCESS);
+    DensityMatrixBackend *density_instance =
+        dynamic_cast<DensityMatrixBackend *>(custom_simulator->getCustomBackend());
+    assert(density_instance != nullptr);
 
-  std::vector<double> probs_custom(N*num_ensemble_states, 0);
-  for (int k=0; k<num_ensemble_states; k++) {
     circuit();
     for (int q=0; q<N; q++) {
-      probs_custom[k*N+q] = custom_iqs_instance->psi.GetProbability(q);
+      mean_custom[q] = density_instance->rho.getProbability(q);
+      myfile << "density\t1\t" << q << "\t" << mean_custom[q] << "\t0\n";
     }
-  }
-
-  // Custom-noise IQS API.
-  iqsdk::IqsConfig iqs_config(N, "custom", false, k_rng_seed); // false is for the "verbose" option
-  iqs_config.PrepZ = CustomPrep;
-  iqs_config.RotationZ = CustomRotZ;
-  iqs_config.RotationXY = CustomRotXY;
-  iqs_config.CPhaseRotation = CustomCPhaseRot;
-  iqsdk::FullStateSimulator iqs_device(iqs_config);
-  status = iqs_device.ready();
-  assert(status == iqsdk::QRT_ERROR_SUCCESS);
-
-  std::vector<double> probs_iqs(N*num_ensemble_states, 0);
-  for (int k=0; k<num_ensemble_states; k++) {
-    circuit();
-    //single_state_probs = iqs_device.getProbabilities(qids);
-    single_state_probs = iqs_device.getSingleQubitProbs(qids);
+  } else {
+    // Custom backend API, one trajectory per run.
+    custom_simulator =
+        iqsdk::CustomSimulator::createSimulator<CustomBackend>("my_custom_device", N);
+    iqsdk::CustomInterface *custom_interface =
+        custom_simulator->getCustomBackend();
+    assert(custom_interface != nullptr);
+    custom_iqs_instance = dynamic_cast<CustomBackend *>(custom_interface);
+    assert(custom_iqs_instance != nullptr);
+
+    std::vector<CustomWorker> custom_workers = {{custom_simulator}};
+    EnsembleAverage probs_custom(N);
+    success = runEnsemble(
+        custom_workers, options, probs_custom,
+        [&](unsigned) {
+          custom_iqs_instance->reset();
+          circuit();
+        },
+        [&](unsigned, std::vector<double> &probs) {
+          custom_iqs_instance->fusion.flush();
+          for (int q=0; q<N; q++)
+            probs[q] = custom_iqs_instance->psi.GetProbability(q);
+        },
+        write_checkpoint("custom"));
+    assert(success);
+    num_custom_states = probs_custom.size();
     for (int q=0; q<N; q++) {
-      probs_iqs[k*N+q] = single_state_probs[q];
+      mean_custom[q] = probs_custom[q].mean();
+      error_custom[q] = probs_custom[q].standardError();
     }
   }
 
-  // Compute the incoherent average of the single-qubit probabilities.
-  std::vector<double> sum_probs_custom(N, 0);
-  std::vector<double> sum_probs_iqs(N, 0);
-  for (int k=0; k<num_ensemble_states; k++) {
-    for (int q=0; q<N; q++) {
-      sum_probs_custom[q] += probs_custom[k*N+q];
-      sum_probs_iqs[q] += probs_iqs[k*N+q];
-      myfile << k+1 << "\t" << q << "\t"
-             << sum_probs_custom[q]/(double)(k+1) << "\t"
-             << sum_probs_iqs[q]/(double)(k+1) << "\n";
-    }
+  // Custom-noise IQS API, one asynchronous device per worker.
+  std::vector<iqsdk::FullStateSimulator> iqs_workers(num_iqs_workers);
+  for (unsigned w = 0; w < num_iqs_workers; w++) {
+    // false is for the "verbose" option, the last false for "synchronous".
+    iqsdk::IqsConfig iqs_config(N, "custom", false, deriveSeed(k_rng_seed, w), false);
+    iqs_config.PrepZ = CustomPrep;
+    iqs_config.RotationZ = CustomRotZ;
+    iqs_config.RotationXY = CustomRotXY;
+    iqs_config.CPhaseRotation = CustomCPhaseRot;
+    iqs_workers[w].initialize(iqs_config);
   }
+
+  std::vector<std::reference_wrapper<qbit>> qids;
+  for (int qubit = 0; qubit < N; ++qubit)
+    qids.push_back(std::ref(q[qubit]));
+
+  EnsembleAverage probs_iqs(N);
+  success = runEnsemble(
+      iqs_workers, options, probs_iqs,
+      [](unsigned) { circuit(); },
+      [&](unsigned w, std::vector<double> &probs) {
+        probs = iqs_workers[w].getSingleQubitProbs(qids);
+      },
+      write_checkpoint("iqs"));
+  assert(success);
   myfile.close();
 
   std::cout << "\nSingle qubit probabilities (averaged over "
-            << "an ensemble of " << num_ensemble_states
-            << " states):\n"
-            << "   (custom backend , custom-noise IQS )\n";
+            << "ensembles of " << num_custom_states << " and "
+            << probs_iqs.size() << " states):\n"
+            << "   (" << custom_mode << " custom backend , custom-noise IQS ) +- standard error\n";
   for (int q = 0; q < N; ++q) {
     std::cout << "q[" << q
-              << "] = ( " << sum_probs_custom[q]/(double)num_ensemble_states
-              << " , " << sum_probs_iqs[q]/(double)num_ensemble_states
+              << "] = ( " << mean_custom[q]
+              << " +- " << error_custom[q]
+              << " , " << probs_iqs[q].mean()
+              << " +- " << probs_iqs[q].standardError()
               << " )\n";
   }
+  noiseOps().printStats("IQS noise op lookups");
+  if (custom_iqs_instance) {
+    custom_iqs_instance->calibrated_channels.printStats("Custom backend channel lookups");
+    std::cout << "Custom backend gate fusion: " << custom_iqs_instance->fusion.numGates()
+              << " gates in " << custom_iqs_instance->fusion.numBlocks() << " blocks\n";
+  }
   delete custom_simulator;
 
   return 0;
@@ -0,0 +1,252 @@
+#include <clang/Quantum/quintrinsics.h>
+
+#include <quantum_custom_backend.h>
+
+#include <mpi.h>
+
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <utility>
+
+#include "../../src/circuits/include/benchmark.h"
+#include "../../src/circuits/include/distributed_state_vector.h"
+#include "../../src/circuits/include/state_vector.h"
+
+
+// GHZ states beyond one node's memory: a CustomInterface on the MPI
+// distributed state vector of src/circuits/include/distributed_state_vector.h.
+//
+// Every rank runs this whole program and gets its own device; the backends
+// do the gates collectively, each holding 2^(n - log2(ranks)) amplitudes, so
+// 35 qubits on 16 ranks need 32 GiB per rank.
+//
+// This lives here rather than in src/circuits because it needs MPI, which
+// prep.py does not pass to the compiler. Build it by hand, adding the
+// include and library paths that `mpicxx --showme:incdirs` and
+// `mpicxx --showme:libdirs` print, and -lmpi, with the compiler's include
+// and library path options (intel-quantum-compiler -h):
+//   intel-quantum-compiler <MPI include and library options> distributed_backend.cpp
+// and run it, for instance on one Linux box,
+//   mpirun -np 4 ./distributed_backend results/distributed_backend/ghz.csv 20 26
+
+const int max_qubits = 40;
+qbit qubit_register[max_qubits];
+
+// Remap policy of every DistributedBackend; set from the command line
+// before the first device is created.
+RemapPolicy remap_policy = RemapPolicy::LeastRecentlyUsed;
+
+
+// One kernel per qubit, as in ghz.cpp, so any size up to max_qubits can be
+// picked at run time without a kernel per size.
+template <unsigned i> quantum_kernel void ghzQubit() {
+  PrepZ(qubit_register[i]);
+  if constexpr (i == 0)
+    H(qubit_register[0]);
+  else
+    CNOT(qubit_register[i - 1], qubit_register[i]);
+}
+
+using GhzStep = void (*)();
+
+template <std::size_t... i>
+constexpr std::array<GhzStep, sizeof...(i)> ghzQubitSteps(std::index_sequence<i...>) {
+  return {+[] { ghzQubit<i>(); }...};
+}
+
+const std::array<GhzStep, max_qubits> k_ghz_qubit_steps =
+  ghzQubitSteps(std::make_index_sequence<max_qubits>());
+
+
+class DistributedBackend : public iqsdk::CustomInterface {
+public:
+  DistributedStateVector psi;
+  // Only rank 0's draws decide measurements.
+  std::mt19937_64 rng;
+  std::uniform_real_distribution<double> uniform;
+
+  DistributedBackend(int num_qubits, std::uint64_t seed = 0)
+      : psi(num_qubits, MPI_COMM_WORLD, remap_policy), rng(seed) {}
+
+  void RXY(qbit q, double phi, double gamma) { psi.applyRotationXY(q, phi, gamma); }
+
+  void RZ(qbit q, double angle) { psi.applyRotationZ(q, angle); }
+
+  void CPhase(qbit ctrl, qbit target, double angle) { psi.applyCPhase(ctrl, target, angle); }
+
+  void SwapA(qbit q1, qbit q2, double angle) { psi.applySwapA(q1, q2, angle); }
+
+  // Measure, then flip |1> back to |0>.
+  void PrepZ(qbit q) {
+    static const std::complex<double> x[4] = {0, 1, 1, 0};
+    if (MeasZ(q))
+      psi.applyMatrix(q, x);
+  }
+
+  cbit MeasZ(qbit q) { return psi.measure(q, uniform(rng)); }
+};
+
+
+// Largest amplitude difference to a StateVector on every rank after
+// `num_gates` random gates on `num_qubits` qubits, reduced over ranks, and
+// the exchanges the distributed vector needed.
+std::pair<double, std::size_t> crossCheck(unsigned num_qubits, unsigned num_gates,
+                                          RemapPolicy policy, std::uint64_t seed) {
+  std::mt19937_64 rng(seed);
+  std::uniform_real_distribution<double> angle(0, 2 * M_PI);
+  StateVector reference(num_qubits);
+  DistributedStateVector psi(num_qubits, MPI_COMM_WORLD, policy);
+  for (unsigned g = 0; g < num_gates; g++) {
+    unsigned q1 = rng() % num_qubits, q2 = (q1 + 1 + rng() % (num_qubits - 1)) % num_qubits;
+    double a = angle(rng), b = angle(rng);
+    // A layer of rotations first, so the state is dense.
+    switch (g < num_qubits ? 0 : rng() % 4) {
+    case 0:
+      q1 = g < num_qubits ? g : q1;
+      reference.applyRotationXY(q1, a, b);
+      psi.applyRotationXY(q1, a, b);
+      break;
+    case 1:
+      reference.applyRotationZ(q1, a);
+      psi.applyRotationZ(q1, a);
+      break;
+    case 2:
+      reference.applyCPhase(q1, q2, a);
+      psi.applyCPhase(q1, q2, a);
+      break;
+    default:
+      reference.applySwapA(q1, q2, a);
+      psi.applySwapA(q1, q2, a);
+      break;
+    }
+  }
+
+  double error = 0;
+  for (std::size_t i = 0; i < reference.numAmplitudes(); i++)
+    error = std::max(error, std::abs(psi.amplitude(i) - reference[i]));
+  for (unsigned q = 0; q < num_qubits; q++)
+    error = std::max(error, std::abs(psi.getProbability(q) - reference.getProbability(q)));
+  double max_error = 0;
+  MPI_Allreduce(&error, &max_error, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+  return {max_error, psi.communication().exchanges};
+}
+
+
+// Usage: distributed_backend [output_csv] [min_qubits] [max_qubits] [lru|fixed]
+// Cross-checks DistributedStateVector against StateVector under both remap
+// policies, then prepares GHZ states of min_qubits to max_qubits qubits with
+// the chosen policy. Rank 0 writes one CSV row per size: the exchanges, the
+// bytes sent by all ranks, the slowest rank's time in exchanges and the wall
+// time.
+int main(int argc, char *argv[]) {
+  MPI_Init(&argc, &argv);
+  int rank, num_ranks;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &num_ranks);
+
+  std::string output = argc > 1 ? argv[1] : "results/distributed_backend/ghz.csv";
+  unsigned min_qubits = argc > 2 ? std::atoi(argv[2]) : 16;
+  unsigned max_qubits_run = argc > 3 ? std::atoi(argv[3]) : 24;
+  std::string policy_name = argc > 4 ? argv[4] : "lru";
+  if (policy_name != "lru" && policy_name != "fixed") {
+    if (rank == 0)
+      std::cerr << "Error: remap policy must be lru or fixed" << std::endl;
+    MPI_Finalize();
+    return 1;
+  }
+  remap_policy = policy_name == "lru" ? RemapPolicy::LeastRecentlyUsed : RemapPolicy::Fixed;
+  max_qubits_run = std::min<unsigned>(max_qubits_run, max_qubits);
+
+  int failed = 0;
+  for (RemapPolicy policy : {RemapPolicy::LeastRecentlyUsed, RemapPolicy::Fixed}) {
+    auto [error, exchanges] = crossCheck(14, 400, policy, 12345);
+    if (rank == 0)
+      std::cout << (policy == RemapPolicy::Fixed ? "fixed" : "lru")
+                << " remap: max difference to StateVector " << error << ", " << exchanges
+                << " exchanges" << std::endl;
+    failed |= error > 1e-10;
+  }
+  if (failed) {
+    if (rank == 0)
+      std::cerr << "Error: DistributedStateVector disagrees with StateVector" << std::endl;
+    MPI_Finalize();
+    return 1;
+  }
+
+  std::ofstream report;
+  if (rank == 0) {
+    std::filesystem::path parent = std::filesystem::path(output).parent_path();
+    if (!parent.empty())
+      std::filesystem::create_directories(parent);
+    report.open(output);
+    failed = !report;
+    if (failed)
+      std::cerr << "Error: Unable to open " << output << std::endl;
+    else
+      report << "num_qubits,num_ranks,local_qubits,remap,exchanges,bytes_sent,"
+                "exchange_seconds,wall_seconds,status\n";
+  }
+  MPI_Bcast(&failed, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  if (failed) {
+    MPI_Finalize();
+    return 1;
+  }
+
+  if (rank == 0)
+    std::cout << "qubits\tranks\texchanges\tGB sent\texchange s\twall s" << std::endl;
+  for (unsigned n = min_qubits; n <= max_qubits_run; n++) {
+    iqsdk::CustomSimulator *custom_simulator =
+        iqsdk::CustomSimulator::createSimulator<DistributedBackend>("distributed_custom_device", n);
+    iqsdk::QRT_ERROR_T status = custom_simulator->ready();
+    assert(status == iqsdk::QRT_ERROR_SUCCESS);
+    DistributedBackend *backend = dynamic_cast<DistributedBackend *>(custom_simulator->getCustomBackend());
+    assert(backend != nullptr);
+    DistributedStateVector &psi = backend->psi;
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    Stopwatch stopwatch;
+    for (unsigned i = 0; i < n; i++)
+      k_ghz_qubit_steps[i]();
+    MPI_Barrier(MPI_COMM_WORLD);
+    double wall_seconds = stopwatch.seconds();
+
+    const std::size_t last = (std::size_t(1) << n) - 1;
+    bool ok = std::abs(std::norm(psi.amplitude(0)) - 0.5) < 1e-9 &&
+              std::abs(std::norm(psi.amplitude(last)) - 0.5) < 1e-9;
+    const CommunicationStats &communication = psi.communication();
+    double bytes_sent = 0, exchange_seconds = 0;
+    MPI_Reduce(&communication.bytes_sent, &bytes_sent, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&communication.seconds, &exchange_seconds, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+
+    if (rank == 0) {
+      char numbers[96];
+      std::snprintf(numbers, sizeof(numbers), "%.6e,%.6e,%.6e", bytes_sent, exchange_seconds,
+                    wall_seconds);
+      report << n << ',' << num_ranks << ',' << psi.numLocalQubits() << ',' << policy_name << ','
+             << communication.exchanges << ',' << numbers << ',' << (ok ? "ok" : "wrong_state")
+             << '\n';
+      std::cout << n << "\t" << num_ranks << "\t" << communication.exchanges << "\t"
+                << bytes_sent * 1e-9 << "\t" << exchange_seconds << "\t" << wall_seconds
+                << std::endl;
+    }
+    delete custom_simulator;
+    if (!ok) {
+      if (rank == 0)
+        std::cerr << "Error: GHZ on " << n << " qubits gave the wrong state" << std::endl;
+      MPI_Finalize();
+      return 1;
+    }
+  }
+
+  MPI_Finalize();
+  return 0;
+}
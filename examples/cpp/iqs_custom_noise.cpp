@@ -69,8 +69,12 @@
 #include <functional>
 #include <iostream>
 #include <quantum_full_state_simulator_backend.h>
+#include <stdexcept>
 #include <string>
 
+#include "../../src/circuits/include/gate_classifier.h"
+#include "../../src/circuits/include/noise_registry.h"
+
 // clang-format off
 // The purpose of this is to showcase using a custom backend. Here, we use IQS
 // clang-format on
@@ -86,51 +90,37 @@ cbit c[N];
 // - measurement: ideal
 // When the operation is ideal, it is not necessary to add its specification.
 
+// Gates with a calibrated process matrix, looked up by angle with one hash
+// probe. Ry(-pi/2) appears both as (phi = pi/2, gamma = -pi/2) and as
+// (phi = 3pi/2, gamma = pi/2).
+// The process matrices are parsed once, when the registry is first used,
+// instead of re-reading the CSV files on every matching gate. main() builds
+// the table before any gate runs, so a missing model is reported there.
+const double k_angle_tolerance = 1e-4;
+const GateClassifier<iqsdk::IqsCustomOp> &noiseOps() {
+  static const NoiseModelRegistry &noise_models = NoiseModelRegistry::instance();
+  static const GateClassifier<iqsdk::IqsCustomOp> noise_ops(k_angle_tolerance, {
+    {GateType::RotationXY, M_PI/2, M_PI/2, {0, 0, 0, 0, noise_models.get("good/qds_yppi2").chi, "yppi2", 0, 0, 0, 0}},
+    {GateType::RotationXY, M_PI/2, -M_PI/2, {0, 0, 0, 0, noise_models.get("good/qds_ynpi2").chi, "ynpi2", 0, 0, 0, 0}},
+    {GateType::RotationXY, 3*M_PI/2, M_PI/2, {0, 0, 0, 0, noise_models.get("good/qds_ynpi2").chi, "ynpi2", 0, 0, 0, 0}},
+    {GateType::CPhase, 0, M_PI, {0, 0, 0, 0, noise_models.get("good/qds_cz").chi, "cz", 0, 0, 0, 0}}});
+  return noise_ops;
+}
+
 // Preparation of one qubit in state |0>.
 iqsdk::IqsCustomOp CustomPrep(unsigned q) {return iqsdk::k_iqs_ideal_op;}
 
 // 1-qubit gate representing a rotation around an axis in the XY plane.
 // phi determine the axis, gamma the rotation angle.
 iqsdk::IqsCustomOp CustomRotXY(unsigned q, double phi, double gamma) {
-  bool is_yppi2 = false; // Ry(+pi/2)
-  is_yppi2 = is_yppi2 || (std::abs(phi - M_PI/2) < 1e-4 && std::abs(gamma - M_PI/2) < 1e-4);
-  bool is_ynpi2 = false; // Ry(-pi/2)
-  is_ynpi2 = is_ynpi2 || (std::abs(phi - M_PI/2) < 1e-4 && std::abs(gamma + M_PI/2) < 1e-4);   // phi =  pi/2 , gamma = -pi/2
-  is_ynpi2 = is_ynpi2 || (std::abs(phi - 3*M_PI/2) < 1e-4 && std::abs(gamma - M_PI/2) < 1e-4); // phi = -pi/2 , gamma = 3/2 pi
-  if (is_yppi2) {
-    // Recall that the path is relative to the "chimatrix_directory" in the platform configuration file.
-    std::string fname_real = "/qds_yppi2/qpt_real.csv";
-    std::string fname_imag = "/qds_yppi2/qpt_imag.csv";
-    std::vector<std::complex<double>> chi_matrix = iqsdk::ParseChiMatrixFromCsvFiles(1, fname_real, fname_imag);
-    iqsdk::IqsCustomOp op = {0, 0, 0, 0, chi_matrix, "yppi2", 0, 0, 0, 0};
-    return op;
-  } else if (is_ynpi2) {
-    std::string fname_real = "/qds_ynpi2/qpt_real.csv";
-    std::string fname_imag = "/qds_ynpi2/qpt_imag.csv";
-    std::vector<std::complex<double>> chi_matrix = iqsdk::ParseChiMatrixFromCsvFiles(1, fname_real, fname_imag);
-    iqsdk::IqsCustomOp op = {0, 0, 0, 0, chi_matrix, "yppi2", 0, 0, 0, 0};
-    return op;
-  } else {
-    //                 pre-op depolarizing noise
-    //                          vvvv
-    iqsdk::IqsCustomOp op = {0, 0.01, 0, 0, {}, "", 0, 0, 0, 0};
-    return iqsdk::k_iqs_ideal_op;
-  }
+  // Other rotations are ideal; a fallback of {0, 0.01, 0, 0, {}, "", 0, 0, 0, 0}
+  // would add pre-op depolarizing noise instead.
+  return noiseOps().lookup(GateType::RotationXY, phi, gamma, iqsdk::k_iqs_ideal_op);
 }
 
 // 2-qubit gate corresponding to a phase applied to q2 controlled by q1 being in |1>.
 iqsdk::IqsCustomOp CustomCPhaseRot(unsigned q1, unsigned q2, double gamma) {
-  bool is_cphase = false; // CZ
-  is_cphase = std::abs(gamma - M_PI) < 1e-4;
-  if (is_cphase) {
-    std::string fname_real = "/qds_cz/qpt_real.csv";
-    std::string fname_imag = "/qds_cz/qpt_imag.csv";
-    std::vector<std::complex<double>> chi_matrix = iqsdk::ParseChiMatrixFromCsvFiles(2, fname_real, fname_imag);
-    iqsdk::IqsCustomOp op = {0, 0, 0, 0, chi_matrix, "cz", 0, 0, 0, 0};
-    return op;
-  }
-  else
-    return iqsdk::k_iqs_ideal_op;
+  return noiseOps().lookup(GateType::CPhase, 0, gamma, iqsdk::k_iqs_ideal_op);
 }
 
 //===----------------------------------------------------------------------===//
@@ -187,6 +177,14 @@ int main() {
   iqs_config.RotationXY = CustomRotXY;
   iqs_config.CPhaseRotation = CustomCPhaseRot;
 
+  try {
+    noiseOps();
+  } catch (const std::exception &error) {
+    std::cerr << "Error: " << error.what() << std::endl;
+    return 1;
+  }
+  NoiseModelRegistry::instance().printStats();
+
   iqsdk::FullStateSimulator iqs_device(iqs_config);
   iqsdk::QRT_ERROR_T status = iqs_device.ready();
   assert(status == iqsdk::QRT_ERROR_SUCCESS);
@@ -200,6 +198,7 @@ int main() {
   for (int i = 0; i < N; ++i) {
     std::cout << "q[" << i << "] = " << probs_iqs[i] << std::endl;
   }
+  noiseOps().printStats("Noise op lookups");
 
   return 0;
 }
@@ -16,15 +16,23 @@
 // Intel Quantum Simulator vs. Clifford Simulator. Also illustrates parallel
 // kickoff and results collection of multiple Clifford simulator instances.
 //
+// By default the Clifford samples come from Pauli-frame sampling
+// (pauli_frame.h): the kernel is recorded and simulated on a stabilizer
+// tableau once, and all samples are drawn from that recording 64 at a time.
+// Pass "simulators" to run one Clifford simulator instance per sample instead.
+//
 //===----------------------------------------------------------------------===//
 
 #include <clang/Quantum/quintrinsics.h>
 #include <quantum.hpp>
 #include <quantum_clifford_simulator_backend.h>
+#include <quantum_custom_backend.h>
 
 #include <bits/stdc++.h>
 #include <cstdlib>
 
+#include "../../src/circuits/include/pauli_frame.h"
+
 // number of samples to consider for the comparison. higher number should give a
 // better average.
 constexpr size_t clifford_samples = 1000;
@@ -69,8 +77,16 @@ quantum_kernel void entangledStateClifford(int run_idx) {
 iqsdk::QssMap<double>
 runIqsSimulation(std::vector<std::reference_wrapper<qbit>> qids);
 void runCliffordSimulation(std::vector<std::reference_wrapper<qbit>> qids);
+void runFrameSampling();
 
-int main() {
+// Usage: iqs_vs_clifford_comparison [frames|simulators]
+int main(int argc, char *argv[]) {
+  std::string mode = argc > 1 ? argv[1] : "frames";
+  if (mode != "frames" && mode != "simulators") {
+    std::cerr << "Error: Unknown mode " << mode << " (frames or simulators)"
+              << std::endl;
+    return 1;
+  }
 
   // Initializing the random number generation
   srand((unsigned)time(NULL));
@@ -96,7 +112,10 @@ int main() {
     non_trivial_probabilities.push_back(expected_probability);
   }
 
-  runCliffordSimulation(qids);
+  if (mode == "simulators")
+    runCliffordSimulation(qids);
+  else
+    runFrameSampling();
 
   // single shot instance count corresponding to each non trivial state
   int single_shot_instances[non_trivial_state_num] = {0};
@@ -189,3 +208,27 @@ void runCliffordSimulation(std::vector<std::reference_wrapper<qbit>> qids) {
     cliff_sim[itr].wait();
   }
 }
+
+// record the Clifford kernel once and draw all samples from the recording
+// with a Pauli-frame sampler
+void runFrameSampling() {
+  iqsdk::CustomSimulator *recorder_sim =
+      iqsdk::CustomSimulator::createSimulator<CliffordRecorder>(
+          "clifford_recorder", total_qubits);
+  iqsdk::QRT_ERROR_T status = recorder_sim->ready();
+  assert(status == iqsdk::QRT_ERROR_SUCCESS);
+  CliffordRecorder *recorder =
+      dynamic_cast<CliffordRecorder *>(recorder_sim->getCustomBackend());
+  assert(recorder != nullptr);
+
+  entangledStateClifford(0);
+
+  PauliFrameSampler sampler(recorder->circuit, rand());
+  ShotMatrix shots = sampler.sample(clifford_samples);
+  for (size_t itr = 0; itr < clifford_samples; itr++) {
+    for (int i = 0; i < total_qubits; i++) {
+      cbit_reg[itr][i] = shots.get(itr, i);
+    }
+  }
+  delete recorder_sim;
+}
@@ -17,6 +17,8 @@
 /// Quantum Runtime Library APIs
 #include <quantum_full_state_simulator_backend.h>
 
+#include "../../src/circuits/include/shot_matrix.h"
+
 const int total_qubits = 2;
 qbit qubit_register[total_qubits];
 
@@ -64,13 +66,12 @@ int main() {
   quantum_8086.displayProbabilities(probability_map);
 
   // use sampling technique to simulate the results of many runs
-  std::vector<std::vector<bool>> measurement_samples;
   unsigned total_samples = 1000;
-  measurement_samples = quantum_8086.getSamples(total_samples, qids);
+  ShotMatrix measurement_samples =
+	  ShotMatrix::fromSamples( quantum_8086.getSamples(total_samples, qids) );
 
   // build a distribution of states
-  iqsdk::QssMap<unsigned int> distribution =
-	  iqsdk::FullStateSimulator::samplesToHistogram( measurement_samples );
+  iqsdk::QssMap<unsigned int> distribution = measurement_samples.toQssMap();
 
   // print out the results
   std::cout << "Using " << total_samples
@@ -16,6 +16,9 @@
 
 #include <iostream>
 #include <quantum_full_state_simulator_backend.h>
+#include <vector>
+
+#include "../../src/circuits/include/matching_decoder.h"
 
 // Allocate 5 global qubits.
 qbit qumem[5];
@@ -110,6 +113,15 @@ int main() {
   // qumem[3-4]   - the ancilla qubits for parity measurement.
   build_repetition3_code();
 
+  // The syndrome is decoded on the graph of the distance-3 repetition code:
+  // detector 0 is cmem[3], detector 1 is cmem[4], and correction edge i is
+  // a bit flip of qubit i. For three qubits this is the lookup table
+  // |10> -> qubit0, |11> -> qubit1, |01> -> qubit2; the same decoder
+  // handles any distance.
+  UnionFindDecoder decoder(DetectorGraph::repetitionCode(3));
+  void (*const flip_qubit[])() = {flip_qubit0, flip_qubit1, flip_qubit2};
+  std::vector<unsigned> defects;
+
   for (int cycles = 0; cycles < 5; cycles++) {
 
     std::cout
@@ -121,12 +133,14 @@ int main() {
     // Apply a decode block to prepare to measure any bit-flip errors.
     decode();
 
-    if (cmem[3] && !cmem[4]) // |10> - first qubit was flipped.
-      flip_qubit0();
-    else if (cmem[3] && cmem[4]) // |11> - second qubit was flipped.
-      flip_qubit1();
-    else if (!cmem[3] && cmem[4]) // |01> - third qubit was flipped.
-      flip_qubit2();
+    defects.clear();
+    if (cmem[3])
+      defects.push_back(0);
+    if (cmem[4])
+      defects.push_back(1);
+    decoder.decode(defects);
+    for (unsigned edge : decoder.correction())
+      flip_qubit[edge]();
 
     reset_ancillas(); // Resetting the ancillas
   }
@@ -12,6 +12,7 @@
 // License.
 //===----------------------------------------------------------------------===//
 
+
 #include <clang/Quantum/quintrinsics.h>
 
 /// Quantum Runtime Library APIs
@@ -19,6 +20,27 @@
 
 // Clifford Simulator APIs
 #include <quantum_clifford_simulator_backend.h>
+#include <quantum_custom_backend.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../../src/circuits/include/decode_pipeline.h"
+#include "../../src/circuits/include/matching_decoder.h"
+#include "../../src/circuits/include/pauli_frame.h"
 
 // Macro flag to enable printing of measurments to screen
 //#define DEBUG_MEAS
@@ -28,6 +50,20 @@
 // which maps naturally to a linear nearest-neighbor connectivity. It is also
 // the simplest to decode.
 
+// Shots are taken in one of two modes, chosen in the configuration:
+// "simulators" runs every shot on one of a set of asynchronous Clifford
+// simulators, each simulating the full tableau, and decodes the shots on a
+// pool of decoder threads (decode_pipeline.h); "frames" (the default)
+// records each distance once on a CliffordRecorder and samples all of its
+// shots with Pauli frames (pauli_frame.h), 64 shots per word operation.
+
+// The syndrome is decoded by a minority vote (the default), or by one of
+// the graph decoders of matching_decoder.h, "union_find" or "matching".
+
+// The distances, error rates, shots and the rest of the sweep are read at
+// run time from a configuration file (see rep_code_clifford.cfg), so a
+// different sweep needs no rebuild.
+
 // The code works as follows:
 
 // d = data qubit
@@ -56,83 +92,233 @@ const unsigned MAX_DISTANCE =
 qbit qdata[MAX_DISTANCE];
 qbit anc[MAX_DISTANCE - 1];
 
-// Define the error extraction circuit.
-// The distance is used as a template argument throughout.
-template <unsigned distance>
-quantum_kernel void measureRepCodeSyndrome(cbit result[]) {
+// Qubit indices in a quantum_kernel are fixed when the program is compiled.
+// The distances of k_compiled_distances below, at k_compiled_idle_rounds,
+// run the whole shot as one kernel, as this example always did: one launch
+// per shot, with the simulator scheduling each layer of gates together.
+// Any other distance or idle time runs as a sequence of small kernels, one
+// per qubit and step, picked at run time (as ghz.cpp builds its GHZ
+// states): about (2d - 1)(idle_rounds + 1) + 4(d - 1) launches per shot.
+// Every step takes the syndrome and data result arrays of the shot, whether
+// it measures into them or not.
 
-  // Prep the ancilla
-  for (unsigned i = 0; i < distance - 1; i++) {
-    PrepZ(anc[i]);
-    H(anc[i]);
-  }
+// Data qubit i is prepared in '0'.
+template <unsigned i> quantum_kernel void prepDataQubit() { PrepZ(qdata[i]); }
 
-  for (unsigned i = 0; i < distance - 1; i++) {
-    CZ(qdata[i], anc[i]);
-  }
+// To generate noise the qubits are idled for a fixed time.
+// This is done by inserting a set of gates which logically form the identity.
 
-  for (unsigned i = 0; i < distance - 1; i++) {
-    CZ(qdata[i + 1], anc[i]);
-  }
+// NOTE: The use of O1 will optimize this away. O1 should not be used
+// for this example.
+template <unsigned i> quantum_kernel void idleDataQubit() {
+  X(qdata[i]);
+  Y(qdata[i]);
+  Z(qdata[i]);
+}
 
-  // Measure the ancilla
-  for (unsigned i = 0; i < distance - 1; i++) {
-    H(anc[i]);
-    MeasZ(anc[i], result[i]);
-  }
+template <unsigned i> quantum_kernel void idleAncilla() {
+  X(anc[i]);
+  Y(anc[i]);
+  Z(anc[i]);
 }
 
-// This circuit prepare the logical '0' or '1' state based
-// on the template argument "init".
-template <unsigned distance, bool init> quantum_kernel void prepData() {
-  for (int i = 0; i < distance; i++) {
-    PrepZ(qdata[i]);
-    if (init)
-      X(qdata[i]);
-  }
+// The error extraction circuit: ancilla i measures the Z Z parity of data
+// qubits i and i + 1.
+template <unsigned i> quantum_kernel void prepAncilla() {
+  PrepZ(anc[i]);
+  H(anc[i]);
 }
 
-// To generate noise the qubits are idled for a fixed time.
-// This is done by inserting a set of gates which logically form the identity.
+template <unsigned i> quantum_kernel void entangleLeft() {
+  CZ(qdata[i], anc[i]);
+}
 
-// NOTE: The use of O1 will optimize this away. O1 should not be used
-// for this example.
-template <unsigned T, unsigned distance> quantum_kernel void idle() {
-  for (int t = 0; t < T; t++) {
-    for (int i = 0; i < distance; i++) {
+template <unsigned i> quantum_kernel void entangleRight() {
+  CZ(qdata[i + 1], anc[i]);
+}
+
+template <unsigned i> quantum_kernel void measureAncilla(cbit result[]) {
+  H(anc[i]);
+  MeasZ(anc[i], result[i]);
+}
+
+// The logical operator is measured as the parity of the measurement of all data
+// qubits.
+template <unsigned i> quantum_kernel void measureDataQubit(cbit result[]) {
+  MeasZ(qdata[i], result[i]);
+}
+
+using RepCodeStep = void (*)(cbit syndrome[], cbit result[]);
+
+// One table of steps per kernel, indexed by qubit.
+template <std::size_t... i>
+constexpr std::array<RepCodeStep, sizeof...(i)>
+prepDataSteps(std::index_sequence<i...>) {
+  return {+[](cbit *, cbit *) { prepDataQubit<i>(); }...};
+}
+
+template <std::size_t... i>
+constexpr std::array<RepCodeStep, sizeof...(i)>
+idleDataSteps(std::index_sequence<i...>) {
+  return {+[](cbit *, cbit *) { idleDataQubit<i>(); }...};
+}
+
+template <std::size_t... i>
+constexpr std::array<RepCodeStep, sizeof...(i)>
+idleAncillaSteps(std::index_sequence<i...>) {
+  return {+[](cbit *, cbit *) { idleAncilla<i>(); }...};
+}
+
+template <std::size_t... i>
+constexpr std::array<RepCodeStep, sizeof...(i)>
+prepAncillaSteps(std::index_sequence<i...>) {
+  return {+[](cbit *, cbit *) { prepAncilla<i>(); }...};
+}
+
+template <std::size_t... i>
+constexpr std::array<RepCodeStep, sizeof...(i)>
+entangleLeftSteps(std::index_sequence<i...>) {
+  return {+[](cbit *, cbit *) { entangleLeft<i>(); }...};
+}
+
+template <std::size_t... i>
+constexpr std::array<RepCodeStep, sizeof...(i)>
+entangleRightSteps(std::index_sequence<i...>) {
+  return {+[](cbit *, cbit *) { entangleRight<i>(); }...};
+}
+
+template <std::size_t... i>
+constexpr std::array<RepCodeStep, sizeof...(i)>
+measureAncillaSteps(std::index_sequence<i...>) {
+  return {+[](cbit *syndrome, cbit *) { measureAncilla<i>(syndrome); }...};
+}
+
+template <std::size_t... i>
+constexpr std::array<RepCodeStep, sizeof...(i)>
+measureDataSteps(std::index_sequence<i...>) {
+  return {+[](cbit *, cbit *result) { measureDataQubit<i>(result); }...};
+}
+
+const auto k_prep_data_steps =
+    prepDataSteps(std::make_index_sequence<MAX_DISTANCE>());
+const auto k_idle_data_steps =
+    idleDataSteps(std::make_index_sequence<MAX_DISTANCE>());
+const auto k_measure_data_steps =
+    measureDataSteps(std::make_index_sequence<MAX_DISTANCE>());
+const auto k_idle_ancilla_steps =
+    idleAncillaSteps(std::make_index_sequence<MAX_DISTANCE - 1>());
+const auto k_prep_ancilla_steps =
+    prepAncillaSteps(std::make_index_sequence<MAX_DISTANCE - 1>());
+const auto k_entangle_left_steps =
+    entangleLeftSteps(std::make_index_sequence<MAX_DISTANCE - 1>());
+const auto k_entangle_right_steps =
+    entangleRightSteps(std::make_index_sequence<MAX_DISTANCE - 1>());
+const auto k_measure_ancilla_steps =
+    measureAncillaSteps(std::make_index_sequence<MAX_DISTANCE - 1>());
+
+// The full quantum process of one shot, joined into a single kernel for
+// efficiency: prepare the data, idle, extract the syndrome and measure the
+// data.
+template <unsigned distance, unsigned idle_rounds>
+quantum_kernel void repCodeShot(cbit syndrome[], cbit result[]) {
+  for (unsigned i = 0; i < distance; i++)
+    PrepZ(qdata[i]);
+
+  for (unsigned t = 0; t < idle_rounds; t++) {
+    for (unsigned i = 0; i < distance; i++) {
       X(qdata[i]);
       Y(qdata[i]);
       Z(qdata[i]);
     }
-    for (int i = 0; i < distance - 1; i++) {
+    for (unsigned i = 0; i < distance - 1; i++) {
       X(anc[i]);
       Y(anc[i]);
       Z(anc[i]);
     }
   }
-}
 
-// The logical operator is measured as the parity of the measurement of all data
-// qubits.
-template <unsigned distance> quantum_kernel void measData(cbit result[]) {
-  for (int i = 0; i < distance; i++)
+  for (unsigned i = 0; i < distance - 1; i++) {
+    PrepZ(anc[i]);
+    H(anc[i]);
+  }
+  for (unsigned i = 0; i < distance - 1; i++)
+    CZ(qdata[i], anc[i]);
+  for (unsigned i = 0; i < distance - 1; i++)
+    CZ(qdata[i + 1], anc[i]);
+  for (unsigned i = 0; i < distance - 1; i++) {
+    H(anc[i]);
+    MeasZ(anc[i], syndrome[i]);
+  }
+
+  for (unsigned i = 0; i < distance; i++)
     MeasZ(qdata[i], result[i]);
 }
 
-// The full quantum process is joined into a single process for efficiency.
-template <unsigned distance>
-quantum_kernel void runFullRepCodeQuantum(cbit syndrome[], cbit result[]) {
-  prepData<distance, false>();
-  idle<10, distance>();
-  measureRepCodeSyndrome<distance>(syndrome);
-  measData<distance>(result);
+// The default sweep of rep_code_clifford.cfg.
+using CompiledDistances =
+    std::integer_sequence<unsigned, 5, 15, 25, 35, 45, 55, 65, 75>;
+const unsigned k_compiled_idle_rounds = 10;
+
+template <unsigned... distance>
+std::map<unsigned, RepCodeStep>
+compiledShots(std::integer_sequence<unsigned, distance...>) {
+  return {{distance, +[](cbit *syndrome, cbit *result) {
+             repCodeShot<distance, k_compiled_idle_rounds>(syndrome, result);
+           }}...};
+}
+
+// The single-kernel shot for (distance, idle_rounds), or null.
+RepCodeStep compiledRepCodeShot(unsigned distance, unsigned idle_rounds) {
+  static const std::map<unsigned, RepCodeStep> shots =
+      compiledShots(CompiledDistances());
+  auto it = shots.find(distance);
+  return idle_rounds == k_compiled_idle_rounds && it != shots.end()
+             ? it->second
+             : nullptr;
+}
+
+// The same shot as a sequence of per-qubit steps, in the same gate order.
+// The sequence is built once per distance and idle time.
+const std::vector<RepCodeStep> &repCodeSequence(unsigned distance,
+                                                unsigned idle_rounds) {
+  static std::map<std::pair<unsigned, unsigned>, std::vector<RepCodeStep>>
+      sequences;
+  auto it = sequences.find({distance, idle_rounds});
+  if (it != sequences.end())
+    return it->second;
+
+  std::vector<RepCodeStep> sequence;
+  auto append = [&](const auto &steps, unsigned count) {
+    sequence.insert(sequence.end(), steps.begin(), steps.begin() + count);
+  };
+  append(k_prep_data_steps, distance);
+  for (unsigned t = 0; t < idle_rounds; t++) {
+    append(k_idle_data_steps, distance);
+    append(k_idle_ancilla_steps, distance - 1);
+  }
+  append(k_prep_ancilla_steps, distance - 1);
+  append(k_entangle_left_steps, distance - 1);
+  append(k_entangle_right_steps, distance - 1);
+  append(k_measure_ancilla_steps, distance - 1);
+  append(k_measure_data_steps, distance);
+  return sequences[{distance, idle_rounds}] = std::move(sequence);
+}
+
+void runFullRepCodeQuantum(unsigned distance, unsigned idle_rounds,
+                           cbit syndrome[], cbit result[]) {
+  if (RepCodeStep shot = compiledRepCodeShot(distance, idle_rounds)) {
+    shot(syndrome, result);
+    return;
+  }
+  for (RepCodeStep step : repCodeSequence(distance, idle_rounds))
+    step(syndrome, result);
 }
 
 // Next, The decoder is a minority vote on the number of bit flips
 // (i.e. majority are not flipped).
 
-template <unsigned distance> bool countMinorityParityDecoding(cbit syndrome[]) {
-  int cnt = 0;
+bool countMinorityParityDecoding(unsigned distance, const cbit syndrome[]) {
+  unsigned cnt = 0;
   // The syndrome flips the count on/off,
   // i.e. to form "strings" between syndrome bits.
   bool cont_cnt = false;
@@ -141,7 +327,7 @@ template <unsigned distance> bool countMinorityParityDecoding(cbit syndrome[]) {
   std::cout << "decode:  ";
 #endif
 
-  for (int i = 0; i < distance - 1; i++) {
+  for (unsigned i = 0; i < distance - 1; i++) {
     cont_cnt = cont_cnt ^ syndrome[i];
     cnt += cont_cnt;
 
@@ -163,14 +349,14 @@ template <unsigned distance> bool countMinorityParityDecoding(cbit syndrome[]) {
 }
 
 // This is a small utility for calculating the overall parity.
-template <unsigned distance> bool calculateParity(cbit outcomes[]) {
+bool calculateParity(unsigned distance, const cbit outcomes[]) {
   bool out = false;
 
 #ifdef DEBUG_MEAS
   std::cout << "data:   ";
 #endif
 
-  for (int i = 0; i < distance; i++) {
+  for (unsigned i = 0; i < distance; i++) {
     out = out ^ outcomes[i];
 
 #ifdef DEBUG_MEAS
@@ -185,69 +371,307 @@ template <unsigned distance> bool calculateParity(cbit outcomes[]) {
   return out;
 }
 
-// The code distance is scaled through the use of template recursion.
-// There are three template arguments to define:
-// 'start' - the code size to start with
-// 'end' - the last code size to simulate
-// 'inc' - the increment in the code size between calls
+// The graph decoders see the syndrome as the detectors of
+// DetectorGraph::repetitionCode. With equal weights along the chain the
+// minimum-weight correction is the minority one, and both "matching" and
+// "union_find" predict exactly what the minority vote does, ties included,
+// so all three give the same histograms here. The graph decoders are for
+// graphs with unequal weights, where that no longer holds.
+std::unique_ptr<GraphDecoder> makeRepCodeDecoder(const std::string &kind,
+                                                 unsigned distance) {
+  DetectorGraph graph = DetectorGraph::repetitionCode(distance);
+  if (kind == "union_find")
+    return std::unique_ptr<GraphDecoder>(new UnionFindDecoder(graph));
+  return std::unique_ptr<GraphDecoder>(new MatchingDecoder(graph));
+}
 
-// Multiple asyncronous simulations are used to gather statistics.
+// Decoders are not thread safe, so every decoder thread builds its own,
+// once per distance.
+GraphDecoder &repCodeDecoder(const std::string &kind, unsigned distance) {
+  thread_local std::map<unsigned, std::unique_ptr<GraphDecoder>> decoders;
+  std::unique_ptr<GraphDecoder> &decoder = decoders[distance];
+  if (!decoder)
+    decoder = makeRepCodeDecoder(kind, distance);
+  return *decoder;
+}
 
-// This is the base case.
-template <int start, int end, int inc>
-void runRepCodes(unsigned *counts, unsigned shots,
-                 iqsdk::CliffordSimulator sims[], unsigned num_sims,
-                 typename std::enable_if<(start > end)>::type * = 0) {}
+bool graphDecoding(const std::string &kind, unsigned distance,
+                   const cbit syndrome[]) {
+  thread_local std::vector<unsigned> defects;
+  defects.clear();
+  for (unsigned i = 0; i < distance - 1; i++)
+    if (syndrome[i])
+      defects.push_back(i);
+  return repCodeDecoder(kind, distance).decode(defects);
+}
 
-// This is the recursive call.
-template <int start, int end, int inc>
-void runRepCodes(unsigned *counts, unsigned shots,
-                 iqsdk::CliffordSimulator sims[], unsigned num_sims,
-                 typename std::enable_if<(start <= end)>::type * = 0) {
+// True if decoding the shot leaves a logical error.
+bool decodeShot(const std::string &decoder, unsigned distance,
+                const cbit syndrome[], const cbit result[]) {
+  bool error = calculateParity(distance, result) ^
+               (decoder == "minority"
+                    ? countMinorityParityDecoding(distance, syndrome)
+                    : graphDecoding(decoder, distance, syndrome));
 
-  cbit syndrome[num_sims][start - 1];
-  bool results[num_sims][start];
-  std::cout << "    Starting on distance " << start << "\n";
+#ifdef DEBUG_MEAS
+  std::cout << "\n";
+#endif
 
-  for (int i = 0; i < shots; i++) {
-    for (unsigned s = 0; s < num_sims; s++) {
-      // Select simulation 's' for the runtime.
-      sims[s].ready();
-      runFullRepCodeQuantum<start>(syndrome[s], results[s]);
-    }
-    for (unsigned s = 0; s < num_sims; s++) {
-      // Make sure simulation 's' has returned its results.
-      sims[s].wait();
+  return error;
+}
 
-      // Note: This use of asyncronous mode is beneficial because
-      // the complexity of the Clifford simulation is O(('start')^2),
-      // as each gate is O('start') in the worst case,
-      // whereas decoding is O('start'). So in this mode, each
-      // Clifford simulation is run in parallel, but the main process
-      // performs decoding for all of them in sequence. If the complexity
-      // of decoding is the same as the Clifford simulation, another
-      // parallelization method may be needed to see a speed-up.
+// The sweep, as read from the configuration file. Each line is
+// "key = value", '#' starts a comment, and the command line can override
+// any key with "key=value".
+struct RepCodeConfig {
+  std::string mode = "frames";
+  std::vector<unsigned> distances = {5, 15, 25, 35, 45, 55, 65, 75};
+  // The xyrot error rates, i.e. the error of the idling.
+  std::vector<double> error_rates = {3e-6, 1.2e-5, 4.8e-5, 1.92e-4, 7.68e-4};
+  // The fixed error of every other gate.
+  double gate_error = 0.001;
+  unsigned idle_rounds = 10;
+  // 0 picks 100000 for frames and 1000 for simulators.
+  unsigned shots = 0;
+  unsigned num_sims = 50;
+  unsigned decoders = 2;
+  // minority, union_find or matching.
+  std::string decoder = "minority";
+};
+
+// "5 15 25", or "5:75:10" for 5 to 75 in steps of 10.
+std::vector<unsigned> parseDistances(const std::string &value) {
+  std::vector<unsigned> distances;
+  unsigned first, last, step;
+  char colon1, colon2;
+  std::stringstream range(value);
+  if (range >> first >> colon1 >> last >> colon2 >> step && colon1 == ':' &&
+      colon2 == ':' && step > 0) {
+    for (unsigned d = first; d <= last; d += step)
+      distances.push_back(d);
+    return distances;
+  }
+  std::stringstream list(value);
+  for (unsigned d; list >> d;)
+    distances.push_back(d);
+  if (!list.eof())
+    throw std::runtime_error("bad distances \"" + value + "\"");
+  return distances;
+}
 
-      (*counts) += calculateParity<start>(results[s]) ^
-                   countMinorityParityDecoding<start>(syndrome[s]);
+void setRepCodeOption(RepCodeConfig &config, const std::string &setting) {
+  std::size_t equals = setting.find('=');
+  if (equals == std::string::npos)
+    throw std::runtime_error("expected key = value, got \"" + setting + "\"");
+  std::stringstream key_stream(setting.substr(0, equals));
+  std::string key, value = setting.substr(equals + 1);
+  key_stream >> key;
+  std::stringstream values(value);
+  auto read = [&](auto &target) {
+    if (!(values >> target))
+      throw std::runtime_error("bad value for " + key + ": \"" + value + "\"");
+  };
+
+  if (key == "mode")
+    read(config.mode);
+  else if (key == "distances")
+    config.distances = parseDistances(value);
+  else if (key == "error_rates") {
+    config.error_rates.clear();
+    for (double rate; values >> rate;)
+      config.error_rates.push_back(rate);
+    if (!values.eof())
+      throw std::runtime_error("bad error rates \"" + value + "\"");
+  } else if (key == "gate_error")
+    read(config.gate_error);
+  else if (key == "idle_rounds")
+    read(config.idle_rounds);
+  else if (key == "shots")
+    read(config.shots);
+  else if (key == "num_sims")
+    read(config.num_sims);
+  else if (key == "decoders")
+    read(config.decoders);
+  else if (key == "decoder")
+    read(config.decoder);
+  else
+    throw std::runtime_error("unknown key \"" + key + "\"");
+}
 
-#ifdef DEBUG_MEAS
-      std::cout << "\n";
-#endif
-    }
+void readRepCodeConfig(RepCodeConfig &config, const std::string &path) {
+  std::ifstream file(path);
+  if (!file)
+    throw std::runtime_error("unable to open " + path);
+  for (std::string line; std::getline(file, line);) {
+    line = line.substr(0, line.find('#'));
+    if (line.find_first_not_of(" \t\r") != std::string::npos)
+      setRepCodeOption(config, line);
   }
+}
+
+void checkRepCodeConfig(RepCodeConfig &config) {
+  if (config.mode != "frames" && config.mode != "simulators")
+    throw std::runtime_error("unknown mode " + config.mode +
+                             " (frames or simulators)");
+  if (config.decoder != "minority" && config.decoder != "union_find" &&
+      config.decoder != "matching")
+    throw std::runtime_error("unknown decoder " + config.decoder +
+                             " (minority, union_find or matching)");
+  if (config.distances.empty() || config.error_rates.empty())
+    throw std::runtime_error("no distances or no error rates");
+  for (unsigned d : config.distances)
+    if (d < 2 || d > MAX_DISTANCE)
+      throw std::runtime_error("distance " + std::to_string(d) +
+                               " outside 2.." + std::to_string(MAX_DISTANCE));
+  if (config.num_sims == 0)
+    throw std::runtime_error("num_sims must be at least 1");
+  if (config.shots == 0)
+    config.shots = config.mode == "frames" ? 100000 : 1000;
+}
+
+// The syndrome and data results of every simulation, allocated once for
+// the largest distance of the sweep and reused for all of them.
+class RepCodeBuffers {
+public:
+  RepCodeBuffers(unsigned num_sims, unsigned max_distance)
+      : max_distance(max_distance),
+        syndromes(new cbit[std::size_t(num_sims) * (max_distance - 1)]()),
+        results(new cbit[std::size_t(num_sims) * max_distance]()) {}
+
+  cbit *syndrome(unsigned sim) {
+    return syndromes.get() + std::size_t(sim) * (max_distance - 1);
+  }
+  cbit *result(unsigned sim) {
+    return results.get() + std::size_t(sim) * max_distance;
+  }
+
+private:
+  unsigned max_distance;
+  std::unique_ptr<cbit[]> syndromes, results;
+};
+
+// A shot on its way to a decoder thread: copies of its measurements and
+// the histogram bin it counts toward.
+struct RepCodeShot {
+  std::atomic<unsigned> *count;
+  unsigned distance;
+  cbit syndrome[MAX_DISTANCE - 1];
+  cbit results[MAX_DISTANCE];
+};
+
+using RepCodePipeline = DecodePipeline<RepCodeShot>;
 
-  // Call next size of code for recursion.
-  runRepCodes<start + inc, end, inc>(counts + 1, shots, sims, num_sims);
+// Multiple asyncronous simulations are used to gather statistics.
+void runRepCode(unsigned distance, const RepCodeConfig &config,
+                std::atomic<unsigned> *count, unsigned shots,
+                iqsdk::CliffordSimulator sims[], RepCodeBuffers &buffers,
+                RepCodePipeline &pipeline) {
+  const unsigned num_sims = config.num_sims;
+  std::cout << "    Starting on distance " << distance
+            << (compiledRepCodeShot(distance, config.idle_rounds)
+                    ? "\n"
+                    : " (per-qubit kernels, not compiled in)\n");
+
+  RepCodeShot shot;
+  shot.count = count;
+  shot.distance = distance;
+
+  // Round 'i' collects shot i - 1 of every simulation and starts shot i.
+  for (unsigned i = 0; i <= shots; i++) {
+    for (unsigned s = 0; s < num_sims; s++) {
+      if (i > 0) {
+        // Make sure simulation 's' has returned its results.
+        sims[s].wait();
+
+        // Note: The Clifford simulation of a shot is O(('distance')^2), as
+        // each gate is O('distance') in the worst case, and decoding is
+        // O('distance'), but decoding every shot here in sequence would
+        // still hold up the next round once there are enough simulations.
+        // So the shot is copied out and handed to the decoder threads, and
+        // simulation 's' is restarted right away.
+        std::copy(buffers.syndrome(s), buffers.syndrome(s) + distance - 1,
+                  shot.syndrome);
+        std::copy(buffers.result(s), buffers.result(s) + distance,
+                  shot.results);
+        pipeline.push(shot);
+      }
+      if (i < shots) {
+        // Select simulation 's' for the runtime.
+        sims[s].ready();
+        runFullRepCodeQuantum(distance, config.idle_rounds,
+                              buffers.syndrome(s), buffers.result(s));
+      }
+    }
+  }
 }
 
-int main() {
+// The Pauli-frame version of runRepCode: the circuit is recorded once,
+// then its shots are sampled and decoded in batches. A graph decoder takes
+// the whole batch at once, straight from the bit-packed rows.
+const unsigned frame_batch = 1 << 16;
+
+void runRepCodeFrames(unsigned distance, const RepCodeConfig &config,
+                      std::atomic<unsigned> *count, unsigned shots,
+                      CliffordRecorder &recorder, RepCodeBuffers &buffers) {
+  cbit *syndrome = buffers.syndrome(0), *results = buffers.result(0);
+  std::cout << "    Starting on distance " << distance;
+
+  auto begin = std::chrono::steady_clock::now();
+  recorder.clear();
+  runFullRepCodeQuantum(distance, config.idle_rounds, syndrome, results);
+
+  // Measurements are recorded syndrome first, then data.
+  PauliFrameSampler sampler(recorder.circuit, rand());
+  ShotMatrix batch;
+  const bool batch_decoding = config.decoder != "minority";
+  std::vector<std::uint8_t> predictions;
+  for (unsigned first = 0; first < shots; first += frame_batch) {
+    sampler.sample(std::min(frame_batch, shots - first), batch);
+    if (batch_decoding)
+      repCodeDecoder(config.decoder, distance)
+          .decodeBatch(batch, 0, predictions);
+    for (std::size_t shot = 0; shot < batch.numShots(); shot++) {
+      for (unsigned i = 0; i < distance; i++)
+        results[i] = batch.get(shot, distance - 1 + i);
+      if (batch_decoding) {
+        (*count) += calculateParity(distance, results) ^ predictions[shot];
+        continue;
+      }
+      for (unsigned i = 0; i < distance - 1; i++)
+        syndrome[i] = batch.get(shot, i);
+
+      (*count) += decodeShot(config.decoder, distance, syndrome, results);
+    }
+  }
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - begin)
+                       .count();
+  std::cout << " (" << shots / seconds << " shots/s)\n";
+}
 
-  // Define template parameters for scaling the code distance.
-  const unsigned start = 5;
-  const unsigned end = 75;
-  const unsigned inc = 10;
-  const unsigned num_codes = (end - start) / inc + 1;
+// Usage: rep_code_clifford [config_file] [key=value ...]
+// Without a file the defaults of RepCodeConfig are used; key=value
+// arguments override single entries, e.g. "mode=simulators shots=2000".
+int main(int argc, char *argv[]) {
+  RepCodeConfig config;
+  try {
+    for (int a = 1; a < argc; a++) {
+      std::string arg = argv[a];
+      if (arg.find('=') != std::string::npos)
+        setRepCodeOption(config, arg);
+      else
+        readRepCodeConfig(config, arg);
+    }
+    checkRepCodeConfig(config);
+  } catch (const std::exception &error) {
+    std::cerr << "Error: " << error.what() << "\n";
+    return 1;
+  }
+  const bool use_frames = config.mode == "frames";
+  const unsigned num_codes = config.distances.size();
+  const unsigned num_err_rates = config.error_rates.size();
+  const unsigned max_distance =
+      *std::max_element(config.distances.begin(), config.distances.end());
 
   // Most gate have afixed gate errors and scale the xyrot error
   // to vary the error rate as this is where error is introduced by the
@@ -255,7 +679,7 @@ int main() {
   // does contain an idle error based on a T1, T2 time, but this is only
   // for necessary idling from ASAP scheduling of the gates.
 
-  double fixed_gate_err = 0.001;
+  double fixed_gate_err = config.gate_error;
 
   iqsdk::ErrorRates error_rates;
 
@@ -269,64 +693,102 @@ int main() {
 
   error_rates.cz = iqsdk::ErrSpec2Q(fixed_gate_err, 0., 0.);
 
-  double err_start = 3e-6;
-  double err_inc = 4.;
-  const unsigned num_err_rates = 5;
+  // The number of simultaneous simulations and total number of shots.
+  // Frame sampling affords many more shots.
+  const unsigned shots = config.shots;
+  const unsigned num_sims = config.num_sims;
+  unsigned shots_per_sim = shots / num_sims;
 
-  // Define the number of simultaneous simulations
-  // and total number of shots.
+  // Define the histograms for different code sizes and error rates, bin
+  // e * num_codes + d. The decoder threads add to them concurrently.
+  std::vector<std::atomic<unsigned>> histogram(num_err_rates * num_codes);
 
-  unsigned shots = 1000;
-  const unsigned num_sims = 50;
-  unsigned shots_per_sim = shots / num_sims;
-  double err_rate = err_start;
+  // Result buffers for every simulation at the largest distance; frame
+  // sampling needs one set.
+  RepCodeBuffers buffers(use_frames ? 1 : num_sims, max_distance);
 
-  // Define the histograms for different code sizes and error rates.
-  unsigned histogram[num_err_rates][num_codes] = {0};
+  // In simulators mode, one set of decoder threads serves every distance
+  // and error rate. With DEBUG_MEAS, one decoder keeps the output readable.
+  unsigned num_decoders = config.decoders;
+#ifdef DEBUG_MEAS
+  num_decoders = 1;
+#endif
+  std::unique_ptr<RepCodePipeline> pipeline;
+  if (!use_frames)
+    pipeline.reset(new RepCodePipeline(
+        num_decoders, 1024, [&config](RepCodeShot &shot) {
+          shot.count->fetch_add(decodeShot(config.decoder, shot.distance,
+                                           shot.syndrome, shot.results),
+                                std::memory_order_relaxed);
+        }));
 
   // Run over all error rates, where each rate scales the code size.
-  for (int e = 0; e < num_err_rates; e++) {
+  for (unsigned e = 0; e < num_err_rates; e++) {
+    double err_rate = config.error_rates[e];
+    std::atomic<unsigned> *counts = histogram.data() + e * num_codes;
     std::cout << "Starting on error rate " << err_rate << "\n";
 
     error_rates.xyrot =
         iqsdk::ErrSpec1Q(err_rate / 3., err_rate / 3., err_rate / 3.);
 
-    // Define the simulators.
-    iqsdk::CliffordSimulator cliff_sim[num_sims];
-    for (int i = 0; i < num_sims; i++) {
-      iqsdk::CliffordSimulatorConfig cliff_config(rand());
-      cliff_config.error_rates = error_rates;
-      cliff_config.synchronous = false;
-      cliff_config.verbose = false;
-      cliff_config.use_errors = true;
-      cliff_sim[i].initialize(cliff_config);
+    if (use_frames) {
+      // The recorder holds every declared qubit, as the simulators do, and
+      // reads its noise from the same error_rates (see frameNoise).
+      iqsdk::CustomSimulator *recorder_sim =
+          iqsdk::CustomSimulator::createSimulator<CliffordRecorder>(
+              "rep_code_recorder", 2 * MAX_DISTANCE - 1, frameNoise(error_rates));
+      iqsdk::QRT_ERROR_T status = recorder_sim->ready();
+      assert(status == iqsdk::QRT_ERROR_SUCCESS);
+      CliffordRecorder *recorder =
+          dynamic_cast<CliffordRecorder *>(recorder_sim->getCustomBackend());
+      assert(recorder != nullptr);
+
+      for (unsigned d = 0; d < num_codes; d++)
+        runRepCodeFrames(config.distances[d], config, counts + d, shots,
+                         *recorder, buffers);
+      delete recorder_sim;
+    } else {
+      // Define the simulators.
+      std::unique_ptr<iqsdk::CliffordSimulator[]> cliff_sim(
+          new iqsdk::CliffordSimulator[num_sims]);
+      for (unsigned i = 0; i < num_sims; i++) {
+        iqsdk::CliffordSimulatorConfig cliff_config(rand());
+        cliff_config.error_rates = error_rates;
+        cliff_config.synchronous = false;
+        cliff_config.verbose = false;
+        cliff_config.use_errors = true;
+        cliff_sim[i].initialize(cliff_config);
+      }
+
+      // Run the simulation.
+      for (unsigned d = 0; d < num_codes; d++)
+        runRepCode(config.distances[d], config, counts + d, shots_per_sim,
+                   cliff_sim.get(), buffers, *pipeline);
     }
+  }
 
-    // Run the simulation.
-    runRepCodes<start, end, inc>(histogram[e], shots_per_sim, cliff_sim,
-                                 num_sims);
-    err_rate *= err_inc;
+  if (pipeline) {
+    // Wait for the last shots to be decoded.
+    pipeline->finish();
+    std::cout << "Decoding stalled the simulations " << pipeline->stalls()
+              << " times\n";
   }
 
   // For this demonstration, the histograms results are simply printed to
-  // screen.
+  // screen. Each idle round applies three xyrot gates per qubit.
 
   std::cout << "Histogram results for repetition code:\n\n";
-  std::cout << "distance/error rate: " << err_start * 30;
-  err_rate = err_start;
-  for (unsigned e = 1; e < num_err_rates; e++) {
-    err_rate *= err_inc;
-    std::cout << ", " << err_rate * 30;
-  }
+  std::cout << "distance/error rate: ";
+  for (unsigned e = 0; e < num_err_rates; e++)
+    std::cout << (e ? ", " : "")
+              << config.error_rates[e] * 3 * config.idle_rounds;
   std::cout << "\n";
 
-  unsigned dist = start;
   for (unsigned d = 0; d < num_codes; d++) {
-    std::cout << dist << ": " << histogram[0][d];
+    std::cout << config.distances[d] << ": " << histogram[d].load();
     for (unsigned e = 1; e < num_err_rates; e++) {
-      std::cout << ", " << histogram[e][d];
+      std::cout << ", " << histogram[e * num_codes + d].load();
     }
     std::cout << "\n";
-    dist += inc;
   }
 }
@@ -17,8 +17,11 @@
 /// Quantum Runtime Library APIs
 #include <quantum_full_state_simulator_backend.h>
 
+#include <random>
 #include <unordered_map>
 
+#include "../../src/circuits/include/shot_matrix.h"
+
 const int total_qubits = 4;
 qbit qubit_register[total_qubits];
 
@@ -67,14 +70,15 @@ int main() {
             << total_probability << std::endl;
   quantum_8086.displayProbabilities(probability_map);
 
-  // use sampling technique to simulate the results of many runs
-  std::vector<std::vector<bool>> measurement_samples;
+  // use sampling technique to simulate the results of many runs; samples are
+  // drawn straight from the probabilities into one bit-packed buffer
   unsigned total_samples = 1000;
-  measurement_samples = quantum_8086.getSamples(total_samples, qids);
+  std::mt19937_64 rng(std::random_device{}());
+  ShotMatrix measurement_samples = ShotMatrix::sample(
+      quantum_8086.getProbabilities(qids), total_qubits, total_samples, rng);
 
   // build a distribution of states
-  iqsdk::QssMap<unsigned int> distribution =
-      iqsdk::FullStateSimulator::samplesToHistogram(measurement_samples);
+  iqsdk::QssMap<unsigned int> distribution = measurement_samples.toQssMap();
 
   // print out the results
   std::cout << "Using " << total_samples
@@ -0,0 +1,359 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <clang/Quantum/quintrinsics.h>
+#include <quantum_clifford_simulator_backend.h>
+#include <quantum_full_state_simulator_backend.h>
+#include <quantum_tensor_network_backend.h>
+
+#include "include/benchmark.h"
+#include "include/gate_classifier.h"
+#include "include/noise_registry.h"
+
+
+// Throughput benchmark: runs every kernel below on every requested backend
+// for each qubit count in [min_qubits, max_qubits] and writes one CSV row
+// per (kernel, backend, qubits) point, see include/benchmark.h.
+//
+// A shot is one execution of a measured kernel. Each point gets a freshly
+// initialized device (the tensor network one per shot, see measure()), so
+// every backend, including the Clifford simulator and QD_SIM, returns its
+// single-shot results the same way.
+
+const int max_qubits = 32;
+qbit qubit_register[max_qubits];
+cbit cbit_register[max_qubits];
+
+const double k_depolarizing_rate = 0.001;
+
+
+//===----------------------------------------------------------------------===//
+// Kernels, templated on the number of qubits. Each comes with the number of
+// gates it applies per shot.
+
+template <unsigned n> quantum_kernel void ghzBenchmark() {
+  for (int i = 0; i < n; i++)
+    PrepZ(qubit_register[i]);
+  H(qubit_register[0]);
+  for (int i = 0; i < n - 1; i++)
+    CNOT(qubit_register[i], qubit_register[i + 1]);
+  for (int i = 0; i < n; i++)
+    MeasZ(qubit_register[i], cbit_register[i]);
+}
+
+constexpr unsigned ghzGates(unsigned n) { return n + 1 + (n - 1) + n; }
+
+
+// Same structure as qft_error.cpp.
+template <unsigned n> quantum_kernel void qftBenchmark() {
+  for (int i = 0; i < n; i++)
+    PrepZ(qubit_register[i]);
+  for (int index = 0; index < n; index++) {
+    H(qubit_register[index]);
+    for (int index_r = 1; index_r < n - index; index_r++) {
+      double angle = 2 * (1 / M_1_PI) / std::pow(2, index_r + 1);
+      CPhase(qubit_register[index + index_r], qubit_register[index], angle);
+    }
+  }
+  for (int i = 0; i < n / 2; i++)
+    SWAP(qubit_register[i], qubit_register[n - i - 1]);
+  for (int i = 0; i < n; i++)
+    MeasZ(qubit_register[i], cbit_register[i]);
+}
+
+constexpr unsigned qftGates(unsigned n) {
+  return n + n + n * (n - 1) / 2 + n / 2 + n;
+}
+
+
+// One time step of the MBL circuit of iqs_custom_noise.cpp on a chain.
+template <unsigned n> quantum_kernel void mblBenchmark() {
+  for (int i = 0; i < n; i++)
+    PrepZ(qubit_register[i]);
+  for (int i = 0; i < n; i += 2)
+    X(qubit_register[i]);
+  for (int i = 0; i < n - 1; i++) {
+    CNOT(qubit_register[i], qubit_register[i + 1]);
+    RZ(qubit_register[i], 9.563581772879);
+    RZ(qubit_register[i + 1], 8.0);
+    H(qubit_register[i]);
+    CNOT(qubit_register[i], qubit_register[i + 1]);
+    RZ(qubit_register[i], 8.0);
+    RZ(qubit_register[i + 1], -8.0);
+    CNOT(qubit_register[i], qubit_register[i + 1]);
+    H(qubit_register[i]);
+    CNOT(qubit_register[i], qubit_register[i + 1]);
+  }
+  for (int i = 0; i < n; i++)
+    RX(qubit_register[i], 4.94709917593 + 0.1 * i);
+  for (int i = 0; i < n; i++)
+    MeasZ(qubit_register[i], cbit_register[i]);
+}
+
+constexpr unsigned mblGates(unsigned n) {
+  return n + (n + 1) / 2 + 10 * (n - 1) + n + n;
+}
+
+
+// Repetition code of rep_code_clifford.cpp: distance (n + 1) / 2 on
+// 2 * distance - 1 qubits, one idle round, then syndrome and data readout.
+template <unsigned n> quantum_kernel void repCodeBenchmark() {
+  // Data qubits first, then the ancillas.
+  const int distance = (n + 1) / 2;
+  for (int i = 0; i < distance; i++)
+    PrepZ(qubit_register[i]);
+  for (int i = 0; i < distance; i++) {
+    X(qubit_register[i]);
+    Y(qubit_register[i]);
+    Z(qubit_register[i]);
+  }
+  for (int i = 0; i < distance - 1; i++) {
+    PrepZ(qubit_register[distance + i]);
+    H(qubit_register[distance + i]);
+  }
+  for (int i = 0; i < distance - 1; i++)
+    CZ(qubit_register[i], qubit_register[distance + i]);
+  for (int i = 0; i < distance - 1; i++)
+    CZ(qubit_register[i + 1], qubit_register[distance + i]);
+  for (int i = 0; i < distance - 1; i++) {
+    H(qubit_register[distance + i]);
+    MeasZ(qubit_register[distance + i], cbit_register[distance + i]);
+  }
+  for (int i = 0; i < distance; i++)
+    MeasZ(qubit_register[i], cbit_register[i]);
+}
+
+constexpr unsigned repCodeQubits(unsigned n) { return 2 * ((n + 1) / 2) - 1; }
+constexpr unsigned repCodeGates(unsigned n) {
+  return (n + 1) / 2 * 5 + ((n + 1) / 2 - 1) * 6;
+}
+
+
+// Thermofield double of tfd_q4_hybrid_demo.cpp on two chains of n / 2
+// qubits, with fixed variational parameters.
+const double k_tfd_params[4] = {0.3, 0.7, 1.1, 0.5};
+
+template <unsigned n> quantum_kernel void tfdBenchmark() {
+  const int half = n / 2;
+  for (int i = 0; i < 2 * half; i++)
+    PrepZ(qubit_register[i]);
+  for (int i = 0; i < half; i++)
+    RY(qubit_register[i], 1.57079632679);
+  for (int i = 0; i < half; i++)
+    CNOT(qubit_register[i], qubit_register[i + half]);
+  for (int i = 0; i < 2 * half; i++)
+    RX(qubit_register[i], k_tfd_params[2]);
+  // Intra-system ZZ terms on neighbouring qubits of each chain.
+  for (int s = 0; s < 2; s++) {
+    for (int i = 0; i < half - 1; i++) {
+      CNOT(qubit_register[s * half + i + 1], qubit_register[s * half + i]);
+      RZ(qubit_register[s * half + i], k_tfd_params[3]);
+      CNOT(qubit_register[s * half + i + 1], qubit_register[s * half + i]);
+    }
+  }
+  // Inter-system XX terms.
+  for (int i = 0; i < 2 * half; i++)
+    RY(qubit_register[i], -1.57079632679);
+  for (int i = 0; i < half; i++) {
+    CNOT(qubit_register[i + half], qubit_register[i]);
+    RZ(qubit_register[i], k_tfd_params[0]);
+    CNOT(qubit_register[i + half], qubit_register[i]);
+  }
+  for (int i = 0; i < 2 * half; i++)
+    RY(qubit_register[i], 1.57079632679);
+  // Inter-system ZZ terms.
+  for (int i = 0; i < half; i++) {
+    CNOT(qubit_register[i], qubit_register[i + half]);
+    RZ(qubit_register[i + half], k_tfd_params[1]);
+    CNOT(qubit_register[i], qubit_register[i + half]);
+  }
+  for (int i = 0; i < 2 * half; i++)
+    MeasZ(qubit_register[i], cbit_register[i]);
+}
+
+constexpr unsigned tfdQubits(unsigned n) { return n / 2 * 2; }
+constexpr unsigned tfdGates(unsigned n) {
+  return 5 * (n / 2 * 2) + 8 * (n / 2) + 6 * (n / 2 - 1);
+}
+
+
+struct BenchmarkKernel {
+  const char *name;
+  unsigned num_qubits;
+  unsigned num_gates;
+  // Only Clifford gates, so the Clifford simulator can run it.
+  bool clifford;
+  void (*run)();
+};
+
+template <unsigned n> void addKernels(std::vector<BenchmarkKernel> &kernels) {
+  kernels.push_back({"ghz", n, ghzGates(n), true, [] { ghzBenchmark<n>(); }});
+  kernels.push_back({"qft", n, qftGates(n), false, [] { qftBenchmark<n>(); }});
+  kernels.push_back({"mbl", n, mblGates(n), false, [] { mblBenchmark<n>(); }});
+  kernels.push_back({"rep_code", repCodeQubits(n), repCodeGates(n), true,
+                     [] { repCodeBenchmark<n>(); }});
+  kernels.push_back({"tfd", tfdQubits(n), tfdGates(n), false, [] { tfdBenchmark<n>(); }});
+}
+
+// Qubit counts compiled into the benchmark; the command line picks a range.
+template <unsigned... sizes> std::vector<BenchmarkKernel> allKernels() {
+  std::vector<BenchmarkKernel> kernels;
+  (addKernels<sizes>(kernels), ...);
+  return kernels;
+}
+
+
+//===----------------------------------------------------------------------===//
+// Custom noise: the calibrated process matrices of iqs_custom_noise.cpp,
+// depolarizing noise on every other rotation.
+
+const GateClassifier<iqsdk::IqsCustomOp> &customNoiseOps() {
+  // Loaded on first use, so the other backends run without noise_models/.
+  static const NoiseModelRegistry &models = NoiseModelRegistry::instance();
+  static const GateClassifier<iqsdk::IqsCustomOp> ops(1e-4, {
+    {GateType::RotationXY, M_PI/2, M_PI/2, {0, 0, 0, 0, models.get("good/qds_yppi2").chi, "yppi2", 0, 0, 0, 0}},
+    {GateType::RotationXY, M_PI/2, -M_PI/2, {0, 0, 0, 0, models.get("good/qds_ynpi2").chi, "ynpi2", 0, 0, 0, 0}},
+    {GateType::RotationXY, 3*M_PI/2, M_PI/2, {0, 0, 0, 0, models.get("good/qds_ynpi2").chi, "ynpi2", 0, 0, 0, 0}},
+    {GateType::CPhase, 0, M_PI, {0, 0, 0, 0, models.get("good/qds_cz").chi, "cz", 0, 0, 0, 0}}});
+  return ops;
+}
+
+const iqsdk::IqsCustomOp k_depolarizing_op = {0, k_depolarizing_rate, 0, 0, {}, "", 0, 0, 0, 0};
+
+iqsdk::IqsCustomOp CustomRotationXY(unsigned qubit, double phi, double gamma) {
+  return customNoiseOps().lookup(GateType::RotationXY, phi, gamma, k_depolarizing_op);
+}
+
+iqsdk::IqsCustomOp CustomCPhaseRotation(unsigned qubit_1, unsigned qubit_2, double gamma) {
+  return customNoiseOps().lookup(GateType::CPhase, 0, gamma, iqsdk::k_iqs_ideal_op);
+}
+
+
+//===----------------------------------------------------------------------===//
+// Backends
+
+const std::vector<std::string> k_backends = {
+  "iqs_noiseless", "iqs_depolarizing", "iqs_custom", "clifford", "tensor_network", "qd_sim"
+};
+
+// Runs `record.num_shots` shots of `kernel` on a fresh simulator and fills
+// in the timing. With `device_per_shot` every shot gets its own simulator,
+// and its setup is timed too: the tensor network keeps growing when kernels
+// are re-run on one instance, so that is how it should be sampled.
+template <typename Simulator, typename Config>
+void measure(Config config, const BenchmarkKernel &kernel, BenchmarkRecord &record,
+             bool device_per_shot = false) {
+  resetPeakRss();
+  Stopwatch stopwatch;
+  const std::uint64_t shots_per_device = device_per_shot ? 1 : record.num_shots;
+  for (std::uint64_t shot = 0; shot < record.num_shots; shot += shots_per_device) {
+    Simulator sim;
+    sim.initialize(config);
+    if (iqsdk::QRT_ERROR_SUCCESS != sim.ready()) {
+      record.status = "not_ready";
+      return;
+    }
+    // Without device_per_shot only the shots are timed.
+    if (!device_per_shot)
+      stopwatch = Stopwatch();
+    for (std::uint64_t i = 0; i < shots_per_device; i++)
+      kernel.run();
+  }
+  record.wall_seconds = stopwatch.seconds();
+  record.peak_rss_bytes = peakRssBytes();
+}
+
+void runPoint(const BenchmarkKernel &kernel, BenchmarkRecord &record, std::uint64_t seed) {
+  const std::string &backend = record.backend;
+  const unsigned n = kernel.num_qubits;
+  if (backend == "clifford" && !kernel.clifford) {
+    record.status = "skipped_non_clifford";
+    return;
+  }
+  if (backend == "iqs_noiseless") {
+    measure<iqsdk::FullStateSimulator>(iqsdk::IqsConfig(n, "noiseless", false, seed), kernel, record);
+  } else if (backend == "iqs_depolarizing") {
+    measure<iqsdk::FullStateSimulator>(
+        iqsdk::IqsConfig(n, "depolarizing", false, seed, true, k_depolarizing_rate), kernel, record);
+  } else if (backend == "iqs_custom") {
+    iqsdk::IqsConfig config(n, "custom", false, seed);
+    config.RotationXY = CustomRotationXY;
+    config.CPhaseRotation = CustomCPhaseRotation;
+    measure<iqsdk::FullStateSimulator>(config, kernel, record);
+  } else if (backend == "clifford") {
+    measure<iqsdk::CliffordSimulator>(iqsdk::CliffordSimulatorConfig(seed), kernel, record);
+  } else if (backend == "tensor_network") {
+    measure<iqsdk::TensorNetworkSimulator>(iqsdk::TensorNetworkConfig(), kernel, record, true);
+  } else if (backend == "qd_sim") {
+    measure<iqsdk::FullStateSimulator>(iqsdk::DeviceConfig("QD_SIM"), kernel, record);
+  } else {
+    record.status = "unknown_backend";
+  }
+}
+
+
+// Usage: benchmark [output_csv] [min_qubits] [max_qubits] [num_shots]
+//                  [backends] [label] [seed]
+// `backends` is a comma-separated subset of k_backends (default: all but
+// qd_sim, which needs the program compiled with the QD_SIM platform config,
+// see the SDK guide). `label` tags every row, e.g. with the SDK release, so
+// reports can be diffed.
+int main(int argc, char *argv[]) {
+  std::string output = argc > 1 ? argv[1] : "results/benchmark/benchmark.csv";
+  unsigned min_qubits = argc > 2 ? std::atoi(argv[2]) : 2;
+  unsigned max_qubits_run = argc > 3 ? std::atoi(argv[3]) : 16;
+  std::uint64_t num_shots = argc > 4 ? std::strtoull(argv[4], nullptr, 10) : 100;
+  std::string backend_list = argc > 5
+    ? argv[5]
+    : "iqs_noiseless,iqs_depolarizing,iqs_custom,clifford,tensor_network";
+  std::string label = argc > 6 ? argv[6] : "default";
+  std::uint64_t seed = argc > 7 ? std::strtoull(argv[7], nullptr, 10) : 12345;
+
+  std::vector<std::string> backends;
+  std::stringstream backend_names(backend_list);
+  for (std::string backend; std::getline(backend_names, backend, ',');) {
+    if (std::find(k_backends.begin(), k_backends.end(), backend) == k_backends.end()) {
+      std::cerr << "Error: unknown backend \"" << backend << "\"" << std::endl;
+      return 1;
+    }
+    backends.push_back(backend);
+  }
+
+  BenchmarkReport report(output);
+  if (!report.isOpen()) {
+    std::cerr << "Error: Unable to open " << output << std::endl;
+    return 1;
+  }
+
+  std::vector<BenchmarkKernel> kernels = allKernels<2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30, 32>();
+  for (const BenchmarkKernel &kernel : kernels) {
+    if (kernel.num_qubits < min_qubits || kernel.num_qubits > max_qubits_run)
+      continue;
+    for (const std::string &backend : backends) {
+      BenchmarkRecord record;
+      record.label = label;
+      record.kernel = kernel.name;
+      record.backend = backend;
+      record.num_qubits = kernel.num_qubits;
+      record.num_gates = kernel.num_gates;
+      record.num_shots = num_shots;
+      try {
+        runPoint(kernel, record, seed);
+      } catch (const std::exception &error) {
+        record.status = "error";
+        std::cerr << kernel.name << " on " << backend << ": " << error.what() << std::endl;
+      }
+      report.add(record);
+      std::cout << kernel.name << "\t" << backend << "\t" << kernel.num_qubits
+                << "\t" << record.wall_seconds << " s\t" << record.status << std::endl;
+    }
+  }
+  return 0;
+}
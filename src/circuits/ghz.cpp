@@ -1,53 +1,104 @@
 #include <clang/Quantum/quintrinsics.h>
 
+#include <array>
+#include <cstddef>
+#include <map>
+#include <utility>
+#include <vector>
 
-const int TOTAL_QUBITS = 20;
+#include "include/shot_batch.h"
+
+
+const int TOTAL_QUBITS = 32;
 qbit qubit_register[TOTAL_QUBITS];
 cbit cbit_register[TOTAL_QUBITS];
 
 
-#define GHZ(N) \
-quantum_kernel void ghz_##N() { \
-  for (int i = 0; i < N; i++) { \
-    PrepZ(qubit_register[i]); \
-  } \
-  H(qubit_register[0]); \
-  for (int i = 0; i < N - 1; i++) { \
-    CNOT(qubit_register[i], qubit_register[i + 1]); \
-  } \
-} \
-quantum_kernel void ghzM_##N() { \
-  for (int i = 0; i < N; i++) { \
-    PrepZ(qubit_register[i]); \
-  } \
-  H(qubit_register[0]); \
-  for (int i = 0; i < N - 1; i++) { \
-    CNOT(qubit_register[i], qubit_register[i + 1]); \
-  } \
-  for (int i = 0; i < N; i++) { \
-    MeasZ(qubit_register[i], cbit_register[i]); \
-  } \
-}
-
-GHZ(1)
-GHZ(2)
-GHZ(3)
-GHZ(4)
-GHZ(5)
-GHZ(6)
-GHZ(7)
-GHZ(8)
-GHZ(9)
-GHZ(10)
-GHZ(11)
-GHZ(12)
-GHZ(13)
-GHZ(14)
-GHZ(15)
-GHZ(16)
-GHZ(17)
-GHZ(18)
-GHZ(19)
-GHZ(20)
-
-#undef GHZ
+// GHZ states of any size up to TOTAL_QUBITS, picked at run time.
+//
+// Qubit indices in a quantum_kernel are fixed when the program is
+// compiled. FLEQ could still take the size at run time, since qexpr::cIf
+// takes a runtime bool: one expression over the whole register could guard
+// the gates of qubit i with i < n. That expression would hold the gates of
+// all TOTAL_QUBITS qubits, though, and evaluate every guard on each run.
+// Instead there is one small kernel per qubit: ghzQubit<i> prepares qubit i
+// and entangles it with qubit i - 1, ghzMeasure<i> reads it out. An n-qubit
+// GHZ is the first n of each, run in order, so it runs only its own gates,
+// at the cost of one kernel call per qubit. The sequence for each size is
+// built once and cached, and the binary grows linearly with TOTAL_QUBITS
+// instead of quadratically.
+
+template <unsigned i> quantum_kernel void ghzQubit() {
+  PrepZ(qubit_register[i]);
+  if constexpr (i == 0)
+    H(qubit_register[0]);
+  else
+    CNOT(qubit_register[i - 1], qubit_register[i]);
+}
+
+template <unsigned i> quantum_kernel void ghzMeasure() {
+  MeasZ(qubit_register[i], cbit_register[i]);
+}
+
+using GhzStep = void (*)();
+
+template <std::size_t... i>
+constexpr std::array<GhzStep, sizeof...(i)> ghzQubitSteps(std::index_sequence<i...>) {
+  return {+[] { ghzQubit<i>(); }...};
+}
+
+template <std::size_t... i>
+constexpr std::array<GhzStep, sizeof...(i)> ghzMeasureSteps(std::index_sequence<i...>) {
+  return {+[] { ghzMeasure<i>(); }...};
+}
+
+const std::array<GhzStep, TOTAL_QUBITS> k_ghz_qubit_steps =
+  ghzQubitSteps(std::make_index_sequence<TOTAL_QUBITS>());
+const std::array<GhzStep, TOTAL_QUBITS> k_ghz_measure_steps =
+  ghzMeasureSteps(std::make_index_sequence<TOTAL_QUBITS>());
+
+// Kernel sequence of the `num_qubits`-qubit GHZ state, measured or not.
+const std::vector<GhzStep> &ghzSequence(unsigned num_qubits, bool measure) {
+  static std::map<std::pair<unsigned, bool>, std::vector<GhzStep>> sequences;
+  auto it = sequences.find({num_qubits, measure});
+  if (it != sequences.end())
+    return it->second;
+
+  std::vector<GhzStep> sequence(k_ghz_qubit_steps.begin(),
+                                k_ghz_qubit_steps.begin() + num_qubits);
+  if (measure)
+    sequence.insert(sequence.end(), k_ghz_measure_steps.begin(),
+                    k_ghz_measure_steps.begin() + num_qubits);
+  return sequences[{num_qubits, measure}] = std::move(sequence);
+}
+
+void runGhz(unsigned num_qubits, bool measure) {
+  for (GhzStep step : ghzSequence(num_qubits, measure))
+    step();
+}
+
+
+// "ghzM_<n>" for run_batch, as the per-size kernels used to be named.
+bool buildGhzM(unsigned num_qubits, ShotKernel &kernel) {
+  if (num_qubits < 1 || num_qubits > TOTAL_QUBITS)
+    return false;
+  kernel = {[num_qubits] { runGhz(num_qubits, true); }, cbit_register, num_qubits};
+  return true;
+}
+
+static ShotKernelFamilyRegistration ghzM_shots("ghzM", buildGhzM);
+
+
+extern "C" {
+
+// Prepares (and with `measure`, measures) the `num_qubits`-qubit GHZ state
+// on the device that is currently ready. Returns 1 if `num_qubits` is out of
+// range, 0 otherwise.
+int ghzRun(unsigned num_qubits, int measure) {
+  if (num_qubits < 1 || num_qubits > TOTAL_QUBITS)
+    return 1;
+  runGhz(num_qubits, measure);
+  return 0;
+}
+
+}
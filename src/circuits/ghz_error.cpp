@@ -1,16 +1,24 @@
 #include <iostream>
-#include <fstream>
+#include <cstdlib>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <vector>
 
 #include <clang/Quantum/quintrinsics.h>
 #include <quantum_full_state_simulator_backend.h>
 
+#include "include/result_sink.h"
+#include "include/trajectory_shards.h"
 
-const int total_qubits = 15, total_samples = 1000;
+
+const int total_qubits = 15, total_samples = 1000, max_workers = 64;
 qbit qubit_register[total_qubits];
-cbit cbit_register[total_qubits];
+// One row of results per worker, so asynchronous shots never share cbits
+cbit cbit_register[max_workers][total_qubits];
 
 
-quantum_kernel void ghz_total_qubits() {
+quantum_kernel void ghz_total_qubits(cbit result[]) {
   for (int i = 0; i < total_qubits; i++) {
     PrepZ(qubit_register[i]);
   }
@@ -22,7 +30,7 @@ quantum_kernel void ghz_total_qubits() {
   }
 
   for (int i = 0; i < total_qubits; i++) {
-    MeasZ(qubit_register[i], cbit_register[i]);
+    MeasZ(qubit_register[i], result[i]);
   }
 }
 
@@ -56,45 +64,54 @@ iqsdk::IqsCustomOp CustomCPhaseRotation(unsigned qubit_1, unsigned qubit_2, doub
 }
 
 
-int main() {
-  iqsdk::IqsConfig settings(total_qubits, "custom");
-  settings.PrepZ = CustomPrepZ;
-  settings.MeasZ = CustomMeasZ;
-  settings.RotationXY = CustomRotationXY;
-  settings.RotationZ = CustomRotationZ;
-  settings.ISwapRotation = CustomISwapRotation;
-  settings.CPhaseRotation = CustomCPhaseRotation;
+// Usage: ghz_error [num_workers] [seed] [csv|qbc]
+// Trajectories are sharded over num_workers asynchronous simulators; output is
+// reproducible for a fixed (seed, num_workers) pair. "qbc" writes the packed
+// columnar format read by results.py.
+int main(int argc, char *argv[]) {
+  unsigned num_workers = argc > 1 ? std::atoi(argv[1]) : 1;
+  std::size_t seed = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : time(NULL);
+  std::string format = argc > 3 ? argv[3] : "csv";
+  if (num_workers < 1 || num_workers > max_workers) {
+    std::cerr << "Error: num_workers must be in [1, " << max_workers << "]" << std::endl;
+    return 1;
+  }
 
-  iqsdk::FullStateSimulator quantum_8086(settings);
+  std::vector<iqsdk::FullStateSimulator> workers(num_workers);
+  for (unsigned w = 0; w < num_workers; w++) {
+    iqsdk::IqsConfig settings(total_qubits, "custom", false, deriveSeed(seed, w), false);
+    settings.PrepZ = CustomPrepZ;
+    settings.MeasZ = CustomMeasZ;
+    settings.RotationXY = CustomRotationXY;
+    settings.RotationZ = CustomRotationZ;
+    settings.ISwapRotation = CustomISwapRotation;
+    settings.CPhaseRotation = CustomCPhaseRotation;
+    workers[w].initialize(settings);
+  }
 
-  std::ofstream file(
-    total_qubits == 5
-    ? "results/ghz_error/correlation.csv"
-    : "results/ghz_error/correlation_fidelity.csv"
+  std::string file_name = total_qubits == 5
+    ? "results/ghz_error/correlation."
+    : "results/ghz_error/correlation_fidelity.";
+  std::unique_ptr<ResultSink> file = openResultSink(
+    file_name + format,
+    {total_qubits, seed, "custom: meas_z q0-q1 pre-depolarizing 0.1"}
   );
-  if (!file.is_open()) {
+  if (!file->isOpen()) {
     std::cerr << "Error: Unable to open file" << std::endl;
     return 1;
   }
 
-  file << "qubit_0";
-  for (int i = 1; i < total_qubits; i++) {
-    file << ',' << "qubit_" << i;
-  }
-  file << '\n';
-
-  for (int sample = 0; sample < total_samples; sample++) {
-    if (iqsdk::QRT_ERROR_SUCCESS != quantum_8086.ready())
-      return 1;
-
-    ghz_total_qubits();
-
-    file << cbit_register[0];
-    for (int i = 1; i < total_qubits; i++) {
-      file << ',' << cbit_register[i];
+  bool success = runShardedTrajectories(
+    workers, total_samples,
+    [](unsigned w) { ghz_total_qubits(cbit_register[w]); },
+    [&](unsigned sample, unsigned w) {
+      for (int i = 0; i < total_qubits; i++) {
+        file->put(i, cbit_register[w][i]);
+      }
+      file->endShot();
     }
-    file << '\n';
-  }
+  );
 
-  file.close();
+  file->close();
+  return success ? 0 : 1;
 }
@@ -1,10 +1,14 @@
 #include <iostream>
-#include <fstream>
 #include <cstdlib>
+#include <ctime>
+#include <memory>
+#include <string>
 
 #include <clang/Quantum/quintrinsics.h>
 #include <quantum_full_state_simulator_backend.h>
 
+#include "include/result_sink.h"
+
 
 const int total_qubits = 5, total_samples = 1000;
 qbit qubit_register[total_qubits];
@@ -57,8 +61,13 @@ iqsdk::IqsCustomOp CustomCPhaseRotation(unsigned qubit_1, unsigned qubit_2, doub
 }
 
 
-int main() {
-  iqsdk::IqsConfig settings(total_qubits, "custom");
+// Usage: ghz_manual [csv|qbc]
+// "qbc" writes the packed columnar format read by results.py.
+int main(int argc, char *argv[]) {
+  std::string format = argc > 1 ? argv[1] : "csv";
+  std::size_t seed = time(NULL);
+
+  iqsdk::IqsConfig settings(total_qubits, "custom", false, seed);
   settings.PrepZ = CustomPrepZ;
   settings.MeasZ = CustomMeasZ;
   settings.RotationXY = CustomRotationXY;
@@ -68,38 +77,34 @@ int main() {
 
   iqsdk::FullStateSimulator quantum_8086(settings);
 
-  std::ofstream file(
-    total_qubits == 5
-    ? "results/ghz_manual/correlation.csv"
-    : "results/ghz_manual/correlation_fidelity.csv"
+  std::string file_name = total_qubits == 5
+    ? "results/ghz_manual/correlation."
+    : "results/ghz_manual/correlation_fidelity.";
+  std::unique_ptr<ResultSink> file = openResultSink(
+    file_name + format,
+    {total_qubits, seed, "custom: meas_z q0 pre-depolarizing 0.9"}
   );
-  if (!file.is_open()) {
+  if (!file->isOpen()) {
     std::cerr << "Error: Unable to open file" << std::endl;
     return 1;
   }
 
-  file << "qubit_0";
-  for (int i = 1; i < total_qubits; i++) {
-    file << ',' << "qubit_" << i;
-  }
-  file << '\n';
-
   for (int sample = 0; sample < total_samples; sample++) {
     if (iqsdk::QRT_ERROR_SUCCESS != quantum_8086.ready())
       return 1;
 
     ghz_total_qubits();
 
-    file << cbit_register[0];
+    file->put(0, cbit_register[0]);
     for (int i = 1; i < total_qubits; i++) {
       if (i == 1 && (rand() % 101) < 60) {
-        file << ',' << cbit_register[0];
+        file->put(i, cbit_register[0]);
       } else {
-        file << ',' << cbit_register[i];
+        file->put(i, cbit_register[i]);
       }
     }
-    file << '\n';
+    file->endShot();
   }
 
-  file.close();
+  file->close();
 }
@@ -0,0 +1,103 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+// Timing, memory and reporting helpers for the benchmark programs.
+//
+// A BenchmarkReport is a CSV file with one row per measurement and a fixed
+// column set, so reports from different SDK releases (or machines, or
+// commits) can be diffed or joined on (label, kernel, backend, num_qubits).
+// Peak RSS is the process high-water mark; on Linux resetPeakRss() rewinds
+// it before each measurement so every row reports its own peak.
+
+#include <sys/resource.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+
+// Resets the kernel's peak RSS counter (VmHWM); a no-op where unsupported.
+inline void resetPeakRss() {
+  std::ofstream clear_refs("/proc/self/clear_refs");
+  if (clear_refs)
+    clear_refs << "5";
+}
+
+inline std::uint64_t peakRssBytes() {
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.rfind("VmHWM:", 0) == 0)
+      return std::stoull(line.substr(6)) * 1024;
+  }
+  // ru_maxrss is in kilobytes on Linux.
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return std::uint64_t(usage.ru_maxrss) * 1024;
+}
+
+
+class Stopwatch {
+public:
+  Stopwatch() : start(std::chrono::steady_clock::now()) {}
+  double seconds() const {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  }
+
+private:
+  std::chrono::steady_clock::time_point start;
+};
+
+
+struct BenchmarkRecord {
+  std::string label;
+  std::string kernel;
+  std::string backend;
+  unsigned num_qubits = 0;
+  // Gates in one shot, as written in the kernel (before decomposition into
+  // native gates).
+  std::uint64_t num_gates = 0;
+  std::uint64_t num_shots = 0;
+  double wall_seconds = 0;
+  std::uint64_t peak_rss_bytes = 0;
+  // "ok", or why the point was skipped or failed.
+  std::string status = "ok";
+};
+
+
+class BenchmarkReport {
+public:
+  explicit BenchmarkReport(const std::string &path) {
+    std::filesystem::path parent = std::filesystem::path(path).parent_path();
+    if (!parent.empty())
+      std::filesystem::create_directories(parent);
+    file.open(path);
+    if (file)
+      file << "label,kernel,backend,num_qubits,num_gates,num_shots,"
+              "wall_seconds,gates_per_second,shots_per_second,peak_rss_bytes,status\n";
+  }
+
+  bool isOpen() const { return file.is_open(); }
+
+  void add(const BenchmarkRecord &record) {
+    double rate = record.wall_seconds > 0 ? 1 / record.wall_seconds : 0;
+    char numbers[128];
+    std::snprintf(numbers, sizeof(numbers), "%.6e,%.6e,%.6e",
+                  record.wall_seconds,
+                  record.num_gates * record.num_shots * rate,
+                  record.num_shots * rate);
+    file << record.label << ',' << record.kernel << ',' << record.backend << ','
+         << record.num_qubits << ',' << record.num_gates << ','
+         << record.num_shots << ',' << numbers << ','
+         << record.peak_rss_bytes << ',' << record.status << '\n';
+    file.flush();
+  }
+
+private:
+  std::ofstream file;
+};
+
+#endif // BENCHMARK_H
@@ -0,0 +1,189 @@
+#ifndef DECODE_PIPELINE_H
+#define DECODE_PIPELINE_H
+
+// Decoding shots on worker threads while the simulators keep running.
+//
+// The thread that collects results from the simulators pushes each shot,
+// copied into a Job, into a bounded lock-free ring (RingBuffer, after
+// Vyukov's bounded MPMC queue: every cell carries a sequence number that
+// tells producers and consumers whose turn it is, so a push or pop is one
+// compare-exchange on the shared index plus one store). A fixed set of
+// decoder threads pops jobs and calls `decode` on them; whatever the
+// decode function accumulates must be atomic, since any decoder may take
+// any job.
+//
+// A decoder that finds the ring empty spins briefly, then yields, then
+// sleeps, so idle decoders do not take CPU from the simulators. A producer
+// that finds it full waits the same way; stalls() counts how often that
+// happened, i.e. how often decoding, not simulation, was the bottleneck.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+
+// Bounded queue for any number of producers and consumers. The capacity is
+// rounded up to a power of two.
+template <typename T> class RingBuffer {
+public:
+  explicit RingBuffer(std::size_t capacity) {
+    std::size_t size = 2;
+    while (size < capacity)
+      size *= 2;
+    mask = size - 1;
+    cells.reset(new Cell[size]);
+    for (std::size_t i = 0; i < size; i++)
+      cells[i].sequence.store(i, std::memory_order_relaxed);
+  }
+
+  RingBuffer(const RingBuffer &) = delete;
+  RingBuffer &operator=(const RingBuffer &) = delete;
+
+  std::size_t capacity() const { return mask + 1; }
+
+  // False if the ring is full.
+  bool tryPush(const T &value) {
+    std::size_t position = tail.load(std::memory_order_relaxed);
+    for (;;) {
+      Cell &cell = cells[position & mask];
+      const std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+      const std::ptrdiff_t lag = std::ptrdiff_t(sequence) - std::ptrdiff_t(position);
+      if (lag == 0) {
+        if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+          cell.value = value;
+          cell.sequence.store(position + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (lag < 0) {
+        return false;
+      } else {
+        position = tail.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // False if the ring is empty.
+  bool tryPop(T &value) {
+    std::size_t position = head.load(std::memory_order_relaxed);
+    for (;;) {
+      Cell &cell = cells[position & mask];
+      const std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+      const std::ptrdiff_t lag = std::ptrdiff_t(sequence) - std::ptrdiff_t(position + 1);
+      if (lag == 0) {
+        if (head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+          value = cell.value;
+          cell.sequence.store(position + mask + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (lag < 0) {
+        return false;
+      } else {
+        position = head.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+private:
+  struct Cell {
+    std::atomic<std::size_t> sequence;
+    T value;
+  };
+
+  std::unique_ptr<Cell[]> cells;
+  std::size_t mask;
+  // On separate cache lines so producers and consumers do not share one.
+  alignas(64) std::atomic<std::size_t> tail{0};
+  alignas(64) std::atomic<std::size_t> head{0};
+};
+
+
+// Waits a little longer on every call: spins, then yields, then sleeps.
+class Backoff {
+public:
+  void wait() {
+    if (tries >= k_yields)
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+    else if (tries++ >= k_spins)
+      std::this_thread::yield();
+  }
+
+  void reset() { tries = 0; }
+
+private:
+  static constexpr unsigned k_spins = 64, k_yields = 128;
+  unsigned tries = 0;
+};
+
+
+template <typename Job> class DecodePipeline {
+public:
+  using Decode = std::function<void(Job &job)>;
+
+  DecodePipeline(unsigned num_decoders, std::size_t capacity, Decode decode)
+      : queue(capacity), decode(std::move(decode)) {
+    for (unsigned d = 0; d < std::max(num_decoders, 1u); d++)
+      decoders.emplace_back(&DecodePipeline::work, this);
+  }
+
+  DecodePipeline(const DecodePipeline &) = delete;
+  DecodePipeline &operator=(const DecodePipeline &) = delete;
+
+  ~DecodePipeline() { finish(); }
+
+  unsigned numDecoders() const { return decoders.size(); }
+
+  // Called by one thread at a time; waits while the ring is full.
+  void push(const Job &job) {
+    if (queue.tryPush(job))
+      return;
+    stall_count++;
+    Backoff backoff;
+    while (!queue.tryPush(job))
+      backoff.wait();
+  }
+
+  // Returns once every pushed job has been decoded; no push after this.
+  void finish() {
+    done.store(true, std::memory_order_release);
+    for (std::thread &decoder : decoders)
+      if (decoder.joinable())
+        decoder.join();
+  }
+
+  std::uint64_t stalls() const { return stall_count; }
+
+private:
+  void work() {
+    Job job;
+    Backoff backoff;
+    for (;;) {
+      if (queue.tryPop(job)) {
+        decode(job);
+        backoff.reset();
+        continue;
+      }
+      // Nothing is pushed once done is set, so empty then means drained.
+      if (done.load(std::memory_order_acquire)) {
+        if (!queue.tryPop(job))
+          return;
+        decode(job);
+        continue;
+      }
+      backoff.wait();
+    }
+  }
+
+  RingBuffer<Job> queue;
+  Decode decode;
+  std::vector<std::thread> decoders;
+  std::atomic<bool> done{false};
+  std::uint64_t stall_count = 0;
+};
+
+#endif // DECODE_PIPELINE_H
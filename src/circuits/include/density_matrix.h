@@ -0,0 +1,176 @@
+#ifndef DENSITY_MATRIX_H
+#define DENSITY_MATRIX_H
+
+// Dense density-matrix state for exact noisy simulation of small registers.
+//
+// rho is stored row-major, 2^n x 2^n, with qubit q on bit q of the row and
+// column index (the IQS convention). Every operation on k <= 2 target qubits
+// goes through one kernel that applies a d^2 x d^2 superoperator (d = 2^k),
+// S = sum_k K_k (x) conj(K_k), to the d x d blocks of rho on those qubits.
+// Ideal gates use the superoperator of U; chi matrices use that of their
+// Kraus set (see noise_channel.h). Diagonal gates only rescale entries.
+//
+// The kernel walks rho one group of d rows at a time: a group holds every
+// entry that mixes with any other under the superoperator, so each
+// application streams through rho once and its working set is d rows
+// (d * 2^n * 16 bytes) whatever the target qubits are. Memory is
+// 4^n * 16 bytes, i.e. this is meant for n up to about 12.
+
+#include <complex>
+#include <cstddef>
+#include <vector>
+
+#include "noise_channel.h"
+
+
+// Superoperator of rho -> U rho U^dag.
+inline ComplexMatrix unitarySuperoperator(const ComplexMatrix &u) {
+  const unsigned d = matrixDim(u);
+  ComplexMatrix s(d * d * d * d);
+  for (unsigned a = 0; a < d; a++)
+    for (unsigned b = 0; b < d; b++)
+      for (unsigned a2 = 0; a2 < d; a2++)
+        for (unsigned b2 = 0; b2 < d; b2++)
+          s[(a * d + b) * d * d + a2 * d + b2] = u[a * d + a2] * std::conj(u[b * d + b2]);
+  return s;
+}
+
+// Superoperator of a compiled chi matrix, sum_k K_k rho K_k^dag.
+inline ComplexMatrix channelSuperoperator(const NoiseChannel &channel) {
+  const unsigned d = 1u << channel.num_qubits;
+  ComplexMatrix s(d * d * d * d);
+  for (std::size_t k = 0; k < channel.branches.size(); k++) {
+    // Mixed-unitary branches are stored as K_k / sqrt(w_k).
+    double scale = channel.mixed_unitary ? channel.weights[k] : 1;
+    ComplexMatrix term = unitarySuperoperator(channel.branches[k]);
+    for (std::size_t i = 0; i < s.size(); i++)
+      s[i] += scale * term[i];
+  }
+  return s;
+}
+
+
+class DensityMatrix {
+public:
+  // |0...0><0...0|
+  explicit DensityMatrix(unsigned num_qubits)
+      : num_qubits(num_qubits), dim(std::size_t(1) << num_qubits),
+        rho(dim * dim) {
+    rho[0] = 1;
+  }
+
+  unsigned numQubits() const { return num_qubits; }
+  const std::complex<double> &operator()(std::size_t row, std::size_t col) const {
+    return rho[row * dim + col];
+  }
+
+  // Applies `superop` (see unitarySuperoperator) to one qubit, or to two
+  // with `q1` as the first qubit of the 4 x 4 basis.
+  void applySuperoperator(const ComplexMatrix &superop, unsigned q1,
+                          int q2 = -1) {
+    std::size_t offsets[4] = {0, std::size_t(1) << q1};
+    unsigned d = 2;
+    if (q2 >= 0) {
+      offsets[1] = std::size_t(1) << q2;
+      offsets[2] = std::size_t(1) << q1;
+      offsets[3] = offsets[1] | offsets[2];
+      d = 4;
+    }
+    const std::size_t mask = offsets[d - 1] | offsets[1];
+    const unsigned dd = d * d;
+
+    std::complex<double> block[16], result[16];
+    std::complex<double> *rows[4];
+    for (std::size_t row = 0; row < dim; row++) {
+      if (row & mask)
+        continue;
+      for (unsigned a = 0; a < d; a++)
+        rows[a] = &rho[(row | offsets[a]) * dim];
+      for (std::size_t col = 0; col < dim; col++) {
+        if (col & mask)
+          continue;
+        for (unsigned a = 0; a < d; a++)
+          for (unsigned b = 0; b < d; b++)
+            block[a * d + b] = rows[a][col | offsets[b]];
+        for (unsigned i = 0; i < dd; i++) {
+          std::complex<double> sum = 0;
+          const std::complex<double> *s = &superop[i * dd];
+          for (unsigned j = 0; j < dd; j++)
+            sum += s[j] * block[j];
+          result[i] = sum;
+        }
+        for (unsigned a = 0; a < d; a++)
+          for (unsigned b = 0; b < d; b++)
+            rows[a][col | offsets[b]] = result[a * d + b];
+      }
+    }
+  }
+
+  void applyUnitary(const ComplexMatrix &u, unsigned q1, int q2 = -1) {
+    applySuperoperator(unitarySuperoperator(u), q1, q2);
+  }
+
+  // rho_ij *= phase(i) conj(phase(j)) for a gate diagonal in the
+  // computational basis; `phase` has 2^num_qubits entries.
+  template <typename Phase>
+  void applyDiagonal(Phase phase) {
+    std::vector<std::complex<double>> phases(dim);
+    for (std::size_t i = 0; i < dim; i++)
+      phases[i] = phase(i);
+    for (std::size_t row = 0; row < dim; row++)
+      for (std::size_t col = 0; col < dim; col++)
+        rho[row * dim + col] *= phases[row] * std::conj(phases[col]);
+  }
+
+  double trace() const {
+    double sum = 0;
+    for (std::size_t i = 0; i < dim; i++)
+      sum += rho[i * dim + i].real();
+    return sum;
+  }
+
+  // Measured chi matrices are only trace preserving up to ~1e-4; this keeps
+  // the errors from accumulating over a circuit.
+  void normalize() {
+    double t = trace();
+    for (std::complex<double> &entry : rho)
+      entry /= t;
+  }
+
+  // Probability of measuring `q` in |1>.
+  double getProbability(unsigned q) const {
+    double sum = 0;
+    for (std::size_t i = 0; i < dim; i++)
+      if (i >> q & 1)
+        sum += rho[i * dim + i].real();
+    return sum;
+  }
+
+  // Projects `q` onto |value> and renormalizes.
+  void collapse(unsigned q, bool value) {
+    for (std::size_t row = 0; row < dim; row++)
+      for (std::size_t col = 0; col < dim; col++)
+        if ((row >> q & 1) != value || (col >> q & 1) != value)
+          rho[row * dim + col] = 0;
+    normalize();
+  }
+
+  // Resets `q` to |0> without measuring it: Kraus |0><0| and |0><1|.
+  void reset(unsigned q) {
+    static const ComplexMatrix k_reset = [] {
+      ComplexMatrix s = unitarySuperoperator({1, 0, 0, 0});
+      ComplexMatrix s1 = unitarySuperoperator({0, 1, 0, 0});
+      for (std::size_t i = 0; i < s.size(); i++)
+        s[i] += s1[i];
+      return s;
+    }();
+    applySuperoperator(k_reset, q);
+  }
+
+private:
+  unsigned num_qubits;
+  std::size_t dim;
+  std::vector<std::complex<double>> rho;
+};
+
+#endif // DENSITY_MATRIX_H
@@ -0,0 +1,105 @@
+#ifndef DIAGONAL_BATCH_H
+#define DIAGONAL_BATCH_H
+
+// Batching of diagonal gates.
+//
+// RZ and CPhase are diagonal, so any run of them, on any qubits, is a single
+// diagonal gate exp(i phase(b)) whose phase is a polynomial in the bits of
+// the basis state (PhasePolynomial in state_vector.h). DiagonalBatch adds up
+// the polynomial's coefficients as gates arrive and hands it to the sink on
+// flush(), which StateVector::applyPhasePolynomial applies in one sweep: a
+// QFT layer of n CPhase gates becomes one pass instead of n.
+//
+// Diagonal gates commute with each other and with measurement in the
+// computational basis, so a backend only has to flush before a
+// non-diagonal gate on a qubit the batch touches (see touches()), before a
+// bit flip, and before reading amplitudes.
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "state_vector.h"
+
+
+class DiagonalBatch {
+public:
+  using Sink = std::function<void(const PhasePolynomial &)>;
+
+  explicit DiagonalBatch(Sink sink) : sink(std::move(sink)) {}
+
+  DiagonalBatch(const DiagonalBatch &) = delete;
+  DiagonalBatch &operator=(const DiagonalBatch &) = delete;
+
+  ~DiagonalBatch() { flush(); }
+
+  // diag(exp(-i angle / 2), exp(i angle / 2))
+  void addRotationZ(unsigned q, double angle) {
+    num_gates++;
+    num_pending++;
+    global -= angle / 2;
+    linear[q] += angle;
+    touch(q);
+  }
+
+  // |11> gets exp(-i angle).
+  void addCPhase(unsigned ctrl, unsigned target, double angle) {
+    num_gates++;
+    num_pending++;
+    quadratic[std::minmax(ctrl, target)] -= angle;
+    touch(ctrl);
+    touch(target);
+  }
+
+  bool empty() const { return num_pending == 0; }
+
+  bool touches(unsigned q) const { return q < touched.size() && touched[q]; }
+
+  // Applies the pending gates, if any, as one phase polynomial.
+  void flush() {
+    if (empty())
+      return;
+    PhasePolynomial polynomial;
+    polynomial.global = global;
+    for (const auto &[q, angle] : linear)
+      polynomial.linear.push_back({q, angle});
+    for (const auto &[qubits, angle] : quadratic)
+      polynomial.quadratic.push_back({qubits.first, qubits.second, angle});
+    num_sweeps++;
+    sink(polynomial);
+    clear();
+  }
+
+  // Drops the pending gates, e.g. when the state they act on is reset.
+  void clear() {
+    global = 0;
+    linear.clear();
+    quadratic.clear();
+    std::fill(touched.begin(), touched.end(), false);
+    num_pending = 0;
+  }
+
+  // Gates batched and sweeps made so far.
+  std::size_t numGates() const { return num_gates; }
+  std::size_t numSweeps() const { return num_sweeps; }
+
+private:
+  void touch(unsigned q) {
+    if (q >= touched.size())
+      touched.resize(q + 1, false);
+    touched[q] = true;
+  }
+
+  Sink sink;
+  double global = 0;
+  // Ordered, so equal batches give bit-identical polynomials.
+  std::map<unsigned, double> linear;
+  std::map<std::pair<unsigned, unsigned>, double> quadratic;
+  std::vector<bool> touched;
+  std::size_t num_pending = 0, num_gates = 0, num_sweeps = 0;
+};
+
+#endif // DIAGONAL_BATCH_H
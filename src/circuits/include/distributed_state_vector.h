@@ -0,0 +1,302 @@
+#ifndef DISTRIBUTED_STATE_VECTOR_H
+#define DISTRIBUTED_STATE_VECTOR_H
+
+// State vector distributed over the ranks of an MPI communicator.
+//
+// With R = 2^g ranks, each rank holds 2^(n - g) of the 2^n amplitudes in a
+// StateVector: the low n - g physical qubits are local, the top g are
+// global and select the rank. Every rank runs the same gate sequence (the
+// program is SPMD), and all methods are collective.
+//
+// Diagonal gates and measurements never communicate: on a global qubit a
+// diagonal gate is a phase on the whole rank and a probability is a sum
+// reduced over ranks. A gate that mixes amplitudes across a global qubit
+// (RXY, SwapA) first swaps it with a local qubit: rank r and its partner
+// r ^ (1 << (global - local qubits)) trade the half of their amplitudes
+// where the two bits differ, in pairwise MPI_Sendrecv_replace messages of at
+// most k_exchange_chunk amplitudes. The logical-to-physical qubit map keeps
+// the swap, so later gates on that qubit stay local. Which local qubit is
+// evicted is the RemapPolicy: the least recently used one by default, so
+// the qubits a circuit is working on stay local and a global qubit is paid
+// for once per phase of the circuit rather than once per gate.
+
+#include <mpi.h>
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include "benchmark.h"
+#include "state_vector.h"
+
+
+// Amplitudes per exchange message (16 MiB of real and imaginary parts).
+constexpr std::size_t k_exchange_chunk = std::size_t(1) << 20;
+
+enum class RemapPolicy {
+  Fixed,             // always evict the highest local qubit
+  LeastRecentlyUsed, // evict the local qubit unused for longest
+};
+
+struct CommunicationStats {
+  std::size_t exchanges = 0;
+  double bytes_sent = 0; // by this rank
+  double seconds = 0;    // spent in exchanges
+};
+
+
+class DistributedStateVector {
+public:
+  // |0...0> over the ranks of `comm`, whose size must be a power of two
+  // leaving at least two local qubits.
+  explicit DistributedStateVector(unsigned num_qubits, MPI_Comm comm = MPI_COMM_WORLD,
+                                  RemapPolicy policy = RemapPolicy::LeastRecentlyUsed,
+                                  SimdLevel level = detectSimdLevel())
+      : comm(comm), rank(commRank(comm)), num_ranks(commSize(comm)),
+        num_qubits(num_qubits), num_global(globalQubits(num_qubits, num_ranks)),
+        num_local(num_qubits - num_global), policy(policy), local(num_local, level),
+        last_use(num_local, 0) {
+    if (rank != 0)
+      local.scale(0);
+    for (unsigned q = 0; q < num_qubits; q++) {
+      physical.push_back(q);
+      logical.push_back(q);
+    }
+  }
+
+  unsigned numQubits() const { return num_qubits; }
+  unsigned numLocalQubits() const { return num_local; }
+  int numRanks() const { return num_ranks; }
+  int rankIndex() const { return rank; }
+  const CommunicationStats &communication() const { return stats; }
+  void resetCommunication() { stats = CommunicationStats(); }
+  // Physical bit logical qubit q is on; bits >= numLocalQubits() are global.
+  unsigned physicalBit(unsigned q) const { return physical[q]; }
+
+  // Amplitude of logical basis state i, broadcast from the rank holding it.
+  std::complex<double> amplitude(std::size_t i) {
+    std::size_t index = 0;
+    for (unsigned q = 0; q < num_qubits; q++)
+      index |= (i >> q & 1) << physical[q];
+    const int owner = index >> num_local;
+    double value[2] = {0, 0};
+    if (owner == rank) {
+      const std::complex<double> a = local[index & ((std::size_t(1) << num_local) - 1)];
+      value[0] = a.real();
+      value[1] = a.imag();
+    }
+    MPI_Bcast(value, 2, MPI_DOUBLE, owner, comm);
+    return {value[0], value[1]};
+  }
+
+  // 2x2 unitary `m` (row-major) on qubit q.
+  void applyMatrix(unsigned q, const std::complex<double> m[4]) {
+    local.applyMatrix(localize(q, num_qubits), m);
+  }
+
+  // exp(-i gamma / 2 (cos(phi) X + sin(phi) Y))
+  void applyRotationXY(unsigned q, double phi, double gamma) {
+    local.applyRotationXY(localize(q, num_qubits), phi, gamma);
+  }
+
+  // diag(exp(-i angle / 2), exp(i angle / 2))
+  void applyRotationZ(unsigned q, double angle) {
+    const unsigned bit = use(q);
+    if (bit < num_local) {
+      local.applyRotationZ(bit, angle);
+      return;
+    }
+    const std::complex<double> phase = std::polar(1.0, -angle / 2);
+    local.scale(globalBit(bit) ? std::conj(phase) : phase);
+  }
+
+  // |11> gets exp(-i angle), as ApplyCPhaseRotation(ctrl, target, -angle).
+  void applyCPhase(unsigned ctrl, unsigned target, double angle) {
+    unsigned bit1 = use(ctrl), bit2 = use(target);
+    if (bit1 > bit2)
+      std::swap(bit1, bit2);
+    if (bit2 < num_local) {
+      local.applyCPhase(bit1, bit2, angle);
+      return;
+    }
+    if (!globalBit(bit2))
+      return;
+    const std::complex<double> phase = std::polar(1.0, -angle);
+    if (bit1 < num_local)
+      local.applyDiagonal(bit1, 1, phase);
+    else if (globalBit(bit1))
+      local.scale(phase);
+  }
+
+  // The ISwapRotation matrix CustomBackend builds for SwapA.
+  void applySwapA(unsigned q1, unsigned q2, double angle) {
+    const unsigned bit1 = localize(q1, num_qubits);
+    const unsigned bit2 = localize(q2, bit1);
+    local.applySwapA(bit1, bit2, angle);
+  }
+
+  // Probability of measuring q in |1>, the same on every rank.
+  double getProbability(unsigned q) {
+    const unsigned bit = use(q);
+    double sum = 0;
+    if (bit < num_local)
+      sum = local.getProbability(bit);
+    else if (globalBit(bit))
+      sum = localNorm();
+    double total = 0;
+    MPI_Allreduce(&sum, &total, 1, MPI_DOUBLE, MPI_SUM, comm);
+    return total;
+  }
+
+  // Projects q onto |value>, which must have probability `probability`, and
+  // renormalizes.
+  void collapse(unsigned q, bool value, double probability) {
+    const unsigned bit = use(q);
+    if (bit < num_local)
+      local.collapse(bit, value, probability);
+    else
+      local.scale(globalBit(bit) == value ? 1 / std::sqrt(probability) : 0);
+  }
+
+  // Measures q with rank 0's uniform `random` in [0, 1): the outcome and its
+  // probability are broadcast so every rank collapses the same way.
+  bool measure(unsigned q, double random) {
+    double probability = getProbability(q);
+    double outcome[2] = {random <= probability ? 1.0 : 0.0, probability};
+    MPI_Bcast(outcome, 2, MPI_DOUBLE, 0, comm);
+    const bool measurement = outcome[0] != 0;
+    collapse(q, measurement, measurement ? outcome[1] : 1 - outcome[1]);
+    return measurement;
+  }
+
+private:
+  static int commRank(MPI_Comm comm) {
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    return rank;
+  }
+
+  static int commSize(MPI_Comm comm) {
+    int size;
+    MPI_Comm_size(comm, &size);
+    return size;
+  }
+
+  static unsigned globalQubits(unsigned num_qubits, int num_ranks) {
+    if (num_ranks & (num_ranks - 1))
+      throw std::invalid_argument("DistributedStateVector: ranks must be a power of two");
+    unsigned num_global = 0;
+    while ((1 << num_global) < num_ranks)
+      num_global++;
+    // Two-qubit gates on two global qubits need two local ones to swap in.
+    if (num_global + 2 > num_qubits)
+      throw std::invalid_argument("DistributedStateVector: too many ranks for the qubits");
+    return num_global;
+  }
+
+  bool globalBit(unsigned bit) const { return rank >> (bit - num_local) & 1; }
+
+  double localNorm() {
+    const double *x = local.real(), *y = local.imag();
+    double sum = 0;
+    for (std::size_t i = 0; i < local.numAmplitudes(); i++)
+      sum += x[i] * x[i] + y[i] * y[i];
+    return sum;
+  }
+
+  // Physical bit of q, recorded as used now if it is local.
+  unsigned use(unsigned q) {
+    const unsigned bit = physical[q];
+    if (bit < num_local)
+      last_use[bit] = ++clock;
+    return bit;
+  }
+
+  // Physical bit of q after making it local, swapping it with a local bit
+  // other than `keep` chosen by the policy if it is global.
+  unsigned localize(unsigned q, unsigned keep) {
+    const unsigned global = use(q);
+    if (global < num_local)
+      return global;
+    unsigned victim = num_local - 1;
+    if (policy == RemapPolicy::LeastRecentlyUsed) {
+      std::uint64_t oldest = std::numeric_limits<std::uint64_t>::max();
+      for (unsigned bit = 0; bit < num_local; bit++)
+        if (bit != keep && last_use[bit] < oldest) {
+          oldest = last_use[bit];
+          victim = bit;
+        }
+    } else if (victim == keep) {
+      victim--;
+    }
+    exchange(global, victim);
+    std::swap(logical[global], logical[victim]);
+    physical[logical[global]] = global;
+    physical[logical[victim]] = victim;
+    last_use[victim] = ++clock;
+    return victim;
+  }
+
+  // Swaps physical bits `global` and `local_bit`. The rank with the global
+  // bit clear sends its amplitudes with the local bit set and receives the
+  // partner's with it clear into the same places; the partner does the
+  // opposite. Both walk their halves in the same order.
+  void exchange(unsigned global, unsigned local_bit) {
+    Stopwatch stopwatch;
+    const int partner = rank ^ (1 << (global - num_local));
+    const std::size_t block = std::size_t(1) << local_bit;
+    const std::size_t half = local.numAmplitudes() / 2;
+    const std::size_t side = globalBit(global) ? 0 : block;
+    double *x = local.real(), *y = local.imag();
+    buffer.resize(2 * std::min(half, k_exchange_chunk));
+
+    for (std::size_t begin = 0; begin < half; begin += k_exchange_chunk) {
+      const std::size_t end = std::min(half, begin + k_exchange_chunk), count = end - begin;
+      // Entry e is offset e % block in block e / block of the sent side.
+      auto copy = [&](bool pack) {
+        for (std::size_t e = begin; e < end;) {
+          const std::size_t offset = e % block, length = std::min(block - offset, end - e);
+          const std::size_t position = 2 * (e - offset) + side + offset;
+          double *packed = buffer.data() + (e - begin);
+          if (pack) {
+            std::memcpy(packed, x + position, length * sizeof(double));
+            std::memcpy(packed + count, y + position, length * sizeof(double));
+          } else {
+            std::memcpy(x + position, packed, length * sizeof(double));
+            std::memcpy(y + position, packed + count, length * sizeof(double));
+          }
+          e += length;
+        }
+      };
+      copy(true);
+      MPI_Sendrecv_replace(buffer.data(), int(2 * count), MPI_DOUBLE, partner, 0, partner, 0,
+                           comm, MPI_STATUS_IGNORE);
+      copy(false);
+    }
+
+    stats.exchanges++;
+    stats.bytes_sent += 2.0 * sizeof(double) * half;
+    stats.seconds += stopwatch.seconds();
+  }
+
+  MPI_Comm comm;
+  int rank, num_ranks;
+  unsigned num_qubits, num_global, num_local;
+  RemapPolicy policy;
+  StateVector local;
+  // physical[q] is the bit of logical qubit q; logical is its inverse.
+  std::vector<unsigned> physical, logical;
+  // Value of `clock` when each local bit was last used.
+  std::vector<std::uint64_t> last_use;
+  std::uint64_t clock = 0;
+  std::vector<double> buffer;
+  CommunicationStats stats;
+};
+
+#endif // DISTRIBUTED_STATE_VECTOR_H
@@ -0,0 +1,127 @@
+#ifndef ENSEMBLE_AVERAGE_H
+#define ENSEMBLE_AVERAGE_H
+
+// Online ensemble averages over noisy trajectories.
+//
+// Trajectory-based noise estimates average some per-trajectory quantity
+// (e.g. single-qubit probabilities) over many runs. Instead of storing every
+// trajectory and re-summing prefixes, EnsembleAverage keeps one Welford
+// accumulator per value: O(num_values) memory, numerically stable mean and
+// variance, and the standard error needed to stop once the estimate is good
+// enough.
+//
+// runEnsemble drives the trajectories through runShardedTrajectories, so they
+// run in parallel on asynchronous simulators, and reports checkpoints only at
+// log-spaced ensemble sizes (`checkpoints_per_decade` per factor of 10) plus
+// the final size.
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#include "trajectory_shards.h"
+
+
+class WelfordAccumulator {
+public:
+  void add(double x) {
+    count++;
+    double delta = x - running_mean;
+    running_mean += delta / count;
+    m2 += delta * (x - running_mean);
+  }
+
+  std::size_t size() const { return count; }
+  double mean() const { return running_mean; }
+  // Unbiased sample variance.
+  double variance() const { return count > 1 ? m2 / (count - 1) : 0; }
+  double standardError() const {
+    return count > 1 ? std::sqrt(variance() / count) : INFINITY;
+  }
+
+private:
+  std::size_t count = 0;
+  double running_mean = 0, m2 = 0;
+};
+
+
+class EnsembleAverage {
+public:
+  explicit EnsembleAverage(unsigned num_values) : values(num_values) {}
+
+  void add(const std::vector<double> &sample) {
+    for (std::size_t i = 0; i < values.size(); i++)
+      values[i].add(sample[i]);
+    count++;
+  }
+
+  std::size_t size() const { return count; }
+  unsigned numValues() const { return values.size(); }
+  const WelfordAccumulator &operator[](unsigned i) const { return values[i]; }
+
+  double maxStandardError() const {
+    double error = 0;
+    for (const WelfordAccumulator &value : values)
+      error = std::max(error, value.standardError());
+    return error;
+  }
+
+private:
+  std::vector<WelfordAccumulator> values;
+  std::size_t count = 0;
+};
+
+
+struct EnsembleOptions {
+  unsigned max_trajectories = 10000;
+  // Stop once every value's standard error is below this (0 disables).
+  double target_standard_error = 0;
+  // Never stop before this many trajectories, so a lucky run of identical
+  // samples does not look converged.
+  unsigned min_trajectories = 100;
+  unsigned checkpoints_per_decade = 10;
+};
+
+
+// Next log-spaced ensemble size after `size`.
+inline std::size_t nextCheckpoint(std::size_t size, unsigned per_decade) {
+  double next = std::ceil(size * std::pow(10.0, 1.0 / std::max(1u, per_decade)));
+  return std::max(size + 1, static_cast<std::size_t>(next));
+}
+
+
+// Runs up to `options.max_trajectories` trajectories over `sims` (see
+// runShardedTrajectories) and accumulates them into `average`.
+//   launch(worker)               - issues one trajectory on that worker
+//   read(worker, sample)         - fills `sample` (numValues() entries) from
+//                                  the finished trajectory
+//   checkpoint(average)          - called at log-spaced sizes and at the end
+// Returns false if a simulator failed.
+template <typename Simulator, typename Launch, typename Read, typename Checkpoint>
+bool runEnsemble(std::vector<Simulator> &sims, const EnsembleOptions &options,
+                 EnsembleAverage &average, Launch launch, Read read,
+                 Checkpoint checkpoint) {
+  std::vector<double> sample(average.numValues());
+  std::size_t next_checkpoint = 1, last_checkpoint = 0;
+  bool success = runShardedTrajectories(
+      sims, options.max_trajectories, launch, [&](unsigned, unsigned w) {
+        read(w, sample);
+        average.add(sample);
+        if (average.size() == next_checkpoint) {
+          checkpoint(average);
+          last_checkpoint = average.size();
+          next_checkpoint = nextCheckpoint(next_checkpoint, options.checkpoints_per_decade);
+        }
+        return !(options.target_standard_error > 0 &&
+                 average.size() >= options.min_trajectories &&
+                 average.maxStandardError() < options.target_standard_error);
+      });
+
+  // The final size is always reported.
+  if (average.size() != last_checkpoint)
+    checkpoint(average);
+  return success;
+}
+
+#endif // ENSEMBLE_AVERAGE_H
@@ -0,0 +1,154 @@
+#ifndef GATE_CLASSIFIER_H
+#define GATE_CLASSIFIER_H
+
+// Angle-keyed lookup of per-gate noise specifications.
+//
+// Custom-noise callbacks have to decide, for every gate, whether its angles
+// match one of a few calibrated gates (Ry(+pi/2), CZ, ...). Instead of a
+// chain of `std::abs(phi - M_PI/2) < 1e-4` tests, the calibrated gates are
+// registered once:
+//
+//   GateClassifier<iqsdk::IqsCustomOp> ops(1e-4, {
+//       {GateType::RotationXY, M_PI/2, M_PI/2, yppi2_op},
+//       {GateType::CPhase, 0, M_PI, cz_op}});
+//   ...
+//   return ops.lookup(GateType::RotationXY, phi, gamma, default_op);
+//
+// Angles are wrapped to [0, 2pi) (a rotation by gamma + 2pi only differs by
+// a global phase) and quantized into cells no wider than `tolerance`, with a
+// whole number of cells per turn. A gate is
+// registered in every cell its tolerance box overlaps, so a lookup is one
+// hash probe on the query's cell followed by an exact check of the few
+// entries stored there. Two-angle gates use (phi, gamma); one-angle gates
+// pass phi = 0.
+//
+// Lookups are const and the hit/miss counters are atomic, so one classifier
+// can serve callbacks of concurrent devices once registration is done.
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <initializer_list>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+enum class GateType : std::uint8_t { RotationXY, RotationZ, CPhase, SwapA };
+
+
+template <typename Value>
+class GateClassifier {
+public:
+  struct Gate {
+    GateType type;
+    double phi, gamma;
+    Value value;
+  };
+
+  explicit GateClassifier(double tolerance = 1e-4, std::initializer_list<Gate> gates = {})
+      : tolerance(tolerance),
+        num_cells(static_cast<std::int64_t>(std::ceil(k_two_pi / tolerance))) {
+    for (const Gate &gate : gates)
+      add(gate.type, gate.phi, gate.gamma, gate.value);
+  }
+
+  void add(GateType type, double phi, double gamma, const Value &value) {
+    phi = wrap(phi);
+    gamma = wrap(gamma);
+    std::size_t index = entries.size();
+    entries.push_back({type, phi, gamma, value});
+
+    std::vector<std::int64_t> phi_cells = cellsAround(phi), gamma_cells = cellsAround(gamma);
+    for (std::int64_t phi_cell : phi_cells) {
+      for (std::int64_t gamma_cell : gamma_cells) {
+        std::vector<std::size_t> &bucket = cells[key(type, phi_cell, gamma_cell)];
+        bucket.push_back(index);
+      }
+    }
+  }
+
+  // The value registered for a gate within `tolerance` of (phi, gamma), or
+  // nullptr.
+  const Value *find(GateType type, double phi, double gamma) const {
+    phi = wrap(phi);
+    gamma = wrap(gamma);
+    auto it = cells.find(key(type, cell(phi), cell(gamma)));
+    if (it != cells.end()) {
+      for (std::size_t index : it->second) {
+        const Gate &entry = entries[index];
+        if (entry.type == type && distance(entry.phi, phi) < tolerance &&
+            distance(entry.gamma, gamma) < tolerance) {
+          hits.fetch_add(1, std::memory_order_relaxed);
+          return &entry.value;
+        }
+      }
+    }
+    misses.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+  }
+
+  const Value &lookup(GateType type, double phi, double gamma,
+                      const Value &fallback) const {
+    const Value *value = find(type, phi, gamma);
+    return value ? *value : fallback;
+  }
+
+  double getTolerance() const { return tolerance; }
+  std::uint64_t numHits() const { return hits.load(std::memory_order_relaxed); }
+  std::uint64_t numMisses() const { return misses.load(std::memory_order_relaxed); }
+
+  void printStats(const std::string &name, std::ostream &out = std::cout) const {
+    out << name << ": " << entries.size() << " gates in " << cells.size()
+        << " cells, " << numHits() << " hits, " << numMisses() << " misses"
+        << std::endl;
+  }
+
+private:
+  static constexpr double k_two_pi = 2 * M_PI;
+
+  static double wrap(double angle) {
+    angle = std::fmod(angle, k_two_pi);
+    if (angle < 0)
+      angle += k_two_pi;
+    return angle < k_two_pi ? angle : 0;
+  }
+
+  static double distance(double a, double b) {
+    double d = std::abs(a - b);
+    return std::min(d, k_two_pi - d);
+  }
+
+  std::int64_t cell(double wrapped) const {
+    return std::min(num_cells - 1,
+                    static_cast<std::int64_t>(wrapped / k_two_pi * num_cells));
+  }
+
+  // Cells overlapping [angle - tolerance, angle + tolerance], across the
+  // wrap-around at 2pi.
+  std::vector<std::int64_t> cellsAround(double angle) const {
+    std::int64_t first = static_cast<std::int64_t>(
+        std::floor((angle - tolerance) / k_two_pi * num_cells));
+    std::int64_t last = static_cast<std::int64_t>(
+        std::floor((angle + tolerance) / k_two_pi * num_cells));
+    std::vector<std::int64_t> result;
+    for (std::int64_t c = first; c <= last && c < first + num_cells; c++)
+      result.push_back(((c % num_cells) + num_cells) % num_cells);
+    return result;
+  }
+
+  static std::uint64_t key(GateType type, std::int64_t phi_cell, std::int64_t gamma_cell) {
+    return (std::uint64_t(type) << 56) ^ (std::uint64_t(phi_cell) << 28) ^
+           std::uint64_t(gamma_cell);
+  }
+
+  double tolerance;
+  std::int64_t num_cells;
+  std::vector<Gate> entries;
+  std::unordered_map<std::uint64_t, std::vector<std::size_t>> cells;
+  mutable std::atomic<std::uint64_t> hits{0}, misses{0};
+};
+
+#endif // GATE_CLASSIFIER_H
@@ -0,0 +1,160 @@
+#ifndef GATE_FUSION_H
+#define GATE_FUSION_H
+
+// Gate fusion in front of a state-vector engine.
+//
+// Every gate a CustomInterface receives is one full pass over the state, so
+// a run like RZ, RXY, CPhase, RZ on the same two qubits costs four sweeps.
+// GateFusion buffers gates as dense unitaries (noise_channel.h conventions:
+// row-major, qubits[0] the most significant bit of the matrix index) and
+// multiplies each one into the pending block as long as the union of their
+// qubits stays within `max_qubits`. The block is handed to the sink, which
+// applies it in one pass, when a gate would grow it past `max_qubits`, on
+// flush(), and on destruction. Backends flush before anything that reads
+// the state: measurement, preparation, state-dependent noise and the final
+// probabilities.
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "noise_channel.h"
+
+
+// diag(exp(-i angle / 2), exp(i angle / 2)), the RotationZ convention.
+inline ComplexMatrix rotationZMatrix(double angle) {
+  std::complex<double> phase = std::polar(1.0, -angle / 2);
+  return {phase, 0, 0, std::conj(phase)};
+}
+
+// |11> gets exp(-i angle), as ApplyCPhaseRotation(ctrl, target, -angle).
+inline ComplexMatrix cphaseMatrix(double angle) {
+  ComplexMatrix m(16);
+  m[0] = m[5] = m[10] = 1;
+  m[15] = std::polar(1.0, -angle);
+  return m;
+}
+
+// The ISwapRotation matrix CustomBackend builds for SwapA, on |01> and |10>.
+inline ComplexMatrix swapAMatrix(double angle) {
+  std::complex<double> diagonal = {0.5 * (1.0 + std::cos(angle)), 0.5 * std::sin(angle)};
+  std::complex<double> off = {0.5 * (1.0 - std::cos(angle)), -0.5 * std::sin(angle)};
+  return {1, 0, 0, 0,
+          0, diagonal, off, 0,
+          0, off, diagonal, 0,
+          0, 0, 0, 1};
+}
+
+
+class GateFusion {
+public:
+  // Receives each fused block: its qubits and the matrix on them.
+  using Sink = std::function<void(const std::vector<unsigned> &qubits,
+                                  const ComplexMatrix &matrix)>;
+
+  explicit GateFusion(Sink sink, unsigned max_qubits = 2)
+      : sink(std::move(sink)), max_qubits(std::max(max_qubits, 1u)) {}
+
+  GateFusion(const GateFusion &) = delete;
+  GateFusion &operator=(const GateFusion &) = delete;
+
+  ~GateFusion() { flush(); }
+
+  // Queues `gate`, a dense unitary on `qubits`.
+  void add(const std::vector<unsigned> &qubits, const ComplexMatrix &gate) {
+    num_gates++;
+    std::vector<unsigned> support = pending_qubits;
+    for (unsigned q : qubits)
+      if (std::find(support.begin(), support.end(), q) == support.end())
+        support.push_back(q);
+
+    // A gate wider than max_qubits on its own still goes through as one block.
+    if (support.size() > max_qubits && !pending_qubits.empty()) {
+      flush();
+      support = qubits;
+    }
+    if (pending_qubits.empty()) {
+      pending_qubits = qubits;
+      pending = gate;
+      return;
+    }
+    if (support.size() != pending_qubits.size())
+      pending = embed(pending, pending_qubits, support);
+    pending = multiply(embed(gate, qubits, support), pending);
+    pending_qubits.swap(support);
+  }
+
+  void add(unsigned q, const ComplexMatrix &gate) { add(std::vector<unsigned>{q}, gate); }
+
+  void add(unsigned q1, unsigned q2, const ComplexMatrix &gate) {
+    add(std::vector<unsigned>{q1, q2}, gate);
+  }
+
+  // Applies the pending block, if any.
+  void flush() {
+    if (pending_qubits.empty())
+      return;
+    num_blocks++;
+    sink(pending_qubits, pending);
+    clear();
+  }
+
+  // Drops the pending block, e.g. when the state it acts on is reset.
+  void clear() {
+    pending_qubits.clear();
+    pending.clear();
+  }
+
+  unsigned maxQubits() const { return max_qubits; }
+  // Qubits of the pending block, empty if there is none.
+  const std::vector<unsigned> &pendingQubits() const { return pending_qubits; }
+  // Gates queued and blocks applied so far; their ratio is the number of
+  // state sweeps saved per sweep made.
+  std::size_t numGates() const { return num_gates; }
+  std::size_t numBlocks() const { return num_blocks; }
+  double fusionFactor() const { return num_blocks ? double(num_gates) / num_blocks : 1; }
+
+private:
+  // `m` on `from` (a subset of `to`) as a matrix on `to`, identity on the
+  // other qubits.
+  static ComplexMatrix embed(const ComplexMatrix &m, const std::vector<unsigned> &from,
+                             const std::vector<unsigned> &to) {
+    const unsigned n = to.size(), dim = 1u << n, from_dim = 1u << from.size();
+    // Bit of each `from` qubit in the index over `to`.
+    std::vector<unsigned> bits(from.size());
+    unsigned from_mask = 0;
+    for (std::size_t a = 0; a < from.size(); a++) {
+      unsigned position = std::find(to.begin(), to.end(), from[a]) - to.begin();
+      bits[a] = n - 1 - position;
+      from_mask |= 1u << bits[a];
+    }
+    auto spread = [&](unsigned i) {
+      unsigned index = 0;
+      for (std::size_t a = 0; a < from.size(); a++)
+        index |= (i >> (from.size() - 1 - a) & 1) << bits[a];
+      return index;
+    };
+
+    ComplexMatrix result(std::size_t(dim) * dim);
+    for (unsigned rest = 0; rest < dim; rest++) {
+      if (rest & from_mask)
+        continue;
+      for (unsigned r = 0; r < from_dim; r++)
+        for (unsigned c = 0; c < from_dim; c++)
+          result[(rest | spread(r)) * dim + (rest | spread(c))] = m[r * from_dim + c];
+    }
+    return result;
+  }
+
+  Sink sink;
+  unsigned max_qubits;
+  std::vector<unsigned> pending_qubits;
+  ComplexMatrix pending;
+  std::size_t num_gates = 0, num_blocks = 0;
+};
+
+#endif // GATE_FUSION_H
@@ -0,0 +1,1079 @@
+#ifndef MATCHING_DECODER_H
+#define MATCHING_DECODER_H
+
+// Graph decoders for codes whose errors flip one or two detectors.
+//
+// A DetectorGraph has one node per detector (a syndrome bit, or the XOR of
+// two rounds of one) plus a boundary node, and one edge per independent
+// error mechanism: the detectors it flips, its probability, and whether it
+// flips the logical observable. Given the detectors that fired in a shot,
+// a decoder picks a set of edges, the correction, that flips exactly those
+// detectors, and reports whether it flips the observable.
+//
+// - UnionFindDecoder (Delfosse and Nickerson) grows a cluster around every
+//   fired detector, at the same rate along every edge weighted by
+//   log((1 - p) / p), merges clusters whose growth meets, and stops once no
+//   cluster holds an odd number of fired detectors without reaching the
+//   boundary. A spanning tree of each cluster is then peeled from the
+//   leaves. Almost linear in the number of fired detectors.
+// - MatchingDecoder finds the minimum-weight correction exactly. Dijkstra
+//   from every fired detector, cut off where a path can no longer beat
+//   sending both ends to the boundary, gives a sparse graph over the fired
+//   detectors and one boundary twin each, on which BlossomMatching finds a
+//   minimum-weight perfect matching, one connected group at a time.
+//
+// Both keep the graph as compressed adjacency arrays (one offset per node,
+// then every node's neighbours back to back), and keep their per-shot
+// scratch space between shots: touched entries are reset, not the whole
+// graph. decodeBatch() decodes every row of a ShotMatrix in one call.
+// Decoders are not thread safe; give each thread its own.
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "shot_matrix.h"
+
+
+class DetectorGraph {
+public:
+  // As the second detector of an edge: the boundary.
+  static constexpr unsigned k_boundary = ~0u;
+
+  struct Edge {
+    unsigned a, b; // b may be k_boundary
+    double probability;
+    bool observable;
+  };
+
+  explicit DetectorGraph(unsigned num_detectors) : detectors(num_detectors) {}
+
+  // Adds an error that flips detectors a and b (or only a, if b is
+  // k_boundary) with the given probability, flipping the observable too if
+  // `observable`. Returns the edge index, which corrections refer to.
+  unsigned addEdge(unsigned a, unsigned b, double probability, bool observable) {
+    if (a >= detectors || (b != k_boundary && (b >= detectors || b == a)))
+      throw std::invalid_argument("DetectorGraph::addEdge: bad detector");
+    // Weights log((1 - p) / p) must be positive.
+    if (!(probability > 0 && probability < 0.5))
+      throw std::invalid_argument("DetectorGraph::addEdge: probability not in (0, 0.5)");
+    edge_list.push_back({a, b, probability, observable});
+    return edge_list.size() - 1;
+  }
+
+  // One round of the distance-d repetition code: detector i is the parity
+  // of data qubits i and i + 1, and edge i is a flip of data qubit i, which
+  // also flips the logical Z (the parity of all data qubits).
+  static DetectorGraph repetitionCode(unsigned distance, double probability = 0.01) {
+    if (distance < 2)
+      throw std::invalid_argument("DetectorGraph::repetitionCode: distance < 2");
+    DetectorGraph graph(distance - 1);
+    for (unsigned i = 0; i < distance; i++) {
+      unsigned a = i == 0 ? 0 : i - 1;
+      unsigned b = i == 0 || i == distance - 1 ? k_boundary : i;
+      graph.addEdge(a, b, probability, true);
+    }
+    return graph;
+  }
+
+  unsigned numDetectors() const { return detectors; }
+  unsigned numEdges() const { return edge_list.size(); }
+  const std::vector<Edge> &edges() const { return edge_list; }
+
+private:
+  unsigned detectors;
+  std::vector<Edge> edge_list;
+};
+
+
+// Maximum-weight matching in a general graph by Edmonds' blossom algorithm
+// with dual variables, O(n^3), after Joris van Rantwijk's public domain
+// mwmatching.py. Weights are integers and the matching always has maximum
+// cardinality, which is what minimum-weight perfect matching needs. The
+// names follow the original, where `p` is an endpoint: edge k has endpoints
+// 2k and 2k + 1, and a vertex's mate is stored as the remote endpoint of its
+// matched edge.
+class BlossomMatching {
+public:
+  struct Edge {
+    int i, j;
+    std::int64_t weight;
+  };
+
+  // Partner of every vertex, or -1.
+  const std::vector<int> &solve(int num_vertices, const std::vector<Edge> &graph) {
+    n = num_vertices;
+    edges = &graph;
+    const int num_edges = graph.size();
+    mate.assign(n, -1);
+    if (num_edges == 0)
+      return mate;
+
+    std::int64_t max_weight = 0;
+    endpoint.resize(2 * num_edges);
+    neighbend_start.assign(n + 1, 0);
+    for (int k = 0; k < num_edges; k++) {
+      max_weight = std::max(max_weight, graph[k].weight);
+      endpoint[2 * k] = graph[k].i;
+      endpoint[2 * k + 1] = graph[k].j;
+      neighbend_start[graph[k].i + 1]++;
+      neighbend_start[graph[k].j + 1]++;
+    }
+    for (int v = 0; v < n; v++)
+      neighbend_start[v + 1] += neighbend_start[v];
+    neighbend.resize(2 * num_edges);
+    std::vector<int> fill(neighbend_start.begin(), neighbend_start.end() - 1);
+    for (int k = 0; k < num_edges; k++) {
+      neighbend[fill[graph[k].i]++] = 2 * k + 1;
+      neighbend[fill[graph[k].j]++] = 2 * k;
+    }
+
+    label.assign(2 * n, 0);
+    labelend.assign(2 * n, -1);
+    inblossom.resize(n);
+    for (int v = 0; v < n; v++)
+      inblossom[v] = v;
+    blossomparent.assign(2 * n, -1);
+    blossomchilds.resize(2 * n);
+    blossomendps.resize(2 * n);
+    blossombase.assign(2 * n, -1);
+    for (int v = 0; v < n; v++)
+      blossombase[v] = v;
+    bestedge.assign(2 * n, -1);
+    blossombestedges.resize(2 * n);
+    has_bestedges.assign(2 * n, false);
+    unusedblossoms.clear();
+    for (int b = 2 * n - 1; b >= n; b--)
+      unusedblossoms.push_back(b);
+    dualvar.assign(2 * n, 0);
+    std::fill(dualvar.begin(), dualvar.begin() + n, max_weight);
+    allowedge.assign(num_edges, false);
+    for (int b = 0; b < 2 * n; b++) {
+      blossomchilds[b].clear();
+      blossomendps[b].clear();
+      blossombestedges[b].clear();
+    }
+
+    for (int stage = 0; stage < n; stage++) {
+      std::fill(label.begin(), label.end(), 0);
+      std::fill(bestedge.begin(), bestedge.end(), -1);
+      for (int b = n; b < 2 * n; b++) {
+        blossombestedges[b].clear();
+        has_bestedges[b] = false;
+      }
+      std::fill(allowedge.begin(), allowedge.end(), false);
+      queue.clear();
+      for (int v = 0; v < n; v++)
+        if (mate[v] == -1 && label[inblossom[v]] == 0)
+          assignLabel(v, 1, -1);
+
+      bool augmented = false;
+      for (;;) {
+        while (!queue.empty() && !augmented) {
+          const int v = queue.back();
+          queue.pop_back();
+          for (int e = neighbend_start[v]; e < neighbend_start[v + 1]; e++) {
+            const int p = neighbend[e], k = p / 2, w = endpoint[p];
+            if (inblossom[v] == inblossom[w])
+              continue;
+            std::int64_t kslack = 0;
+            if (!allowedge[k]) {
+              kslack = slack(k);
+              if (kslack <= 0)
+                allowedge[k] = true;
+            }
+            if (allowedge[k]) {
+              if (label[inblossom[w]] == 0) {
+                assignLabel(w, 2, p ^ 1);
+              } else if (label[inblossom[w]] == 1) {
+                const int base = scanBlossom(v, w);
+                if (base >= 0) {
+                  addBlossom(base, k);
+                } else {
+                  augmentMatching(k);
+                  augmented = true;
+                  break;
+                }
+              } else if (label[w] == 0) {
+                label[w] = 2;
+                labelend[w] = p ^ 1;
+              }
+            } else if (label[inblossom[w]] == 1) {
+              const int b = inblossom[v];
+              if (bestedge[b] == -1 || kslack < slack(bestedge[b]))
+                bestedge[b] = k;
+            } else if (label[w] == 0) {
+              if (bestedge[w] == -1 || kslack < slack(bestedge[w]))
+                bestedge[w] = k;
+            }
+          }
+        }
+        if (augmented)
+          break;
+
+        // No augmenting path with the current duals: change them.
+        int deltatype = -1, deltaedge = -1, deltablossom = -1;
+        std::int64_t delta = 0;
+        for (int v = 0; v < n; v++) {
+          if (label[inblossom[v]] == 0 && bestedge[v] != -1) {
+            const std::int64_t d = slack(bestedge[v]);
+            if (deltatype == -1 || d < delta) {
+              delta = d;
+              deltatype = 2;
+              deltaedge = bestedge[v];
+            }
+          }
+        }
+        for (int b = 0; b < 2 * n; b++) {
+          if (blossomparent[b] == -1 && label[b] == 1 && bestedge[b] != -1) {
+            const std::int64_t d = slack(bestedge[b]) / 2;
+            if (deltatype == -1 || d < delta) {
+              delta = d;
+              deltatype = 3;
+              deltaedge = bestedge[b];
+            }
+          }
+        }
+        for (int b = n; b < 2 * n; b++) {
+          if (blossombase[b] >= 0 && blossomparent[b] == -1 && label[b] == 2 &&
+              (deltatype == -1 || dualvar[b] < delta)) {
+            delta = dualvar[b];
+            deltatype = 4;
+            deltablossom = b;
+          }
+        }
+        if (deltatype == -1) {
+          // Maximum cardinality reached: one last dual update to optimum.
+          deltatype = 1;
+          delta = std::max<std::int64_t>(
+            0, *std::min_element(dualvar.begin(), dualvar.begin() + n));
+        }
+
+        for (int v = 0; v < n; v++) {
+          if (label[inblossom[v]] == 1)
+            dualvar[v] -= delta;
+          else if (label[inblossom[v]] == 2)
+            dualvar[v] += delta;
+        }
+        for (int b = n; b < 2 * n; b++) {
+          if (blossombase[b] >= 0 && blossomparent[b] == -1) {
+            if (label[b] == 1)
+              dualvar[b] += delta;
+            else if (label[b] == 2)
+              dualvar[b] -= delta;
+          }
+        }
+
+        if (deltatype == 1) {
+          break;
+        } else if (deltatype == 2) {
+          allowedge[deltaedge] = true;
+          int i = graph[deltaedge].i, j = graph[deltaedge].j;
+          if (label[inblossom[i]] == 0)
+            std::swap(i, j);
+          queue.push_back(i);
+        } else if (deltatype == 3) {
+          allowedge[deltaedge] = true;
+          queue.push_back(graph[deltaedge].i);
+        } else {
+          expandBlossom(deltablossom, false);
+        }
+      }
+
+      if (!augmented)
+        break;
+      for (int b = n; b < 2 * n; b++)
+        if (blossomparent[b] == -1 && blossombase[b] >= 0 && label[b] == 1 &&
+            dualvar[b] == 0)
+          expandBlossom(b, true);
+    }
+
+    for (int v = 0; v < n; v++)
+      if (mate[v] >= 0)
+        mate[v] = endpoint[mate[v]];
+    return mate;
+  }
+
+private:
+  std::int64_t slack(int k) const {
+    const Edge &edge = (*edges)[k];
+    return dualvar[edge.i] + dualvar[edge.j] - 2 * edge.weight;
+  }
+
+  template <typename F> void forEachLeaf(int b, F &&f) {
+    if (b < n) {
+      f(b);
+      return;
+    }
+    for (int t : blossomchilds[b])
+      forEachLeaf(t, f);
+  }
+
+  // Python-style index into a blossom's cyclic child and endpoint lists.
+  static int wrap(int j, int size) { return j < 0 ? j + size : j; }
+
+  void assignLabel(int w, int t, int p) {
+    const int b = inblossom[w];
+    label[w] = label[b] = t;
+    labelend[w] = labelend[b] = p;
+    bestedge[w] = bestedge[b] = -1;
+    if (t == 1) {
+      forEachLeaf(b, [&](int v) { queue.push_back(v); });
+    } else if (t == 2) {
+      const int base = blossombase[b];
+      assignLabel(endpoint[mate[base]], 1, mate[base] ^ 1);
+    }
+  }
+
+  // Traces back from v and w to find a new blossom's base, or -1 if the
+  // two paths reach different roots (an augmenting path).
+  int scanBlossom(int v, int w) {
+    std::vector<int> &path = scan_path;
+    path.clear();
+    int base = -1;
+    while (v != -1 || w != -1) {
+      int b = inblossom[v];
+      if (label[b] & 4) {
+        base = blossombase[b];
+        break;
+      }
+      path.push_back(b);
+      label[b] = 5;
+      if (labelend[b] == -1) {
+        v = -1;
+      } else {
+        v = endpoint[labelend[b]];
+        b = inblossom[v];
+        v = endpoint[labelend[b]];
+      }
+      if (w != -1)
+        std::swap(v, w);
+    }
+    for (int b : path)
+      label[b] = 1;
+    return base;
+  }
+
+  void addBlossom(int base, int k) {
+    int v = (*edges)[k].i, w = (*edges)[k].j;
+    const int bb = inblossom[base];
+    int bv = inblossom[v], bw = inblossom[w];
+    const int b = unusedblossoms.back();
+    unusedblossoms.pop_back();
+    blossombase[b] = base;
+    blossomparent[b] = -1;
+    blossomparent[bb] = b;
+    std::vector<int> &path = blossomchilds[b], &endps = blossomendps[b];
+    path.clear();
+    endps.clear();
+    while (bv != bb) {
+      blossomparent[bv] = b;
+      path.push_back(bv);
+      endps.push_back(labelend[bv]);
+      v = endpoint[labelend[bv]];
+      bv = inblossom[v];
+    }
+    path.push_back(bb);
+    std::reverse(path.begin(), path.end());
+    std::reverse(endps.begin(), endps.end());
+    endps.push_back(2 * k);
+    while (bw != bb) {
+      blossomparent[bw] = b;
+      path.push_back(bw);
+      endps.push_back(labelend[bw] ^ 1);
+      w = endpoint[labelend[bw]];
+      bw = inblossom[w];
+    }
+    label[b] = 1;
+    labelend[b] = labelend[bb];
+    dualvar[b] = 0;
+    forEachLeaf(b, [&](int leaf) {
+      if (label[inblossom[leaf]] == 2)
+        queue.push_back(leaf);
+      inblossom[leaf] = b;
+    });
+
+    // Least-slack edge from the new blossom to every neighbouring S-blossom.
+    bestedgeto.assign(2 * n, -1);
+    auto consider = [&](int edge) {
+      int j = (*edges)[edge].j;
+      if (inblossom[j] == b)
+        j = (*edges)[edge].i;
+      const int bj = inblossom[j];
+      if (bj != b && label[bj] == 1 &&
+          (bestedgeto[bj] == -1 || slack(edge) < slack(bestedgeto[bj])))
+        bestedgeto[bj] = edge;
+    };
+    for (int child : path) {
+      if (!has_bestedges[child]) {
+        forEachLeaf(child, [&](int leaf) {
+          for (int e = neighbend_start[leaf]; e < neighbend_start[leaf + 1]; e++)
+            consider(neighbend[e] / 2);
+        });
+      } else {
+        for (int edge : blossombestedges[child])
+          consider(edge);
+      }
+      blossombestedges[child].clear();
+      has_bestedges[child] = false;
+      bestedge[child] = -1;
+    }
+    blossombestedges[b].clear();
+    for (int edge : bestedgeto)
+      if (edge != -1)
+        blossombestedges[b].push_back(edge);
+    has_bestedges[b] = true;
+    bestedge[b] = -1;
+    for (int edge : blossombestedges[b])
+      if (bestedge[b] == -1 || slack(edge) < slack(bestedge[b]))
+        bestedge[b] = edge;
+  }
+
+  void expandBlossom(int b, bool endstage) {
+    for (int s : blossomchilds[b]) {
+      blossomparent[s] = -1;
+      if (s < n)
+        inblossom[s] = s;
+      else if (endstage && dualvar[s] == 0)
+        expandBlossom(s, endstage);
+      else
+        forEachLeaf(s, [&](int leaf) { inblossom[leaf] = s; });
+    }
+
+    if (!endstage && label[b] == 2) {
+      // The expanded T-blossom's children on the even-length path from
+      // the entry child to the base become alternately T and S; the rest
+      // lose their labels unless reachable from outside.
+      const std::vector<int> &childs = blossomchilds[b], &endps = blossomendps[b];
+      const int size = childs.size();
+      const int entrychild = inblossom[endpoint[labelend[b] ^ 1]];
+      int j = std::find(childs.begin(), childs.end(), entrychild) - childs.begin();
+      int jstep, endptrick;
+      if (j & 1) {
+        j -= size;
+        jstep = 1;
+        endptrick = 0;
+      } else {
+        jstep = -1;
+        endptrick = 1;
+      }
+      int p = labelend[b];
+      while (j != 0) {
+        label[endpoint[p ^ 1]] = 0;
+        label[endpoint[endps[wrap(j - endptrick, size)] ^ endptrick ^ 1]] = 0;
+        assignLabel(endpoint[p ^ 1], 2, p);
+        allowedge[endps[wrap(j - endptrick, size)] / 2] = true;
+        j += jstep;
+        p = endps[wrap(j - endptrick, size)] ^ endptrick;
+        allowedge[p / 2] = true;
+        j += jstep;
+      }
+      int bv = childs[wrap(j, size)];
+      label[endpoint[p ^ 1]] = label[bv] = 2;
+      labelend[endpoint[p ^ 1]] = labelend[bv] = p;
+      bestedge[bv] = -1;
+      j += jstep;
+      while (childs[wrap(j, size)] != entrychild) {
+        bv = childs[wrap(j, size)];
+        if (label[bv] == 1) {
+          j += jstep;
+          continue;
+        }
+        int reached = -1;
+        forEachLeaf(bv, [&](int leaf) {
+          if (reached == -1 && label[leaf] != 0)
+            reached = leaf;
+        });
+        if (reached != -1) {
+          label[reached] = 0;
+          label[endpoint[mate[blossombase[bv]]]] = 0;
+          assignLabel(reached, 2, labelend[reached]);
+        }
+        j += jstep;
+      }
+    }
+
+    label[b] = labelend[b] = -1;
+    blossomchilds[b].clear();
+    blossomendps[b].clear();
+    blossombase[b] = -1;
+    blossombestedges[b].clear();
+    has_bestedges[b] = false;
+    bestedge[b] = -1;
+    unusedblossoms.push_back(b);
+  }
+
+  // Swaps matched and unmatched edges on the path through blossom b from
+  // vertex v to the base, and makes v's child the new base.
+  void augmentBlossom(int b, int v) {
+    int t = v;
+    while (blossomparent[t] != b)
+      t = blossomparent[t];
+    if (t >= n)
+      augmentBlossom(t, v);
+    std::vector<int> &childs = blossomchilds[b], &endps = blossomendps[b];
+    const int size = childs.size();
+    const int i = std::find(childs.begin(), childs.end(), t) - childs.begin();
+    int j = i, jstep, endptrick;
+    if (i & 1) {
+      j -= size;
+      jstep = 1;
+      endptrick = 0;
+    } else {
+      jstep = -1;
+      endptrick = 1;
+    }
+    while (j != 0) {
+      j += jstep;
+      t = childs[wrap(j, size)];
+      const int p = endps[wrap(j - endptrick, size)] ^ endptrick;
+      if (t >= n)
+        augmentBlossom(t, endpoint[p]);
+      j += jstep;
+      t = childs[wrap(j, size)];
+      if (t >= n)
+        augmentBlossom(t, endpoint[p ^ 1]);
+      mate[endpoint[p]] = p ^ 1;
+      mate[endpoint[p ^ 1]] = p;
+    }
+    std::rotate(childs.begin(), childs.begin() + i, childs.end());
+    std::rotate(endps.begin(), endps.begin() + i, endps.end());
+    blossombase[b] = blossombase[childs[0]];
+  }
+
+  // Swaps matched and unmatched edges along the augmenting path through
+  // edge k, which joins two S-vertices with different roots.
+  void augmentMatching(int k) {
+    const std::pair<int, int> ends[2] = {{(*edges)[k].i, 2 * k + 1},
+                                         {(*edges)[k].j, 2 * k}};
+    for (auto [s, p] : ends) {
+      for (;;) {
+        const int bs = inblossom[s];
+        if (bs >= n)
+          augmentBlossom(bs, s);
+        mate[s] = p;
+        if (labelend[bs] == -1)
+          break;
+        const int t = endpoint[labelend[bs]];
+        const int bt = inblossom[t];
+        s = endpoint[labelend[bt]];
+        const int j = endpoint[labelend[bt] ^ 1];
+        if (bt >= n)
+          augmentBlossom(bt, j);
+        mate[j] = labelend[bt];
+        p = labelend[bt] ^ 1;
+      }
+    }
+  }
+
+  int n = 0;
+  const std::vector<Edge> *edges = nullptr;
+  std::vector<int> endpoint, neighbend_start, neighbend;
+  std::vector<int> mate, label, labelend, inblossom, blossomparent, blossombase;
+  std::vector<std::vector<int>> blossomchilds, blossomendps, blossombestedges;
+  std::vector<bool> has_bestedges, allowedge;
+  std::vector<int> bestedge, unusedblossoms, queue, bestedgeto, scan_path;
+  std::vector<std::int64_t> dualvar;
+};
+
+
+// What the decoders share: the graph in adjacency arrays, the observable
+// of the last correction, and the batch loop.
+class GraphDecoder {
+public:
+  explicit GraphDecoder(const DetectorGraph &graph)
+      : detectors(graph.numDetectors()), boundary(graph.numDetectors()),
+        adjacency_start(graph.numDetectors() + 2, 0), fired(graph.numDetectors() + 1, false) {
+    for (const DetectorGraph::Edge &edge : graph.edges()) {
+      const unsigned b = edge.b == DetectorGraph::k_boundary ? boundary : edge.b;
+      edge_nodes.push_back({edge.a, b});
+      edge_observable.push_back(edge.observable);
+      weights.push_back(std::log((1 - edge.probability) / edge.probability));
+      adjacency_start[edge.a + 1]++;
+      adjacency_start[b + 1]++;
+    }
+    for (unsigned v = 0; v <= boundary; v++)
+      adjacency_start[v + 1] += adjacency_start[v];
+    adjacency.resize(adjacency_start.back());
+    std::vector<unsigned> fill(adjacency_start.begin(), adjacency_start.end() - 1);
+    for (unsigned e = 0; e < edge_nodes.size(); e++) {
+      adjacency[fill[edge_nodes[e].first]++] = {edge_nodes[e].second, e};
+      adjacency[fill[edge_nodes[e].second]++] = {edge_nodes[e].first, e};
+    }
+  }
+  virtual ~GraphDecoder() = default;
+
+  unsigned numDetectors() const { return detectors; }
+
+  // Decodes one shot given the detectors that fired, each at most once.
+  // Returns whether the correction flips the observable.
+  virtual bool decode(const std::vector<unsigned> &defects) = 0;
+
+  // Edges of the last correction.
+  const std::vector<unsigned> &correction() const { return correction_edges; }
+
+  // Decodes every shot of `shots`, whose detectors are bits first_detector
+  // to first_detector + numDetectors() - 1; predictions[s] is whether the
+  // correction of shot s flips the observable.
+  void decodeBatch(const ShotMatrix &shots, unsigned first_detector,
+                   std::vector<std::uint8_t> &predictions) {
+    if (first_detector + detectors > shots.numBits())
+      throw std::invalid_argument("decodeBatch: detectors past the end of the shots");
+    predictions.resize(shots.numShots());
+    const unsigned end = first_detector + detectors;
+    for (std::size_t shot = 0; shot < shots.numShots(); shot++) {
+      const std::uint64_t *row = shots.row(shot);
+      defects.clear();
+      for (unsigned w = first_detector / 64; w * 64 < end; w++) {
+        std::uint64_t bits = row[w];
+        if (w == first_detector / 64)
+          bits &= ~std::uint64_t(0) << (first_detector % 64);
+        if ((w + 1) * 64 > end && end % 64)
+          bits &= (std::uint64_t(1) << (end % 64)) - 1;
+        while (bits) {
+          defects.push_back(w * 64 + __builtin_ctzll(bits) - first_detector);
+          bits &= bits - 1;
+        }
+      }
+      predictions[shot] = decode(defects);
+    }
+  }
+
+protected:
+  struct Neighbor {
+    unsigned node, edge;
+  };
+
+  const Neighbor *neighborsBegin(unsigned v) const { return &adjacency[adjacency_start[v]]; }
+  const Neighbor *neighborsEnd(unsigned v) const { return &adjacency[adjacency_start[v + 1]]; }
+
+  // Sets correction_edges from `edges`, cancelling edges used twice, and
+  // returns the observable parity.
+  bool setCorrection(std::vector<unsigned> &edges) {
+    std::sort(edges.begin(), edges.end());
+    correction_edges.clear();
+    bool flip = false;
+    for (std::size_t i = 0; i < edges.size(); i++) {
+      if (i + 1 < edges.size() && edges[i] == edges[i + 1]) {
+        i++;
+        continue;
+      }
+      correction_edges.push_back(edges[i]);
+      flip ^= edge_observable[edges[i]];
+    }
+    return flip;
+  }
+
+  void checkDefects(const std::vector<unsigned> &defects) const {
+    for (unsigned d : defects)
+      if (d >= detectors)
+        throw std::invalid_argument("decode: detector out of range");
+  }
+
+  unsigned detectors;
+  // Node index of the boundary, after the detectors.
+  unsigned boundary;
+  std::vector<unsigned> adjacency_start;
+  std::vector<Neighbor> adjacency;
+  std::vector<std::pair<unsigned, unsigned>> edge_nodes;
+  std::vector<bool> edge_observable;
+  std::vector<double> weights;
+  // Scratch: which nodes are fired (the boundary never is).
+  std::vector<bool> fired;
+
+private:
+  std::vector<unsigned> correction_edges, defects;
+};
+
+
+class UnionFindDecoder : public GraphDecoder {
+public:
+  explicit UnionFindDecoder(const DetectorGraph &graph)
+      : GraphDecoder(graph), parent(boundary + 1), odd(boundary + 1, false),
+        has_boundary(boundary + 1, false), members(boundary + 1),
+        growth(edge_nodes.size(), 0), grown(edge_nodes.size(), false),
+        tree_edge(boundary + 1), touched(boundary + 1, false), visited(boundary + 1, false) {
+    for (unsigned v = 0; v <= boundary; v++) {
+      parent[v] = v;
+      members[v] = {v};
+    }
+    has_boundary[boundary] = true;
+  }
+
+  bool decode(const std::vector<unsigned> &defects) override {
+    checkDefects(defects);
+    for (unsigned d : defects) {
+      fired[d] = true;
+      odd[d] = true;
+      touch(d);
+    }
+    grow(defects);
+    std::vector<unsigned> &edges = peel(defects);
+    const bool flip = setCorrection(edges);
+    clear();
+    return flip;
+  }
+
+private:
+  unsigned find(unsigned v) {
+    while (parent[v] != v)
+      v = parent[v] = parent[parent[v]];
+    return v;
+  }
+
+  void touch(unsigned v) {
+    if (!touched[v]) {
+      touched[v] = true;
+      touched_nodes.push_back(v);
+    }
+  }
+
+  // Merges the clusters of a and b, the smaller into the larger.
+  void merge(unsigned a, unsigned b) {
+    a = find(a);
+    b = find(b);
+    if (a == b)
+      return;
+    if (members[a].size() < members[b].size())
+      std::swap(a, b);
+    parent[b] = a;
+    members[a].insert(members[a].end(), members[b].begin(), members[b].end());
+    odd[a] = odd[a] != odd[b];
+    has_boundary[a] = has_boundary[a] || has_boundary[b];
+    for (unsigned v : members[b])
+      touch(v);
+    touch(a);
+  }
+
+  bool active(unsigned root) { return odd[root] && !has_boundary[root]; }
+
+  // Grows the odd clusters until none is left. Each step advances every
+  // frontier edge of an active cluster by `delta` per active side, the
+  // least amount that completes some edge.
+  void grow(const std::vector<unsigned> &defects) {
+    roots.assign(defects.begin(), defects.end());
+    while (!roots.empty()) {
+      double delta = std::numeric_limits<double>::infinity();
+      for (unsigned root : roots) {
+        for (unsigned v : members[root]) {
+          for (const Neighbor *nb = neighborsBegin(v); nb != neighborsEnd(v); nb++) {
+            if (grown[nb->edge] || find(nb->node) == root)
+              continue;
+            const double rate = active(find(nb->node)) ? 2 : 1;
+            delta = std::min(delta, (weights[nb->edge] - growth[nb->edge]) / rate);
+          }
+        }
+      }
+      if (delta == std::numeric_limits<double>::infinity())
+        break; // No edge left to grow into; the graph has no boundary.
+
+      completed.clear();
+      for (unsigned root : roots) {
+        for (unsigned v : members[root]) {
+          for (const Neighbor *nb = neighborsBegin(v); nb != neighborsEnd(v); nb++) {
+            const unsigned e = nb->edge;
+            if (grown[e] || find(nb->node) == root)
+              continue;
+            if (growth[e] == 0)
+              touched_edges.push_back(e);
+            growth[e] += delta;
+            if (growth[e] >= weights[e] * (1 - 1e-9)) {
+              grown[e] = true;
+              completed.push_back(e);
+            }
+          }
+        }
+      }
+      for (unsigned e : completed)
+        merge(edge_nodes[e].first, edge_nodes[e].second);
+
+      next_roots.clear();
+      for (unsigned root : roots) {
+        root = find(root);
+        if (active(root) && std::find(next_roots.begin(), next_roots.end(), root) ==
+                                next_roots.end())
+          next_roots.push_back(root);
+      }
+      roots.swap(next_roots);
+    }
+  }
+
+  // Spanning forest of the grown edges, rooted at the boundary where a
+  // cluster reaches it, peeled from the leaves: a fired leaf takes its tree
+  // edge into the correction and passes the flip to its parent.
+  std::vector<unsigned> &peel(const std::vector<unsigned> &defects) {
+    order.clear();
+    auto span = [&](unsigned root) {
+      if (visited[root])
+        return;
+      visited[root] = true;
+      tree_edge[root] = ~0u;
+      std::size_t head = order.size();
+      order.push_back(root);
+      while (head < order.size()) {
+        const unsigned v = order[head++];
+        for (const Neighbor *nb = neighborsBegin(v); nb != neighborsEnd(v); nb++) {
+          if (!grown[nb->edge] || visited[nb->node])
+            continue;
+          visited[nb->node] = true;
+          tree_edge[nb->node] = nb->edge;
+          order.push_back(nb->node);
+        }
+      }
+    };
+    span(boundary);
+    for (unsigned d : defects)
+      span(d);
+
+    peeled.clear();
+    for (std::size_t i = order.size(); i-- > 0;) {
+      const unsigned v = order[i];
+      if (!fired[v] || tree_edge[v] == ~0u)
+        continue;
+      const unsigned e = tree_edge[v];
+      peeled.push_back(e);
+      fired[v] = false;
+      const unsigned up = edge_nodes[e].first == v ? edge_nodes[e].second : edge_nodes[e].first;
+      if (up != boundary)
+        fired[up] = !fired[up];
+    }
+    for (unsigned v : order)
+      touch(v);
+    return peeled;
+  }
+
+  void clear() {
+    for (unsigned v : touched_nodes) {
+      parent[v] = v;
+      odd[v] = false;
+      has_boundary[v] = v == boundary;
+      members[v].assign(1, v);
+      fired[v] = false;
+      touched[v] = false;
+      visited[v] = false;
+    }
+    touched_nodes.clear();
+    for (unsigned e : touched_edges) {
+      growth[e] = 0;
+      grown[e] = false;
+    }
+    touched_edges.clear();
+  }
+
+  std::vector<unsigned> parent;
+  std::vector<bool> odd, has_boundary;
+  std::vector<std::vector<unsigned>> members;
+  std::vector<double> growth;
+  std::vector<bool> grown;
+  std::vector<unsigned> tree_edge;
+  std::vector<bool> touched, visited;
+  std::vector<unsigned> touched_nodes, touched_edges, roots, next_roots, completed;
+  std::vector<unsigned> order, peeled;
+};
+
+
+class MatchingDecoder : public GraphDecoder {
+public:
+  // Weights are rounded to multiples of 1 / k_weight_scale for the exact
+  // integer matching.
+  static constexpr double k_weight_scale = 1000;
+
+  explicit MatchingDecoder(const DetectorGraph &graph)
+      : GraphDecoder(graph), distance(boundary + 1, k_unreachable),
+        path_edge(boundary + 1, ~0u), boundary_distance(boundary + 1, k_unreachable),
+        boundary_edge(boundary + 1, ~0u) {
+    for (double w : weights)
+      integer_weights.push_back(std::max<std::int64_t>(1, std::llround(w * k_weight_scale)));
+    dijkstra(boundary, k_unreachable, boundary_distance, boundary_edge, nullptr);
+  }
+
+  bool decode(const std::vector<unsigned> &defects) override {
+    checkDefects(defects);
+    const int k = defects.size();
+    chosen.clear();
+    if (k == 0)
+      return setCorrection(chosen);
+
+    std::int64_t max_boundary = 0;
+    for (unsigned d : defects)
+      if (boundary_distance[d] != k_unreachable)
+        max_boundary = std::max(max_boundary, boundary_distance[d]);
+
+    // Vertices 0..k-1 are the defects, k..2k-1 their boundary twins. Every
+    // pair edge i-j has a free twin edge, so when i and j are matched to
+    // the boundary instead, their twins pair up.
+    matching_edges.clear();
+    for (int i = 0; i < k; i++) {
+      const unsigned d = defects[i];
+      if (boundary_distance[d] != k_unreachable)
+        matching_edges.push_back({i, k + i, boundary_distance[d]});
+      // A pair is only worth an edge if it beats sending both to the
+      // boundary, so the search stops there.
+      const std::int64_t limit = boundary_distance[d] == k_unreachable
+                                     ? k_unreachable
+                                     : boundary_distance[d] + max_boundary;
+      dijkstra(d, limit, distance, path_edge, &reached);
+      for (int j = i + 1; j < k; j++) {
+        const unsigned dj = defects[j];
+        if (distance[dj] == k_unreachable ||
+            (boundary_distance[d] != k_unreachable && boundary_distance[dj] != k_unreachable &&
+             distance[dj] >= boundary_distance[d] + boundary_distance[dj]))
+          continue;
+        matching_edges.push_back({i, j, distance[dj]});
+        matching_edges.push_back({k + i, k + j, 0});
+      }
+      resetSearch();
+    }
+
+    // Minimum weight perfect matching as a maximum weight matching of
+    // maximum cardinality on weights top - w, doubled to keep the duals
+    // integral.
+    std::int64_t top = 0;
+    for (const BlossomMatching::Edge &edge : matching_edges)
+      top = std::max(top, edge.weight);
+    top++;
+    for (BlossomMatching::Edge &edge : matching_edges)
+      edge.weight = 2 * (top - edge.weight);
+
+    // Pair edges split the defects into groups that are matched
+    // independently; solving each group on its own keeps the blossom's
+    // stages short when the defects are spread out.
+    group.resize(k);
+    std::iota(group.begin(), group.end(), 0);
+    for (const BlossomMatching::Edge &edge : matching_edges)
+      if (edge.j < k)
+        group[findGroup(edge.i)] = findGroup(edge.j);
+    for (int i = 0; i < k; i++)
+      group[i] = findGroup(i);
+    members.resize(k);
+    std::iota(members.begin(), members.end(), 0);
+    std::stable_sort(members.begin(), members.end(),
+                     [&](int a, int b) { return group[a] < group[b]; });
+    std::sort(matching_edges.begin(), matching_edges.end(),
+              [&](const BlossomMatching::Edge &a, const BlossomMatching::Edge &b) {
+                return group[a.i % k] < group[b.i % k];
+              });
+    local.resize(k);
+    mate.assign(k, -1);
+    std::size_t next_edge = 0;
+    for (int first = 0; first < k;) {
+      const int g = group[members[first]];
+      int last = first;
+      for (; last < k && group[members[last]] == g; last++)
+        local[members[last]] = last - first;
+      const int size = last - first;
+      group_edges.clear();
+      for (; next_edge < matching_edges.size() && group[matching_edges[next_edge].i % k] == g;
+           next_edge++) {
+        const BlossomMatching::Edge &edge = matching_edges[next_edge];
+        auto to_local = [&](int v) { return v < k ? local[v] : size + local[v - k]; };
+        group_edges.push_back({to_local(edge.i), to_local(edge.j), edge.weight});
+      }
+      const std::vector<int> &group_mate = blossom.solve(2 * size, group_edges);
+      for (int l = 0; l < size; l++) {
+        const int m = group_mate[l];
+        if (m >= 0)
+          mate[members[first + l]] = m < size ? members[first + m] : k + members[first + m - size];
+      }
+      first = last;
+    }
+
+    // The paths of the matching, the pairs' searched again.
+    for (int i = 0; i < k; i++) {
+      if (mate[i] == k + i) {
+        appendPath(defects[i], boundary_edge);
+      } else if (mate[i] > i && mate[i] < k) {
+        const unsigned target = defects[mate[i]];
+        dijkstra(defects[i], k_unreachable, distance, path_edge, &reached, target);
+        appendPath(target, path_edge);
+        resetSearch();
+      }
+    }
+    return setCorrection(chosen);
+  }
+
+private:
+  static constexpr std::int64_t k_unreachable = std::numeric_limits<std::int64_t>::max();
+
+  // Shortest paths from `source` up to distance `limit`, or until
+  // `target` is settled; dist and via (the last edge of each path) must be
+  // k_unreachable and ~0u wherever this call does not reach, and `reached`
+  // collects where it does.
+  void dijkstra(unsigned source, std::int64_t limit, std::vector<std::int64_t> &dist,
+                std::vector<unsigned> &via, std::vector<unsigned> *reached,
+                unsigned target = ~0u) {
+    using Item = std::pair<std::int64_t, unsigned>;
+    frontier.clear();
+    auto later = std::greater<Item>();
+    dist[source] = 0;
+    if (reached)
+      reached->push_back(source);
+    frontier.push_back({0, source});
+    while (!frontier.empty()) {
+      std::pop_heap(frontier.begin(), frontier.end(), later);
+      const auto [d, v] = frontier.back();
+      frontier.pop_back();
+      if (v == target)
+        return;
+      if (d > dist[v] || d > limit)
+        continue;
+      for (const Neighbor *nb = neighborsBegin(v); nb != neighborsEnd(v); nb++) {
+        const std::int64_t next = d + integer_weights[nb->edge];
+        if (next < dist[nb->node]) {
+          if (dist[nb->node] == k_unreachable && reached)
+            reached->push_back(nb->node);
+          dist[nb->node] = next;
+          via[nb->node] = nb->edge;
+          frontier.push_back({next, nb->node});
+          std::push_heap(frontier.begin(), frontier.end(), later);
+        }
+      }
+    }
+  }
+
+  int findGroup(int v) {
+    while (group[v] != v)
+      v = group[v] = group[group[v]];
+    return v;
+  }
+
+  void resetSearch() {
+    for (unsigned v : reached) {
+      distance[v] = k_unreachable;
+      path_edge[v] = ~0u;
+    }
+    reached.clear();
+  }
+
+  // Adds the edges of the path to `target` in the search tree `via`.
+  void appendPath(unsigned target, const std::vector<unsigned> &via) {
+    for (unsigned v = target; via[v] != ~0u;) {
+      const unsigned e = via[v];
+      chosen.push_back(e);
+      v = edge_nodes[e].first == v ? edge_nodes[e].second : edge_nodes[e].first;
+    }
+  }
+
+  std::vector<std::int64_t> integer_weights;
+  // Scratch of the per-defect searches.
+  std::vector<std::int64_t> distance;
+  std::vector<unsigned> path_edge, reached;
+  std::vector<std::pair<std::int64_t, unsigned>> frontier;
+  // Every node's shortest path to the boundary, searched once.
+  std::vector<std::int64_t> boundary_distance;
+  std::vector<unsigned> boundary_edge;
+  std::vector<unsigned> chosen;
+  std::vector<BlossomMatching::Edge> matching_edges, group_edges;
+  // Scratch of the split into independent groups, and the mates.
+  std::vector<int> group, members, local, mate;
+  BlossomMatching blossom;
+};
+
+#endif // MATCHING_DECODER_H
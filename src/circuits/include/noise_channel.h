@@ -0,0 +1,306 @@
+#ifndef NOISE_CHANNEL_H
+#define NOISE_CHANNEL_H
+
+// Compiles chi (process) matrices into sampled Kraus branches.
+//
+// A chi matrix in the Pauli basis describes
+//   rho -> sum_mn chi_mn P_m rho P_n^dag.
+// Diagonalizing chi = sum_k l_k v_k v_k^dag gives the minimal Kraus set
+// K_k = sqrt(l_k) sum_m v_k[m] P_m. compileChannel does this once per
+// matrix, drops eigenvalues below a tolerance, and optionally folds an ideal
+// gate U applied after the channel into every branch (K_k -> U K_k). The
+// stochastic unravelling then costs one small matrix application per gate:
+//
+// - If every K_k is a scaled unitary (K_k^dag K_k = w_k I), as for Pauli
+//   and depolarizing channels, the branch probabilities are the fixed w_k and
+//   are drawn from an alias table in O(1); `branches` hold K_k / sqrt(w_k),
+//   so the state needs no renormalization.
+// - Otherwise the probabilities depend on the state, p_k = tr(K_k^dag K_k
+//   rho), with rho the reduced density matrix of the target qubits;
+//   `branches` hold K_k and `effects` hold K_k^dag K_k.
+//
+// Two-qubit matrices use the basis |b_first b_second>, i.e. index
+// 2 * b_first + b_second, and Pauli index 4 * m_first + m_second.
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <vector>
+
+
+// Dense row-major dim x dim matrix.
+using ComplexMatrix = std::vector<std::complex<double>>;
+
+
+inline unsigned matrixDim(const ComplexMatrix &m) {
+  return static_cast<unsigned>(std::lround(std::sqrt(double(m.size()))));
+}
+
+inline ComplexMatrix multiply(const ComplexMatrix &a, const ComplexMatrix &b) {
+  unsigned dim = matrixDim(a);
+  ComplexMatrix c(a.size());
+  for (unsigned i = 0; i < dim; i++)
+    for (unsigned k = 0; k < dim; k++)
+      for (unsigned j = 0; j < dim; j++)
+        c[i * dim + j] += a[i * dim + k] * b[k * dim + j];
+  return c;
+}
+
+inline ComplexMatrix adjoint(const ComplexMatrix &a) {
+  unsigned dim = matrixDim(a);
+  ComplexMatrix c(a.size());
+  for (unsigned i = 0; i < dim; i++)
+    for (unsigned j = 0; j < dim; j++)
+      c[j * dim + i] = std::conj(a[i * dim + j]);
+  return c;
+}
+
+// Pauli string `index` on `num_qubits` qubits (0 = I, 1 = X, 2 = Y, 3 = Z per
+// qubit, first qubit most significant).
+inline ComplexMatrix pauliMatrix(unsigned index, unsigned num_qubits) {
+  static const std::complex<double> paulis[4][4] = {
+      {1, 0, 0, 1},
+      {0, 1, 1, 0},
+      {0, {0, -1}, {0, 1}, 0},
+      {1, 0, 0, -1}};
+  ComplexMatrix m = {1};
+  unsigned dim = 1;
+  for (unsigned q = 0; q < num_qubits; q++) {
+    const std::complex<double> *p = paulis[(index >> (2 * (num_qubits - 1 - q))) & 3];
+    ComplexMatrix next(4 * dim * dim);
+    for (unsigned i = 0; i < dim; i++)
+      for (unsigned j = 0; j < dim; j++)
+        for (unsigned a = 0; a < 2; a++)
+          for (unsigned b = 0; b < 2; b++)
+            next[(2 * i + a) * 2 * dim + 2 * j + b] = m[i * dim + j] * p[2 * a + b];
+    m.swap(next);
+    dim *= 2;
+  }
+  return m;
+}
+
+// exp(-i gamma / 2 (cos(phi) X + sin(phi) Y)), the RotationXY convention.
+inline ComplexMatrix rotationXYMatrix(double phi, double gamma) {
+  std::complex<double> c = std::cos(gamma / 2), s = std::sin(gamma / 2);
+  std::complex<double> i(0, 1);
+  return {c, -i * s * std::exp(-i * phi), -i * s * std::exp(i * phi), c};
+}
+
+
+// Eigen-decomposition of a Hermitian matrix: eigenvalues in descending order
+// and the matching orthonormal eigenvectors as the rows of `vectors`.
+// Cyclic Jacobi on the real symmetric embedding [[Re, -Im], [Im, Re]], whose
+// spectrum is that of the input with every eigenvalue doubled; one vector of
+// each (v, i v) pair is kept by Gram-Schmidt. Meant for chi matrices (at
+// most 16 x 16), not for large systems.
+inline void hermitianEigen(const ComplexMatrix &a, std::vector<double> &values,
+                           ComplexMatrix &vectors) {
+  const unsigned n = matrixDim(a), m = 2 * n;
+  std::vector<double> s(m * m), v(m * m, 0);
+  for (unsigned i = 0; i < n; i++) {
+    for (unsigned j = 0; j < n; j++) {
+      s[i * m + j] = s[(i + n) * m + j + n] = a[i * n + j].real();
+      s[(i + n) * m + j] = a[i * n + j].imag();
+      s[i * m + j + n] = -a[i * n + j].imag();
+    }
+  }
+  for (unsigned i = 0; i < m; i++)
+    v[i * m + i] = 1;
+
+  for (int sweep = 0; sweep < 100; sweep++) {
+    double off = 0;
+    for (unsigned p = 0; p < m; p++)
+      for (unsigned q = p + 1; q < m; q++)
+        off += s[p * m + q] * s[p * m + q];
+    if (off < 1e-30)
+      break;
+
+    for (unsigned p = 0; p < m; p++) {
+      for (unsigned q = p + 1; q < m; q++) {
+        double apq = s[p * m + q];
+        if (std::abs(apq) < 1e-300)
+          continue;
+        double theta = (s[q * m + q] - s[p * m + p]) / (2 * apq);
+        double t = (theta >= 0 ? 1 : -1) /
+                   (std::abs(theta) + std::sqrt(theta * theta + 1));
+        double c = 1 / std::sqrt(t * t + 1), sn = t * c;
+        for (unsigned k = 0; k < m; k++) {
+          double skp = s[k * m + p], skq = s[k * m + q];
+          s[k * m + p] = c * skp - sn * skq;
+          s[k * m + q] = sn * skp + c * skq;
+        }
+        for (unsigned k = 0; k < m; k++) {
+          double spk = s[p * m + k], sqk = s[q * m + k];
+          s[p * m + k] = c * spk - sn * sqk;
+          s[q * m + k] = sn * spk + c * sqk;
+        }
+        for (unsigned k = 0; k < m; k++) {
+          double vkp = v[k * m + p], vkq = v[k * m + q];
+          v[k * m + p] = c * vkp - sn * vkq;
+          v[k * m + q] = sn * vkp + c * vkq;
+        }
+      }
+    }
+  }
+
+  std::vector<unsigned> order(m);
+  for (unsigned i = 0; i < m; i++)
+    order[i] = i;
+  std::sort(order.begin(), order.end(), [&](unsigned x, unsigned y) {
+    return s[x * m + x] > s[y * m + y];
+  });
+
+  values.clear();
+  vectors.clear();
+  for (unsigned col : order) {
+    if (values.size() == n)
+      break;
+    std::vector<std::complex<double>> w(n);
+    for (unsigned i = 0; i < n; i++)
+      w[i] = {v[i * m + col], v[(i + n) * m + col]};
+    for (std::size_t k = 0; k < values.size(); k++) {
+      std::complex<double> overlap = 0;
+      for (unsigned i = 0; i < n; i++)
+        overlap += std::conj(vectors[k * n + i]) * w[i];
+      for (unsigned i = 0; i < n; i++)
+        w[i] -= overlap * vectors[k * n + i];
+    }
+    double norm = 0;
+    for (unsigned i = 0; i < n; i++)
+      norm += std::norm(w[i]);
+    // The partner of an accepted vector is parallel to it and cancels out.
+    if (norm < 0.5)
+      continue;
+    norm = std::sqrt(norm);
+    for (unsigned i = 0; i < n; i++)
+      vectors.push_back(w[i] / norm);
+    values.push_back(s[col * m + col]);
+  }
+}
+
+
+// Vose alias table: O(n) to build, one uniform draw and O(1) per sample.
+class AliasTable {
+public:
+  AliasTable() = default;
+  explicit AliasTable(const std::vector<double> &weights) {
+    const std::size_t n = weights.size();
+    probability.assign(n, 1);
+    alias.resize(n);
+    for (std::size_t i = 0; i < n; i++)
+      alias[i] = i;
+
+    double total = 0;
+    for (double w : weights)
+      total += w;
+    if (n == 0 || total <= 0)
+      return;
+
+    std::vector<double> scaled(n);
+    std::vector<std::size_t> small, large;
+    for (std::size_t i = 0; i < n; i++) {
+      scaled[i] = weights[i] * n / total;
+      (scaled[i] < 1 ? small : large).push_back(i);
+    }
+    while (!small.empty() && !large.empty()) {
+      std::size_t s = small.back(), l = large.back();
+      small.pop_back();
+      probability[s] = scaled[s];
+      alias[s] = l;
+      scaled[l] -= 1 - scaled[s];
+      if (scaled[l] < 1) {
+        large.pop_back();
+        small.push_back(l);
+      }
+    }
+    // Leftovers are 1 up to rounding.
+    for (std::size_t i : small)
+      probability[i] = 1;
+    for (std::size_t i : large)
+      probability[i] = 1;
+  }
+
+  std::size_t size() const { return probability.size(); }
+
+  // `uniform` in [0, 1).
+  std::size_t sample(double uniform) const {
+    double scaled = uniform * probability.size();
+    std::size_t i = std::min<std::size_t>(scaled, probability.size() - 1);
+    return scaled - i < probability[i] ? i : alias[i];
+  }
+
+private:
+  std::vector<double> probability;
+  std::vector<std::size_t> alias;
+};
+
+
+struct NoiseChannel {
+  unsigned num_qubits = 0;
+  bool mixed_unitary = true;
+  // Operator applied for each branch (see the header comment).
+  std::vector<ComplexMatrix> branches;
+  // K_k^dag K_k, only filled when !mixed_unitary.
+  std::vector<ComplexMatrix> effects;
+  // Branch weights w_k (fixed probabilities when mixed_unitary).
+  std::vector<double> weights;
+  AliasTable alias;
+};
+
+
+// `ideal`, if non-empty, is the gate applied after the channel and is folded
+// into every branch. Eigenvalues below `tolerance` are dropped.
+inline NoiseChannel compileChannel(const ComplexMatrix &chi, unsigned num_qubits,
+                                   const ComplexMatrix &ideal = {},
+                                   double tolerance = 1e-10) {
+  const unsigned basis_size = 1u << (2 * num_qubits), dim = 1u << num_qubits;
+  std::vector<ComplexMatrix> paulis;
+  for (unsigned p = 0; p < basis_size; p++)
+    paulis.push_back(pauliMatrix(p, num_qubits));
+
+  std::vector<double> values;
+  ComplexMatrix vectors;
+  hermitianEigen(chi, values, vectors);
+
+  NoiseChannel channel;
+  channel.num_qubits = num_qubits;
+  for (std::size_t k = 0; k < values.size(); k++) {
+    if (values[k] < tolerance)
+      continue;
+    ComplexMatrix kraus(dim * dim);
+    double scale = std::sqrt(values[k]);
+    for (unsigned p = 0; p < basis_size; p++)
+      for (unsigned i = 0; i < dim * dim; i++)
+        kraus[i] += scale * vectors[k * basis_size + p] * paulis[p][i];
+    if (!ideal.empty())
+      kraus = multiply(ideal, kraus);
+
+    ComplexMatrix effect = multiply(adjoint(kraus), kraus);
+    double weight = 0;
+    for (unsigned i = 0; i < dim; i++)
+      weight += effect[i * dim + i].real();
+    weight /= dim;
+
+    // Scaled unitary iff K^dag K == weight * I.
+    for (unsigned i = 0; i < dim; i++)
+      for (unsigned j = 0; j < dim; j++)
+        if (std::abs(effect[i * dim + j] - (i == j ? weight : 0.0)) > 1e-9)
+          channel.mixed_unitary = false;
+
+    channel.branches.push_back(kraus);
+    channel.effects.push_back(effect);
+    channel.weights.push_back(weight);
+  }
+
+  if (channel.mixed_unitary) {
+    for (std::size_t k = 0; k < channel.branches.size(); k++)
+      for (auto &entry : channel.branches[k])
+        entry /= std::sqrt(channel.weights[k]);
+    channel.effects.clear();
+  }
+  channel.alias = AliasTable(channel.weights);
+  return channel;
+}
+
+#endif // NOISE_CHANNEL_H
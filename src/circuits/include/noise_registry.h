@@ -0,0 +1,160 @@
+#ifndef NOISE_REGISTRY_H
+#define NOISE_REGISTRY_H
+
+// Process-wide registry of the chi (process) matrices in noise_models/.
+//
+// Every directory under noise_models/good and noise_models/bad holding a
+// qpt_real.csv / qpt_imag.csv pair is parsed once, the first time the
+// registry is used, and registered under "<set>/<directory>", e.g.
+// "good/qds_yppi2". Custom-op callbacks then fetch the matrix by handle
+// instead of re-reading the CSVs on every gate:
+//
+//   static const NoiseModel &yppi2 = NoiseModelRegistry::instance().get("good/qds_yppi2");
+//   ...
+//   return {0, 0, 0, 0, yppi2.chi, yppi2.name, 0, 0, 0, 0};
+//
+// Matrices are stored row-major in the Pauli basis, the layout expected by
+// iqsdk::IqsCustomOp, and are never modified after loading, so callbacks on
+// concurrent devices can share them.
+//
+// The registry root is NOISE_MODELS_DIR if set, otherwise the first
+// "noise_models" directory found in the working directory or one of its
+// parents, so the examples find the repository's models when run from the
+// repository or a build folder inside it. Unlike
+// iqsdk::ParseChiMatrixFromCsvFiles, it does not read the
+// "chimatrix_directory" of the platform configuration; point
+// NOISE_MODELS_DIR there to use those matrices. Look models up after main
+// starts (e.g. in a function-local static), so a missing one can be
+// reported instead of terminating during static initialization.
+
+#include <chrono>
+#include <complex>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+struct NoiseModel {
+  std::string name;
+  unsigned num_qubits;
+  // (4^num_qubits)^2 entries, row-major.
+  std::vector<std::complex<double>> chi;
+};
+
+
+class NoiseModelRegistry {
+public:
+  static const NoiseModelRegistry &instance() {
+    static const NoiseModelRegistry registry(defaultRoot());
+    return registry;
+  }
+
+  explicit NoiseModelRegistry(const std::filesystem::path &root) : root(root) {
+    auto start = std::chrono::steady_clock::now();
+    for (const char *set : {"good", "bad"}) {
+      std::filesystem::path set_path = root / set;
+      if (!std::filesystem::is_directory(set_path))
+        continue;
+      for (const auto &entry : std::filesystem::directory_iterator(set_path)) {
+        std::filesystem::path real = entry.path() / "qpt_real.csv";
+        std::filesystem::path imag = entry.path() / "qpt_imag.csv";
+        if (std::filesystem::exists(real) && std::filesystem::exists(imag))
+          add(std::string(set) + "/" + entry.path().filename().string(), real, imag);
+      }
+    }
+    load_seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+  }
+
+  // O(1) lookup; throws if `name` was not loaded.
+  const NoiseModel &get(const std::string &name) const {
+    auto it = index.find(name);
+    if (it == index.end())
+      throw std::out_of_range("noise model \"" + name + "\" not found under \"" +
+                              root.string() + "\" (set NOISE_MODELS_DIR)");
+    return *models[it->second];
+  }
+
+  bool contains(const std::string &name) const { return index.count(name); }
+  std::size_t size() const { return models.size(); }
+  double loadSeconds() const { return load_seconds; }
+
+  std::size_t memoryBytes() const {
+    std::size_t bytes = 0;
+    for (const auto &model : models)
+      bytes += sizeof(NoiseModel) + model->name.capacity() +
+               model->chi.capacity() * sizeof(std::complex<double>);
+    return bytes;
+  }
+
+  void printStats(std::ostream &out = std::cout) const {
+    out << "Loaded " << size() << " noise models in " << load_seconds * 1e3
+        << " ms (" << memoryBytes() << " bytes)" << std::endl;
+  }
+
+private:
+  static std::filesystem::path defaultRoot() {
+    if (const char *root = std::getenv("NOISE_MODELS_DIR"))
+      return root;
+    std::error_code error, missing;
+    for (std::filesystem::path folder = std::filesystem::current_path(error);
+         !error && !folder.empty(); folder = folder.parent_path()) {
+      if (std::filesystem::is_directory(folder / "noise_models", missing))
+        return folder / "noise_models";
+      if (folder == folder.parent_path())
+        break;
+    }
+    return "noise_models";
+  }
+
+  static std::vector<double> parseCsv(const std::filesystem::path &path) {
+    std::ifstream file(path);
+    std::vector<double> values;
+    std::string line, cell;
+    while (std::getline(file, line)) {
+      std::stringstream cells(line);
+      while (std::getline(cells, cell, ','))
+        values.push_back(std::stod(cell));
+    }
+    return values;
+  }
+
+  void add(const std::string &name, const std::filesystem::path &real_path,
+           const std::filesystem::path &imag_path) {
+    std::vector<double> real = parseCsv(real_path), imag = parseCsv(imag_path);
+    if (real.size() != imag.size())
+      throw std::runtime_error("noise model \"" + name + "\": real and imaginary parts differ in size");
+
+    // A chi matrix on n qubits is 4^n x 4^n.
+    unsigned num_qubits = 0;
+    for (std::size_t dim = 1; dim * dim < real.size(); dim *= 4)
+      num_qubits++;
+    std::size_t dim = std::size_t(1) << (2 * num_qubits);
+    if (num_qubits == 0 || dim * dim != real.size())
+      throw std::runtime_error("noise model \"" + name + "\" is not a 4^n x 4^n matrix");
+
+    auto model = std::make_unique<NoiseModel>();
+    model->name = name;
+    model->num_qubits = num_qubits;
+    model->chi.resize(real.size());
+    for (std::size_t i = 0; i < real.size(); i++)
+      model->chi[i] = {real[i], imag[i]};
+
+    index[name] = models.size();
+    models.push_back(std::move(model));
+  }
+
+  std::filesystem::path root;
+  std::vector<std::unique_ptr<const NoiseModel>> models;
+  std::unordered_map<std::string, std::size_t> index;
+  double load_seconds = 0;
+};
+
+#endif // NOISE_REGISTRY_H
@@ -0,0 +1,394 @@
+#ifndef NUMA_STATE_VECTOR_H
+#define NUMA_STATE_VECTOR_H
+
+// Multi-threaded state vector partitioned over NUMA nodes.
+//
+// The 2^n amplitudes are split into P = 2^g partitions of 2^(n - g)
+// amplitudes, one per ThreadPool worker. Each worker allocates nothing but
+// zeroes its own partition first, so the pages land on its node, and every
+// later gate on the partition runs on that worker: the low n - g physical
+// qubits are local to each partition, the top g are global and select the
+// partition.
+//
+// Logical qubits are mapped to physical ones. A gate that mixes amplitudes
+// across a global qubit (RXY, SwapA) first swaps that qubit with a local one
+// in an explicit exchange step: partitions p and p ^ (1 << global) trade the
+// halves where the two qubits differ, so every later gate on it is local
+// again, and the mapping is not undone. Diagonal gates (RZ, CPhase) never
+// need an exchange; on a global qubit they are a per-partition phase.
+//
+// Every job records, per worker, the bytes of the cache lines it reads and
+// writes and how long it runs, which bandwidth() aggregates per node. The
+// SIMD kernels are those of state_vector.h.
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <vector>
+
+#include "benchmark.h"
+#include "state_vector.h"
+#include "thread_pool.h"
+
+
+// Partitions hold at least 2^k_min_local_qubits amplitudes by default.
+constexpr unsigned k_min_local_qubits = 12;
+
+// Largest power of two that is at most the usable CPUs and leaves
+// k_min_local_qubits local qubits.
+inline unsigned defaultPartitions(unsigned num_qubits) {
+  const unsigned num_cpus = numUsableCpus(numaNodes());
+  unsigned partitions = 1;
+  while (2 * partitions <= num_cpus &&
+         num_qubits > k_min_local_qubits + unsigned(std::log2(partitions)))
+    partitions *= 2;
+  return partitions;
+}
+
+
+struct NodeBandwidth {
+  unsigned node; // NUMA node id
+  unsigned num_workers;
+  double bytes = 0;
+  // Sum over jobs of the slowest of the node's workers.
+  double seconds = 0;
+
+  double bytesPerSecond() const { return seconds > 0 ? bytes / seconds : 0; }
+};
+
+
+class NumaStateVector {
+public:
+  // |0...0> on `num_partitions` workers (a power of two, 0 for
+  // defaultPartitions), using `level`'s kernels.
+  explicit NumaStateVector(unsigned num_qubits, unsigned num_partitions = 0,
+                           SimdLevel level = detectSimdLevel())
+      : num_qubits(num_qubits),
+        num_partitions(num_partitions ? num_partitions : defaultPartitions(num_qubits)),
+        pool(this->num_partitions), stats(this->num_partitions) {
+    if (this->num_partitions & (this->num_partitions - 1))
+      throw std::invalid_argument("NumaStateVector: partitions must be a power of two");
+    while ((std::size_t(1) << num_global) < this->num_partitions)
+      num_global++;
+    // Two-qubit gates on two global qubits need two local ones to swap in.
+    if (num_global > 0 && num_global + 2 > num_qubits)
+      throw std::invalid_argument("NumaStateVector: too many partitions for the qubits");
+    num_local = num_qubits - num_global;
+    partition_size = std::size_t(1) << num_local;
+    while (stateVectorKernels(level).width > partition_size)
+      level = SimdLevel(int(level) - 1);
+    kernels = &stateVectorKernels(level);
+    this->level = level;
+
+    for (unsigned q = 0; q < num_qubits; q++) {
+      physical.push_back(q);
+      logical.push_back(q);
+    }
+    // Large aligned_alloc blocks are fresh mmap pages, placed on first touch.
+    for (unsigned p = 0; p < this->num_partitions; p++) {
+      re.push_back(allocate(partition_size));
+      im.push_back(allocate(partition_size));
+    }
+    run([&](unsigned p) {
+      std::memset(re[p].get(), 0, partition_size * sizeof(double));
+      std::memset(im[p].get(), 0, partition_size * sizeof(double));
+      if (p == 0)
+        re[0][0] = 1;
+      return 2.0 * partition_size * sizeof(double);
+    });
+  }
+
+  unsigned numQubits() const { return num_qubits; }
+  unsigned numPartitions() const { return num_partitions; }
+  unsigned numLocalQubits() const { return num_local; }
+  SimdLevel simdLevel() const { return level; }
+  const ThreadPool &threadPool() const { return pool; }
+
+  // Amplitude of logical basis state i.
+  std::complex<double> operator[](std::size_t i) const {
+    std::size_t index = 0;
+    for (unsigned q = 0; q < num_qubits; q++)
+      index |= (i >> q & 1) << physical[q];
+    return {re[index >> num_local][index & (partition_size - 1)],
+            im[index >> num_local][index & (partition_size - 1)]};
+  }
+
+  // 2x2 unitary `m` (row-major) on qubit q.
+  void applyMatrix(unsigned q, const std::complex<double> m[4]) {
+    const unsigned bit = localize(q, num_qubits);
+    run([&](unsigned p) {
+      kernels->matrix1(re[p].get(), im[p].get(), partition_size, bit, m);
+      return sweepBytes();
+    });
+  }
+
+  // exp(-i gamma / 2 (cos(phi) X + sin(phi) Y))
+  void applyRotationXY(unsigned q, double phi, double gamma) {
+    const std::complex<double> i(0, 1);
+    const double c = std::cos(gamma / 2), s = std::sin(gamma / 2);
+    const std::complex<double> m[4] = {c, -i * s * std::exp(-i * phi),
+                                       -i * s * std::exp(i * phi), c};
+    applyMatrix(q, m);
+  }
+
+  // diag(exp(-i angle / 2), exp(i angle / 2))
+  void applyRotationZ(unsigned q, double angle) {
+    const std::complex<double> d0 = std::polar(1.0, -angle / 2), d1 = std::conj(d0);
+    const unsigned bit = physical[q];
+    run([&](unsigned p) {
+      if (bit < num_local)
+        kernels->diagonal1(re[p].get(), im[p].get(), partition_size, bit, d0, d1);
+      else
+        scale(p, globalBit(p, bit) ? d1 : d0);
+      return sweepBytes();
+    });
+  }
+
+  // |11> gets exp(-i angle), as ApplyCPhaseRotation(ctrl, target, -angle).
+  void applyCPhase(unsigned ctrl, unsigned target, double angle) {
+    const std::complex<double> phase = std::polar(1.0, -angle);
+    unsigned bit1 = physical[ctrl], bit2 = physical[target];
+    if (bit1 > bit2)
+      std::swap(bit1, bit2);
+    run([&](unsigned p) {
+      if (bit2 < num_local) {
+        kernels->phase2(re[p].get(), im[p].get(), partition_size, bit1, bit2, phase);
+        return sweepBytes(bit1, bit2);
+      }
+      if (!globalBit(p, bit2))
+        return 0.0;
+      if (bit1 < num_local) {
+        kernels->diagonal1(re[p].get(), im[p].get(), partition_size, bit1, 1, phase);
+        return sweepBytes();
+      }
+      if (!globalBit(p, bit1))
+        return 0.0;
+      scale(p, phase);
+      return sweepBytes();
+    });
+  }
+
+  // The ISwapRotation matrix CustomBackend builds for SwapA.
+  void applySwapA(unsigned q1, unsigned q2, double angle) {
+    const std::complex<double> diagonal = {0.5 * (1.0 + std::cos(angle)), 0.5 * std::sin(angle)};
+    const std::complex<double> off = {0.5 * (1.0 - std::cos(angle)), -0.5 * std::sin(angle)};
+    const unsigned bit1 = localize(q1, num_qubits);
+    const unsigned bit2 = localize(q2, bit1);
+    run([&](unsigned p) {
+      kernels->swap_a(re[p].get(), im[p].get(), partition_size, bit1, bit2, diagonal, off);
+      return sweepBytes();
+    });
+  }
+
+  // Probability of measuring q in |1>.
+  double getProbability(unsigned q) {
+    const unsigned bit = physical[q];
+    std::vector<Padded> sums(num_partitions);
+    run([&](unsigned p) {
+      const double *x = re[p].get(), *y = im[p].get();
+      double sum = 0;
+      if (bit >= num_local) {
+        if (globalBit(p, bit))
+          for (std::size_t i = 0; i < partition_size; i++)
+            sum += x[i] * x[i] + y[i] * y[i];
+      } else {
+        const std::size_t mask = std::size_t(1) << bit;
+        for (std::size_t i = 0; i < partition_size; i++)
+          sum += i & mask ? x[i] * x[i] + y[i] * y[i] : 0;
+      }
+      sums[p].value = sum;
+      return bit >= num_local && !globalBit(p, bit) ? 0.0 : sweepBytes() / 2;
+    });
+    double total = 0;
+    for (const Padded &sum : sums)
+      total += sum.value;
+    return total;
+  }
+
+  // Projects q onto |value>, which must have probability `probability`, and
+  // renormalizes.
+  void collapse(unsigned q, bool value, double probability) {
+    const unsigned bit = physical[q];
+    const double norm = 1 / std::sqrt(probability);
+    run([&](unsigned p) {
+      double *x = re[p].get(), *y = im[p].get();
+      if (bit >= num_local) {
+        if (globalBit(p, bit) == value) {
+          scale(p, norm);
+        } else {
+          std::memset(x, 0, partition_size * sizeof(double));
+          std::memset(y, 0, partition_size * sizeof(double));
+        }
+        return sweepBytes();
+      }
+      const std::size_t mask = std::size_t(1) << bit;
+      for (std::size_t i = 0; i < partition_size; i++) {
+        bool keep = bool(i & mask) == value;
+        x[i] = keep ? x[i] * norm : 0;
+        y[i] = keep ? y[i] * norm : 0;
+      }
+      return sweepBytes();
+    });
+  }
+
+  // Bytes moved and time spent per node since construction or the last
+  // resetBandwidth().
+  std::vector<NodeBandwidth> bandwidth() const {
+    std::vector<NodeBandwidth> nodes;
+    for (unsigned n = 0; n < pool.numNodes(); n++)
+      nodes.push_back({pool.nodes()[n].id, 0});
+    for (unsigned p = 0; p < num_partitions; p++) {
+      NodeBandwidth &node = nodes[pool.nodeOf(p)];
+      node.num_workers++;
+      node.bytes += stats[p].bytes;
+    }
+    for (unsigned n = 0; n < nodes.size(); n++)
+      nodes[n].seconds = node_seconds.size() > n ? node_seconds[n] : 0;
+    return nodes;
+  }
+
+  void resetBandwidth() {
+    for (Stats &s : stats)
+      s = Stats();
+    node_seconds.assign(pool.numNodes(), 0);
+  }
+
+  // Per-node streaming rate of a read-modify-write pass over every
+  // partition, best of `repetitions`: the ceiling for bandwidth(). Leaves
+  // the state unchanged and the counters reset.
+  std::vector<NodeBandwidth> measurePeakBandwidth(unsigned repetitions = 3) {
+    std::vector<NodeBandwidth> best;
+    for (unsigned r = 0; r < repetitions; r++) {
+      resetBandwidth();
+      run([&](unsigned p) {
+        scale(p, 1.0);
+        return sweepBytes();
+      });
+      std::vector<NodeBandwidth> nodes = bandwidth();
+      if (best.empty())
+        best = nodes;
+      for (std::size_t n = 0; n < nodes.size(); n++)
+        if (nodes[n].bytesPerSecond() > best[n].bytesPerSecond())
+          best[n] = nodes[n];
+    }
+    resetBandwidth();
+    return best;
+  }
+
+private:
+  struct Free {
+    void operator()(double *p) const { std::free(p); }
+  };
+  using Buffer = std::unique_ptr<double[], Free>;
+
+  struct alignas(64) Stats {
+    double bytes = 0;
+    double last_seconds = 0; // of the latest job
+  };
+  struct alignas(64) Padded {
+    double value = 0;
+  };
+
+  static Buffer allocate(std::size_t size) {
+    std::size_t bytes = std::max<std::size_t>(size * sizeof(double), 64);
+    double *p = static_cast<double *>(std::aligned_alloc(64, bytes));
+    if (!p)
+      throw std::bad_alloc();
+    return Buffer(p);
+  }
+
+  // Runs job(p) on the worker owning each partition p; job returns the bytes
+  // it moved.
+  template <typename Job> void run(Job job) {
+    pool.run([&](unsigned p) {
+      Stopwatch stopwatch;
+      double bytes = job(p);
+      stats[p].bytes += bytes;
+      stats[p].last_seconds = stopwatch.seconds();
+    });
+    node_seconds.resize(pool.numNodes(), 0);
+    std::vector<double> slowest(pool.numNodes(), 0);
+    for (unsigned p = 0; p < num_partitions; p++)
+      slowest[pool.nodeOf(p)] = std::max(slowest[pool.nodeOf(p)], stats[p].last_seconds);
+    for (unsigned n = 0; n < slowest.size(); n++)
+      node_seconds[n] += slowest[n];
+  }
+
+  bool globalBit(unsigned p, unsigned bit) const { return p >> (bit - num_local) & 1; }
+
+  // Read and write of both arrays of a partition, or of the cache lines
+  // holding the amplitudes with `bit1` and `bit2` set (a 64-byte line holds
+  // eight amplitudes, so lower bits select nothing).
+  double sweepBytes(unsigned bit1 = 0, unsigned bit2 = 0) const {
+    double bytes = 4.0 * partition_size * sizeof(double);
+    for (unsigned bit : {bit1, bit2})
+      if (bit >= 3)
+        bytes /= 2;
+    return bytes;
+  }
+
+  void scale(unsigned p, std::complex<double> c) {
+    kernels->diagonal1(re[p].get(), im[p].get(), partition_size, 0, c, c);
+  }
+
+  // Physical bit of q after making it local, swapping it with the highest
+  // local bit other than `keep` if it is global.
+  unsigned localize(unsigned q, unsigned keep) {
+    const unsigned global = physical[q];
+    if (global < num_local)
+      return global;
+    unsigned local = num_local - 1;
+    if (local == keep)
+      local--;
+    exchange(global, local);
+    std::swap(logical[global], logical[local]);
+    physical[logical[global]] = global;
+    physical[logical[local]] = local;
+    return local;
+  }
+
+  // Swaps physical bits `global` and `local`: partition p (global bit clear)
+  // trades its amplitudes with the local bit set for those of partition
+  // p | global with it clear. Of these partition_size / 2 pairs, each
+  // partner swaps half.
+  void exchange(unsigned global, unsigned local) {
+    const unsigned partner_bit = 1u << (global - num_local);
+    const std::size_t block = std::size_t(1) << local;
+    const std::size_t num_pairs = partition_size / 2;
+    run([&](unsigned p) {
+      const unsigned low = p & ~partner_bit, high = p | partner_bit;
+      const std::size_t begin = p == low ? 0 : num_pairs / 2;
+      const std::size_t end = p == low ? num_pairs / 2 : num_pairs;
+      // Pair e is offset e % block in block e / block of either side.
+      for (std::size_t e = begin; e < end;) {
+        const std::size_t offset = e % block, length = std::min(block - offset, end - e);
+        const std::size_t theirs = 2 * (e - offset) + offset, mine = theirs + block;
+        std::swap_ranges(re[low].get() + mine, re[low].get() + mine + length, re[high].get() + theirs);
+        std::swap_ranges(im[low].get() + mine, im[low].get() + mine + length, im[high].get() + theirs);
+        e += length;
+      }
+      // Reads and writes both sides of every swapped pair.
+      return 8.0 * sizeof(double) * (end - begin);
+    });
+  }
+
+  unsigned num_qubits, num_partitions, num_global = 0, num_local;
+  std::size_t partition_size;
+  SimdLevel level;
+  const StateVectorKernels *kernels;
+  ThreadPool pool;
+  std::vector<Stats> stats;
+  std::vector<double> node_seconds;
+  // physical[q] is the bit of logical qubit q; logical is its inverse.
+  std::vector<unsigned> physical, logical;
+  std::vector<Buffer> re, im;
+};
+
+#endif // NUMA_STATE_VECTOR_H
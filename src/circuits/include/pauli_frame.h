@@ -0,0 +1,357 @@
+#ifndef PAULI_FRAME_H
+#define PAULI_FRAME_H
+
+// Pauli-frame sampling of noisy Clifford circuits.
+//
+// Running a full tableau simulation per shot costs O(n) per gate and O(n^2)
+// per measurement, every shot. Pauli-frame sampling runs the tableau once
+// instead: CliffordRecorder is a custom backend that simulates the circuit
+// with a StabilizerTableau, keeps one noiseless reference sample (random
+// outcomes taken as 0), and records the gates as a CliffordCircuit.
+// PauliFrameSampler then gets every shot as the reference sample XOR the
+// effect of a Pauli error frame propagated through that circuit. A frame is
+// two bits per qubit, and 64 shots share a word, so a gate costs a few word
+// operations per 64 shots no matter how large the circuit is.
+//
+// Random measurement outcomes come out right because each frame picks up a
+// random Z on every qubit right after it is prepared or measured. Z is a
+// stabilizer of the qubit there, so this changes nothing, until a gate like
+// H turns it into an X that flips a later measurement half the time.
+//
+// Only Clifford angles are accepted, see stabilizer_tableau.h; anything
+// else throws std::invalid_argument.
+//
+// FrameNoise is the Pauli error model of the Clifford simulator, and
+// frameNoise() builds it from the same iqsdk::ErrorRates through their rate
+// getters: a Pauli channel with X, Y and Z probabilities after each prep,
+// RXY and RZ, and before each measurement, where X and Y flip the qubit and
+// so the outcome; and the Pauli-twirled non-ideal gate of iqsdk::ErrSpec2Q
+// after each CPhase and SwapA. The time-dependent idle error of
+// iqsdk::ErrSpecIdle is not modelled.
+
+#include <quantum_clifford_simulator_backend.h>
+#include <quantum_custom_backend.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "shot_matrix.h"
+#include "stabilizer_tableau.h"
+
+
+struct PauliRates {
+  double x = 0, y = 0, z = 0;
+
+  double total() const { return x + y + z; }
+};
+
+// The twirled non-ideal CZ of iqsdk::ErrSpec2Q: ZI and IZ with probability
+// zi each, XX and YY with xx each, XY and YX with xy each, and ZZ with zz.
+struct PauliRates2Q {
+  double zi = 0, xx = 0, xy = 0, zz = 0;
+
+  double total() const { return 2 * (zi + xx + xy) + zz; }
+};
+
+struct FrameNoise {
+  PauliRates prep, meas, xyrot, zrot;
+  PauliRates2Q cz, swap;
+};
+
+inline PauliRates pauliRates(const iqsdk::ErrSpec1Q &spec) {
+  return {spec.getXRate(), spec.getYRate(), spec.getZRate()};
+}
+
+inline PauliRates2Q pauliRates(const iqsdk::ErrSpec2Q &spec) {
+  return {spec.getZRate(), spec.getXXRate(), spec.getXYRate(), spec.getZZRate()};
+}
+
+// The frame model of `rates`, gate for gate the channels the Clifford
+// simulator applies with use_errors.
+inline FrameNoise frameNoise(const iqsdk::ErrorRates &rates) {
+  return {pauliRates(rates.prep), pauliRates(rates.meas), pauliRates(rates.xyrot),
+          pauliRates(rates.zrot), pauliRates(rates.cz), pauliRates(rates.swap)};
+}
+
+
+enum class FrameOp : std::uint8_t {
+  H,
+  S, // Also S^3; S^2 is a Pauli, which frames ignore.
+  CZ,
+  Swap,
+  Prep,
+  Measure, // Reads the next entry of the measurement record.
+  Pauli,   // Pauli channel with `rates`.
+  Pauli2,  // Two-qubit Pauli channel with `rates_2q`.
+};
+
+struct FrameInstruction {
+  FrameOp op;
+  unsigned a, b;
+  // Pauli: the channel. Measure: the channel before readout.
+  PauliRates rates;
+  PauliRates2Q rates_2q;
+};
+
+struct CliffordCircuit {
+  unsigned num_qubits = 0;
+  std::vector<FrameInstruction> instructions;
+  // Noiseless outcome of each measurement, in order.
+  std::vector<bool> reference;
+
+  unsigned numMeasurements() const { return reference.size(); }
+};
+
+
+// Records a kernel for PauliFrameSampler. MeasZ returns the reference
+// outcome, so classical control in the kernel follows the noiseless run.
+class CliffordRecorder : public iqsdk::CustomInterface {
+public:
+  StabilizerTableau tableau;
+  CliffordCircuit circuit;
+  FrameNoise noise;
+
+  explicit CliffordRecorder(int num_qubits, FrameNoise noise = {})
+      : tableau(num_qubits), noise(noise) {
+    circuit.num_qubits = num_qubits;
+  }
+
+  // Starts a new recording from |0...0>.
+  void clear() {
+    tableau.reset();
+    circuit.instructions.clear();
+    circuit.reference.clear();
+  }
+
+  // The tableau checks the angles; the frames see the same gates as H and
+  // odd powers of S, see StabilizerTableau::applyRotationXY.
+  void RXY(qbit q, double phi, double gamma) {
+    tableau.applyRotationXY(q, phi, gamma);
+    const unsigned turns_phi = quarterTurns(phi), turns_gamma = quarterTurns(gamma);
+    if (turns_gamma != 0) {
+      recordRotateZ(q, 4 - turns_phi);
+      record(FrameOp::H, q);
+      recordRotateZ(q, turns_gamma);
+      record(FrameOp::H, q);
+      recordRotateZ(q, turns_phi);
+    }
+    pauliNoise(q, noise.xyrot);
+  }
+
+  void RZ(qbit q, double angle) {
+    tableau.applyRotationZ(q, angle);
+    recordRotateZ(q, quarterTurns(angle));
+    pauliNoise(q, noise.zrot);
+  }
+
+  void CPhase(qbit ctrl, qbit target, double angle) {
+    tableau.applyCPhase(ctrl, target, angle);
+    if (quarterTurns(angle) == 2)
+      record(FrameOp::CZ, ctrl, target);
+    pauliNoise(ctrl, target, noise.cz);
+  }
+
+  void SwapA(qbit q1, qbit q2, double angle) {
+    tableau.applySwapA(q1, q2, angle);
+    if (quarterTurns(angle) == 2)
+      record(FrameOp::Swap, q1, q2);
+    pauliNoise(q1, q2, noise.swap);
+  }
+
+  void PrepZ(qbit q) {
+    tableau.reset(q, false);
+    record(FrameOp::Prep, q);
+    pauliNoise(q, noise.prep);
+  }
+
+  cbit MeasZ(qbit q) {
+    const bool outcome = tableau.measure(q, false);
+    circuit.instructions.push_back({FrameOp::Measure, q, 0, noise.meas, {}});
+    circuit.reference.push_back(outcome);
+    return outcome;
+  }
+
+private:
+  void record(FrameOp op, unsigned a, unsigned b = 0) {
+    circuit.instructions.push_back({op, a, b, {}, {}});
+  }
+
+  // S^turns; S^2 is a Pauli and S^3 acts on frames as S does.
+  void recordRotateZ(unsigned q, unsigned turns) {
+    if (turns % 2)
+      record(FrameOp::S, q);
+  }
+
+  void pauliNoise(unsigned q, const PauliRates &rates) {
+    if (rates.total() > 0)
+      circuit.instructions.push_back({FrameOp::Pauli, q, 0, rates, {}});
+  }
+
+  void pauliNoise(unsigned a, unsigned b, const PauliRates2Q &rates) {
+    if (rates.total() > 0)
+      circuit.instructions.push_back({FrameOp::Pauli2, a, b, {}, rates});
+  }
+};
+
+
+// Samples shots of a recorded circuit, k_frame_words * 64 at a time.
+class PauliFrameSampler {
+public:
+  static constexpr std::size_t k_frame_words = 16;
+
+  explicit PauliFrameSampler(const CliffordCircuit &circuit, std::uint64_t seed = 0)
+      : circuit(circuit), rng(seed), x(circuit.num_qubits * k_frame_words),
+        z(circuit.num_qubits * k_frame_words),
+        record(circuit.numMeasurements() * k_frame_words) {}
+
+  // `num_shots` rows with one bit per measurement, in recording order.
+  ShotMatrix sample(std::size_t num_shots) {
+    ShotMatrix shots;
+    sample(num_shots, shots);
+    return shots;
+  }
+
+  void sample(std::size_t num_shots, ShotMatrix &shots) {
+    shots.reset(num_shots, circuit.numMeasurements());
+    const std::size_t batch = k_frame_words * 64;
+    for (std::size_t first = 0; first < num_shots; first += batch) {
+      runBatch();
+      const std::size_t count = std::min(batch, num_shots - first);
+      for (unsigned m = 0; m < circuit.numMeasurements(); m++) {
+        const std::uint64_t flip = circuit.reference[m] ? ~std::uint64_t(0) : 0;
+        for (std::size_t w = 0; w * 64 < count; w++) {
+          std::uint64_t bits = record[m * k_frame_words + w] ^ flip;
+          while (bits) {
+            const std::size_t shot = w * 64 + __builtin_ctzll(bits);
+            bits &= bits - 1;
+            if (shot < count)
+              shots.set(first + shot, m);
+          }
+        }
+      }
+    }
+  }
+
+private:
+  // Propagates one batch of frames; record then holds, per measurement,
+  // which shots differ from the reference.
+  void runBatch() {
+    std::fill(x.begin(), x.end(), 0);
+    for (unsigned q = 0; q < circuit.num_qubits; q++)
+      randomize(z.data() + q * k_frame_words);
+
+    unsigned m = 0;
+    for (const FrameInstruction &in : circuit.instructions) {
+      std::uint64_t *xa = x.data() + in.a * k_frame_words, *za = z.data() + in.a * k_frame_words;
+      std::uint64_t *xb = x.data() + in.b * k_frame_words, *zb = z.data() + in.b * k_frame_words;
+      switch (in.op) {
+      case FrameOp::H:
+        for (std::size_t w = 0; w < k_frame_words; w++)
+          std::swap(xa[w], za[w]);
+        break;
+      case FrameOp::S:
+        for (std::size_t w = 0; w < k_frame_words; w++)
+          za[w] ^= xa[w];
+        break;
+      case FrameOp::CZ:
+        for (std::size_t w = 0; w < k_frame_words; w++) {
+          za[w] ^= xb[w];
+          zb[w] ^= xa[w];
+        }
+        break;
+      case FrameOp::Swap:
+        for (std::size_t w = 0; w < k_frame_words; w++) {
+          std::swap(xa[w], xb[w]);
+          std::swap(za[w], zb[w]);
+        }
+        break;
+      case FrameOp::Prep:
+        std::fill(xa, xa + k_frame_words, 0);
+        randomize(za);
+        break;
+      case FrameOp::Measure:
+        // The error acts on the qubit before it is read. Its Z part is
+        // dropped, as za is randomized below anyway.
+        forEachHit(in.rates.x + in.rates.y, [&](std::size_t lane) { flipLane(xa, lane); });
+        std::copy(xa, xa + k_frame_words, record.data() + m++ * k_frame_words);
+        randomize(za);
+        break;
+      case FrameOp::Pauli: {
+        const double total = in.rates.total();
+        forEachHit(total, [&](std::size_t lane) {
+          const double u = uniform(rng) * total;
+          if (u < in.rates.x + in.rates.y)
+            flipLane(xa, lane);
+          if (u >= in.rates.x)
+            flipLane(za, lane);
+        });
+        break;
+      }
+      case FrameOp::Pauli2: {
+        const PauliRates2Q &rates = in.rates_2q;
+        // Bits 0-1 the Pauli on a, bits 2-3 on b, as x + 2 z: ZI, IZ, XX,
+        // YY, XY, YX, ZZ.
+        static constexpr unsigned paulis[7] = {2, 8, 5, 15, 13, 7, 10};
+        const double weights[7] = {rates.zi, rates.zi, rates.xx, rates.xx,
+                                   rates.xy, rates.xy, rates.zz};
+        const double total = rates.total();
+        forEachHit(total, [&](std::size_t lane) {
+          double u = uniform(rng) * total;
+          unsigned k = 0;
+          while (k < 6 && u >= weights[k])
+            u -= weights[k++];
+          if (paulis[k] & 1)
+            flipLane(xa, lane);
+          if (paulis[k] & 2)
+            flipLane(za, lane);
+          if (paulis[k] & 4)
+            flipLane(xb, lane);
+          if (paulis[k] & 8)
+            flipLane(zb, lane);
+        });
+        break;
+      }
+      }
+    }
+  }
+
+  void randomize(std::uint64_t *words) {
+    for (std::size_t w = 0; w < k_frame_words; w++)
+      words[w] = rng();
+  }
+
+  static void flipLane(std::uint64_t *words, std::size_t lane) {
+    words[lane / 64] ^= std::uint64_t(1) << (lane % 64);
+  }
+
+  // Calls f on each lane of the batch independently with probability p,
+  // skipping geometrically between hits so sparse noise costs per hit.
+  template <typename F> void forEachHit(double p, F f) {
+    const std::size_t lanes = k_frame_words * 64;
+    if (p <= 0)
+      return;
+    if (p >= 1) {
+      for (std::size_t lane = 0; lane < lanes; lane++)
+        f(lane);
+      return;
+    }
+    std::geometric_distribution<std::size_t> gap(p);
+    for (std::size_t lane = gap(rng); lane < lanes; lane += 1 + gap(rng))
+      f(lane);
+  }
+
+  // A copy, small next to the frames, so the recorder can be cleared or
+  // reused while this samples.
+  const CliffordCircuit circuit;
+  std::mt19937_64 rng;
+  std::uniform_real_distribution<double> uniform{0, 1};
+  std::vector<std::uint64_t> x, z, record;
+};
+
+#endif // PAULI_FRAME_H
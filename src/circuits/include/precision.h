@@ -0,0 +1,84 @@
+#ifndef PRECISION_H
+#define PRECISION_H
+
+// Precision of an IQS state vector in a custom backend.
+//
+// iqs::QubitRegister<ComplexSP> stores complex<float> amplitudes, which
+// halves the memory and the bytes each gate moves compared with ComplexDP.
+// Single precision leaves norms and probabilities to IQS's own OpenMP
+// reductions; Mixed keeps the float storage but accumulates those sums in
+// double, also as OpenMP reductions. How much either loses against double
+// depends on IQS's reduction order and thread count, so it is measured
+// (precision_benchmark.cpp) rather than quoted here. The helpers below take
+// the register of either type and a flag for double accumulation. The
+// register must not be distributed, so LocalSize() is the whole state, and
+// its qubits must not be permuted, so qubit q is bit q of the index.
+
+#include <qureg.hpp>
+
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+
+
+enum class Precision {
+  Double, // ComplexDP
+  Single, // ComplexSP, sums by IQS
+  Mixed,  // ComplexSP, sums in double
+};
+
+inline const char *precisionName(Precision precision) {
+  switch (precision) {
+  case Precision::Double:
+    return "double";
+  case Precision::Single:
+    return "single";
+  default:
+    return "mixed";
+  }
+}
+
+inline Precision parsePrecision(const std::string &name) {
+  for (Precision precision : {Precision::Double, Precision::Single, Precision::Mixed})
+    if (name == precisionName(precision))
+      return precision;
+  throw std::invalid_argument("Unknown precision " + name + " (double, single or mixed)");
+}
+
+
+// Probability of measuring q in |1>.
+template <typename Type>
+double qubitProbability(iqs::QubitRegister<Type> &psi, unsigned q, bool accumulate_in_double) {
+  if (!accumulate_in_double)
+    return psi.GetProbability(q);
+  const std::size_t bit = std::size_t(1) << q;
+  const std::ptrdiff_t size = psi.LocalSize();
+  double sum = 0;
+#pragma omp parallel for reduction(+ : sum)
+  for (std::ptrdiff_t i = 0; i < size; i++)
+    if (i & bit)
+      sum += std::norm(std::complex<double>(psi[i]));
+  return sum;
+}
+
+// Rescales psi to unit norm.
+template <typename Type>
+void normalizeState(iqs::QubitRegister<Type> &psi, bool accumulate_in_double) {
+  if (!accumulate_in_double) {
+    psi.Normalize();
+    return;
+  }
+  const std::ptrdiff_t size = psi.LocalSize();
+  double norm = 0;
+#pragma omp parallel for reduction(+ : norm)
+  for (std::ptrdiff_t i = 0; i < size; i++)
+    norm += std::norm(std::complex<double>(psi[i]));
+  const typename Type::value_type scale = 1 / std::sqrt(norm);
+#pragma omp parallel for
+  for (std::ptrdiff_t i = 0; i < size; i++)
+    psi[i] *= scale;
+}
+
+#endif // PRECISION_H
@@ -0,0 +1,190 @@
+#ifndef RESULT_SINK_H
+#define RESULT_SINK_H
+
+// Destinations for per-shot measurement results.
+//
+// A circuit writes each shot with `put(qubit, value)` followed by
+// `endShot()`; the sink decides how it is stored:
+//
+// - CsvResultSink keeps the `qubit_0,...,qubit_N` text layout that
+//   results/*/correlation*.csv have always had, formatted into a line buffer
+//   instead of one `ofstream <<` per cbit.
+// - ColumnarResultSink writes the packed binary layout below, which
+//   results.py memory-maps with numpy instead of parsing text.
+//
+// Columnar layout (all integers little-endian):
+//   ColumnarHeader                       128 bytes
+//   chunk 0: column 0 .. column N-1      N * chunk_shots / 8 bytes
+//   chunk 1: ...
+// Every chunk holds `chunk_shots` shots (a multiple of 64) as one bit column
+// per qubit: shot `s` of the chunk is bit `s % 64` of word `s / 64` of the
+// column. The last chunk is zero-padded and `num_shots` says how many shots
+// are valid, so the file is a plain (num_chunks, N, chunk_shots / 64) uint64
+// array after the header.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+struct ResultInfo {
+  unsigned num_qubits;
+  std::uint64_t seed;
+  // Free-form description of the noise model, truncated to fit the header.
+  std::string noise_config;
+};
+
+
+class ResultSink {
+public:
+  virtual ~ResultSink() = default;
+
+  virtual bool isOpen() const = 0;
+  virtual void put(unsigned qubit, bool value) = 0;
+  virtual void endShot() = 0;
+  // Flushes everything; called by the destructor if not called explicitly.
+  virtual void close() = 0;
+};
+
+
+class CsvResultSink : public ResultSink {
+public:
+  CsvResultSink(const std::string &path, const ResultInfo &info)
+      : file(std::fopen(path.c_str(), "w")),
+        line(std::max(1u, 2 * info.num_qubits), ',') {
+    if (!file)
+      return;
+    line.back() = '\n';
+
+    std::string header;
+    for (unsigned i = 0; i < info.num_qubits; i++)
+      header += (i ? ",qubit_" : "qubit_") + std::to_string(i);
+    header += '\n';
+    buffer = header;
+  }
+  ~CsvResultSink() { close(); }
+
+  bool isOpen() const override { return file != nullptr; }
+
+  void put(unsigned qubit, bool value) override {
+    line[2 * qubit] = value ? '1' : '0';
+  }
+
+  void endShot() override {
+    buffer += line;
+    if (buffer.size() >= k_flush_bytes)
+      flush();
+  }
+
+  void close() override {
+    if (!file)
+      return;
+    flush();
+    std::fclose(file);
+    file = nullptr;
+  }
+
+private:
+  static constexpr std::size_t k_flush_bytes = 1 << 20;
+
+  void flush() {
+    std::fwrite(buffer.data(), 1, buffer.size(), file);
+    buffer.clear();
+  }
+
+  std::FILE *file;
+  std::string line, buffer;
+};
+
+
+struct ColumnarHeader {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t num_qubits;
+  std::uint64_t seed;
+  std::uint64_t chunk_shots;
+  std::uint64_t num_shots;
+  char noise_config[88];
+};
+static_assert(sizeof(ColumnarHeader) == 128, "results.py reads a 128 byte header");
+
+
+class ColumnarResultSink : public ResultSink {
+public:
+  static constexpr char k_magic[8] = "QBSHOTS";
+  static constexpr std::uint32_t k_version = 1;
+
+  ColumnarResultSink(const std::string &path, const ResultInfo &info,
+                     std::uint64_t chunk_shots = 4096)
+      : file(std::fopen(path.c_str(), "wb")) {
+    header = {};
+    std::memcpy(header.magic, k_magic, sizeof(k_magic));
+    header.version = k_version;
+    header.num_qubits = info.num_qubits;
+    header.seed = info.seed;
+    header.chunk_shots = std::max<std::uint64_t>(64, (chunk_shots + 63) / 64 * 64);
+    std::strncpy(header.noise_config, info.noise_config.c_str(),
+                 sizeof(header.noise_config) - 1);
+
+    words_per_column = header.chunk_shots / 64;
+    chunk.assign(std::size_t(header.num_qubits) * words_per_column, 0);
+    if (file)
+      std::fwrite(&header, sizeof(header), 1, file);
+  }
+  ~ColumnarResultSink() { close(); }
+
+  bool isOpen() const override { return file != nullptr; }
+
+  void put(unsigned qubit, bool value) override {
+    if (value)
+      chunk[qubit * words_per_column + shot_in_chunk / 64] |=
+          std::uint64_t(1) << (shot_in_chunk % 64);
+  }
+
+  void endShot() override {
+    header.num_shots++;
+    if (++shot_in_chunk == header.chunk_shots)
+      writeChunk();
+  }
+
+  void close() override {
+    if (!file)
+      return;
+    if (shot_in_chunk)
+      writeChunk();
+    // The shot count is only known now; patch it into the header.
+    std::fseek(file, 0, SEEK_SET);
+    std::fwrite(&header, sizeof(header), 1, file);
+    std::fclose(file);
+    file = nullptr;
+  }
+
+private:
+  void writeChunk() {
+    std::fwrite(chunk.data(), sizeof(std::uint64_t), chunk.size(), file);
+    std::fill(chunk.begin(), chunk.end(), 0);
+    shot_in_chunk = 0;
+  }
+
+  std::FILE *file;
+  ColumnarHeader header;
+  std::uint64_t words_per_column, shot_in_chunk = 0;
+  std::vector<std::uint64_t> chunk;
+};
+
+
+// Picks the backend from the extension: ".qbc" is columnar, anything else CSV.
+inline std::unique_ptr<ResultSink> openResultSink(const std::string &path,
+                                                  const ResultInfo &info) {
+  const std::string columnar = ".qbc";
+  if (path.size() >= columnar.size() &&
+      path.compare(path.size() - columnar.size(), columnar.size(), columnar) == 0)
+    return std::make_unique<ColumnarResultSink>(path, info);
+  return std::make_unique<CsvResultSink>(path, info);
+}
+
+#endif // RESULT_SINK_H
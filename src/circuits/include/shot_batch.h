@@ -0,0 +1,171 @@
+#ifndef SHOT_BATCH_H
+#define SHOT_BATCH_H
+
+// Native multi-shot runner for measured quantum kernels.
+//
+// A circuit registers each measured kernel together with the cbits it writes.
+// `shotBatchRun` then runs the kernel `num_shots` times on the device that is
+// currently ready and packs every shot into a ShotMatrix row (bit `i` of the
+// shot is bit `i % 64` of word `i / 64`). The C entry points at the bottom
+// are what `SDKManager.run_batch` in run.py calls through ctypes, so a whole
+// sweep point costs one Python -> C++ round trip instead of one per shot.
+//
+// A kernel family covers every size of one circuit: asking for
+// "<family>_<size>" the first time builds that kernel through the family's
+// builder (e.g. from a runtime gate sequence, see ghz.cpp) and caches it
+// under its full name.
+//
+// Every circuit in this repo is a single translation unit, so this header is
+// meant to be included exactly once per program.
+
+#include <clang/Quantum/quintrinsics.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "shot_matrix.h"
+
+
+struct ShotKernel {
+  std::function<void()> run;
+  cbit *result;
+  unsigned num_cbits;
+};
+
+// Fills in the kernel of the given size, or returns false if the family
+// does not support it.
+using ShotKernelBuilder = bool (*)(unsigned size, ShotKernel &kernel);
+
+
+class ShotBatch {
+public:
+  static ShotBatch &instance() {
+    static ShotBatch batch;
+    return batch;
+  }
+
+  void registerKernel(const std::string &name, std::function<void()> run,
+                      cbit *result, unsigned num_cbits) {
+    kernels[name] = {std::move(run), result, num_cbits};
+  }
+
+  void registerFamily(const std::string &name, ShotKernelBuilder build) {
+    families[name] = build;
+  }
+
+  // Runs `name` `num_shots` times. The device must already be ready and
+  // synchronous, since the cbits are read back right after every call.
+  bool run(const std::string &name, unsigned num_shots) {
+    const ShotKernel *found = find(name);
+    if (!found)
+      return false;
+    const ShotKernel &kernel = *found;
+
+    shots.reset(num_shots, kernel.num_cbits);
+    for (unsigned shot = 0; shot < num_shots; shot++) {
+      kernel.run();
+
+      for (unsigned i = 0; i < kernel.num_cbits; i++) {
+        if (kernel.result[i])
+          shots.set(shot, i);
+      }
+    }
+    return true;
+  }
+
+  // Shots of the last run; overwritten by the next one.
+  const ShotMatrix &lastShots() const { return shots; }
+
+private:
+  ShotBatch() = default;
+
+  const ShotKernel *find(const std::string &name) {
+    auto it = kernels.find(name);
+    if (it != kernels.end())
+      return &it->second;
+
+    // "<family>_<size>"
+    std::size_t separator = name.rfind('_');
+    if (separator == std::string::npos || separator + 1 == name.size())
+      return nullptr;
+    std::string size = name.substr(separator + 1);
+    if (size.find_first_not_of("0123456789") != std::string::npos)
+      return nullptr;
+    auto family = families.find(name.substr(0, separator));
+    ShotKernel kernel;
+    if (family == families.end() ||
+        !family->second(std::strtoul(size.c_str(), nullptr, 10), kernel))
+      return nullptr;
+    return &(kernels[name] = std::move(kernel));
+  }
+
+  std::map<std::string, ShotKernel> kernels;
+  std::map<std::string, ShotKernelBuilder> families;
+  ShotMatrix shots;
+};
+
+
+// Registers a kernel at static-initialization time, e.g.
+//   static ShotKernelRegistration ghzM_5_shots("ghzM_5", [] { ghzM_5(); },
+//                                              cbit_register, 5);
+struct ShotKernelRegistration {
+  ShotKernelRegistration(const char *name, std::function<void()> run,
+                         cbit *result, unsigned num_cbits) {
+    ShotBatch::instance().registerKernel(name, std::move(run), result, num_cbits);
+  }
+};
+
+// Registers a kernel family, e.g.
+//   static ShotKernelFamilyRegistration ghzM_shots("ghzM", buildGhzM);
+struct ShotKernelFamilyRegistration {
+  ShotKernelFamilyRegistration(const char *name, ShotKernelBuilder build) {
+    ShotBatch::instance().registerFamily(name, build);
+  }
+};
+
+
+extern "C" {
+
+// Returns 0 on success and 1 if no kernel was registered under `name`.
+int shotBatchRun(const char *name, unsigned num_shots) {
+  return ShotBatch::instance().run(name, num_shots) ? 0 : 1;
+}
+
+const std::uint64_t *shotBatchData() {
+  return ShotBatch::instance().lastShots().data();
+}
+
+unsigned shotBatchNumShots() {
+  return ShotBatch::instance().lastShots().numShots();
+}
+
+unsigned shotBatchNumBits() {
+  return ShotBatch::instance().lastShots().numBits();
+}
+
+unsigned shotBatchWordsPerShot() {
+  return ShotBatch::instance().lastShots().wordsPerShot();
+}
+
+// Distinct outcomes of the last run: writes up to `capacity` (first shot,
+// count) pairs and returns how many distinct outcomes there are.
+std::size_t shotBatchHistogram(std::uint64_t *first_shots, unsigned *counts,
+                               std::size_t capacity) {
+  std::vector<ShotMatrix::Count> histogram =
+      ShotBatch::instance().lastShots().histogram();
+  for (std::size_t i = 0; i < std::min(capacity, histogram.size()); i++) {
+    first_shots[i] = histogram[i].shot;
+    counts[i] = histogram[i].count;
+  }
+  return histogram.size();
+}
+
+}
+
+#endif // SHOT_BATCH_H
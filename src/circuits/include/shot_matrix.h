@@ -0,0 +1,197 @@
+#ifndef SHOT_MATRIX_H
+#define SHOT_MATRIX_H
+
+// Bit-packed storage for measurement shots.
+//
+// `getSamples` returns one heap-allocated std::vector<bool> per shot, which at
+// 10^6 shots spends far more memory on allocator headers than on the bits
+// themselves. A ShotMatrix keeps every shot as a row of `wordsPerShot()`
+// uint64 words in one contiguous buffer: bit `i` of a shot (the outcome of
+// qids[i]) is bit `i % 64` of word `i / 64`, and unused high bits are zero.
+// The same layout is what include/shot_batch.h hands to numpy.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <qrt_indexing.hpp>
+
+
+class ShotMatrix {
+public:
+  // Outcome of `shot` (the first shot that produced it) seen `count` times.
+  struct Count {
+    std::size_t shot;
+    unsigned count;
+  };
+
+  ShotMatrix() = default;
+  ShotMatrix(std::size_t num_shots, unsigned num_bits)
+      : shots(num_shots), bits(num_bits), words_per_shot((num_bits + 63) / 64),
+        words(num_shots * words_per_shot, 0) {}
+
+  static ShotMatrix fromSamples(const std::vector<std::vector<bool>> &samples) {
+    ShotMatrix matrix(samples.size(), samples.empty() ? 0 : samples[0].size());
+    for (std::size_t shot = 0; shot < samples.size(); shot++) {
+      for (unsigned i = 0; i < matrix.bits; i++) {
+        if (samples[shot][i])
+          matrix.set(shot, i);
+      }
+    }
+    return matrix;
+  }
+
+  // Draws `num_shots` outcomes from a full probability vector as returned by
+  // getProbabilities(qids), without materializing one vector per shot. Index
+  // bits are mapped to qids through QssIndex, so the rows match getSamples.
+  template <typename RNG>
+  static ShotMatrix sample(const std::vector<double> &probabilities,
+                           unsigned num_qubits, std::size_t num_shots,
+                           RNG &rng) {
+    std::vector<double> cumulative(probabilities.size());
+    double total = 0;
+    for (std::size_t i = 0; i < probabilities.size(); i++)
+      cumulative[i] = total += probabilities[i];
+
+    std::vector<unsigned> qubit_of_bit(num_qubits);
+    for (unsigned b = 0; b < num_qubits; b++) {
+      std::vector<bool> basis =
+          iqsdk::QssIndex(num_qubits, std::size_t(1) << b).getBasis();
+      qubit_of_bit[b] = std::find(basis.begin(), basis.end(), true) - basis.begin();
+    }
+
+    ShotMatrix matrix(num_shots, num_qubits);
+    std::uniform_real_distribution<double> uniform(0, total);
+    for (std::size_t shot = 0; shot < num_shots; shot++) {
+      std::size_t index =
+          std::upper_bound(cumulative.begin(), cumulative.end(), uniform(rng)) -
+          cumulative.begin();
+      index = std::min(index, cumulative.size() - 1);
+      for (unsigned b = 0; b < num_qubits; b++) {
+        if ((index >> b) & 1)
+          matrix.set(shot, qubit_of_bit[b]);
+      }
+    }
+    return matrix;
+  }
+
+  std::size_t numShots() const { return shots; }
+  unsigned numBits() const { return bits; }
+  unsigned wordsPerShot() const { return words_per_shot; }
+
+  std::uint64_t *data() { return words.data(); }
+  const std::uint64_t *data() const { return words.data(); }
+  std::uint64_t *row(std::size_t shot) {
+    return &words[shot * words_per_shot];
+  }
+  const std::uint64_t *row(std::size_t shot) const {
+    return &words[shot * words_per_shot];
+  }
+
+  bool get(std::size_t shot, unsigned i) const {
+    return (row(shot)[i / 64] >> (i % 64)) & 1;
+  }
+  void set(std::size_t shot, unsigned i) {
+    row(shot)[i / 64] |= std::uint64_t(1) << (i % 64);
+  }
+
+  // Clears every bit and resizes for a new batch, reusing the allocation.
+  void reset(std::size_t num_shots, unsigned num_bits) {
+    shots = num_shots;
+    bits = num_bits;
+    words_per_shot = (num_bits + 63) / 64;
+    words.assign(shots * words_per_shot, 0);
+  }
+
+  std::vector<bool> basis(std::size_t shot) const {
+    std::vector<bool> outcome(bits);
+    for (unsigned i = 0; i < bits; i++)
+      outcome[i] = get(shot, i);
+    return outcome;
+  }
+
+  // Distinct outcomes and their counts. Shots that fit in one word are LSD
+  // radix sorted 16 bits at a time, giving outcomes in ascending order of
+  // their packed value; wider shots are grouped by hashing whole rows and
+  // come back in order of first appearance.
+  std::vector<Count> histogram() const {
+    return words_per_shot <= 1 ? radixHistogram() : hashHistogram();
+  }
+
+  // Same result as samplesToHistogram(samples) for compatibility with the
+  // display code in the examples.
+  iqsdk::QssMap<unsigned int> toQssMap() const {
+    iqsdk::QssMap<unsigned int> map;
+    for (const Count &entry : histogram())
+      map[iqsdk::QssIndex(basis(entry.shot))] = entry.count;
+    return map;
+  }
+
+private:
+  std::vector<Count> radixHistogram() const {
+    std::vector<Count> counts;
+    if (shots == 0)
+      return counts;
+
+    std::vector<std::uint32_t> order(shots), scratch(shots);
+    for (std::size_t shot = 0; shot < shots; shot++)
+      order[shot] = shot;
+
+    auto key = [&](std::uint32_t shot) {
+      return words_per_shot ? words[shot] : std::uint64_t(0);
+    };
+    for (unsigned shift = 0; shift < bits; shift += 16) {
+      std::vector<std::size_t> offsets((1 << 16) + 1, 0);
+      for (std::uint32_t shot : order)
+        offsets[((key(shot) >> shift) & 0xFFFF) + 1]++;
+      for (std::size_t d = 1; d < offsets.size(); d++)
+        offsets[d] += offsets[d - 1];
+      for (std::uint32_t shot : order)
+        scratch[offsets[(key(shot) >> shift) & 0xFFFF]++] = shot;
+      order.swap(scratch);
+    }
+
+    for (std::size_t i = 0; i < shots; i++) {
+      if (i == 0 || key(order[i]) != key(order[i - 1]))
+        counts.push_back({order[i], 0});
+      counts.back().count++;
+    }
+    return counts;
+  }
+
+  std::vector<Count> hashHistogram() const {
+    std::vector<Count> counts;
+    // hash -> indices into `counts` of outcomes with that hash
+    std::unordered_map<std::uint64_t, std::vector<std::size_t>> buckets;
+    const std::size_t row_bytes = words_per_shot * sizeof(std::uint64_t);
+
+    for (std::size_t shot = 0; shot < shots; shot++) {
+      const std::uint64_t *r = row(shot);
+      std::uint64_t hash = 0xCBF29CE484222325ull;
+      for (unsigned w = 0; w < words_per_shot; w++)
+        hash = (hash ^ r[w]) * 0x100000001B3ull;
+
+      std::vector<std::size_t> &bucket = buckets[hash];
+      auto match = std::find_if(bucket.begin(), bucket.end(), [&](std::size_t c) {
+        return std::memcmp(row(counts[c].shot), r, row_bytes) == 0;
+      });
+      if (match != bucket.end()) {
+        counts[*match].count++;
+      } else {
+        bucket.push_back(counts.size());
+        counts.push_back({shot, 1});
+      }
+    }
+    return counts;
+  }
+
+  std::size_t shots = 0;
+  unsigned bits = 0, words_per_shot = 0;
+  std::vector<std::uint64_t> words;
+};
+
+#endif // SHOT_MATRIX_H
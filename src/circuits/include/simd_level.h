@@ -0,0 +1,29 @@
+#ifndef SIMD_LEVEL_H
+#define SIMD_LEVEL_H
+
+// Instruction sets the hand-vectorized engines are compiled for. Each engine
+// builds its kernels once per level and picks the widest one the CPU runs.
+
+
+enum class SimdLevel { Scalar, Avx2, Avx512 };
+
+inline const char *simdLevelName(SimdLevel level) {
+  switch (level) {
+  case SimdLevel::Avx512: return "avx512";
+  case SimdLevel::Avx2: return "avx2";
+  default: return "scalar";
+  }
+}
+
+// Widest kernel set this CPU can run.
+inline SimdLevel detectSimdLevel() {
+#if defined(__x86_64__) || defined(__i386__)
+  if (__builtin_cpu_supports("avx512f"))
+    return SimdLevel::Avx512;
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    return SimdLevel::Avx2;
+#endif
+  return SimdLevel::Scalar;
+}
+
+#endif // SIMD_LEVEL_H
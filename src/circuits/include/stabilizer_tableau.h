@@ -0,0 +1,404 @@
+#ifndef STABILIZER_TABLEAU_H
+#define STABILIZER_TABLEAU_H
+
+// Stabilizer tableau (Aaronson-Gottesman, "CHP") for Clifford circuits.
+//
+// The tableau has 2n rows: n destabilizers, then n stabilizers, plus one
+// scratch row for deterministic measurements. Each row is a Pauli string
+// with a sign. It is stored column by column: for every qubit q, x[q] and
+// z[q] are bit vectors over the rows, packed 64 rows to a uint64 word, and
+// the signs form one more such vector. A gate on q then updates every row
+// with a few word operations on q's columns. Multiplying one row into a set
+// of rows, the core of measurement, is word-parallel as well: the phase
+// exponents mod 4 of the target rows are kept as two bit planes.
+//
+// Columns are padded to a whole number of 256-bit vectors, and the column
+// kernels in stabilizer_kernels.inc are compiled for scalar code and for
+// AVX2, picked when the tableau is constructed as state_vector.h does. At
+// 255 qubits a column is 511 rows, two AVX2 vectors.
+//
+// The native gates of a CustomInterface are accepted at Clifford angles
+// only: RXY with both angles multiples of pi/2, RZ multiples of pi/2,
+// CPhase multiples of pi, SwapA 0 or pi (up to multiples of 2 pi). Anything
+// else throws std::invalid_argument.
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define STABILIZER_TABLEAU_X86 1
+#endif
+
+#include "simd_level.h"
+
+
+// Multiple of pi/2 that `angle` is, mod 4.
+inline unsigned quarterTurns(double angle) {
+  const double turns = angle / M_PI_2;
+  const double rounded = std::round(turns);
+  if (std::abs(turns - rounded) > 1e-9 * std::max(1.0, std::abs(turns)))
+    throw std::invalid_argument("Angle " + std::to_string(angle) + " is not a Clifford angle");
+  return ((long long)rounded % 4 + 4) % 4;
+}
+
+
+// One instruction set's kernels, see stabilizer_kernels.inc.
+struct StabilizerKernels {
+  unsigned width;
+  void (*hadamard)(std::uint64_t *x, std::uint64_t *z, std::uint64_t *r, std::size_t words);
+  void (*phase)(std::uint64_t *x, std::uint64_t *z, std::uint64_t *r, std::size_t words);
+  void (*cnot)(std::uint64_t *xc, std::uint64_t *zc, std::uint64_t *xt, std::uint64_t *zt,
+               std::uint64_t *r, std::size_t words);
+  void (*cz)(std::uint64_t *xa, std::uint64_t *za, std::uint64_t *xb, std::uint64_t *zb,
+             std::uint64_t *r, std::size_t words);
+  void (*swap)(std::uint64_t *xa, std::uint64_t *za, std::uint64_t *xb, std::uint64_t *zb,
+               std::size_t words);
+  void (*xor_column)(std::uint64_t *dst, const std::uint64_t *src, std::size_t words);
+  void (*multiply_column)(std::uint64_t *x, std::uint64_t *z, const std::uint64_t *rows,
+                          std::uint64_t *low, std::uint64_t *high, std::size_t words, bool xs,
+                          bool zs);
+};
+
+// Columns are a multiple of this many words.
+constexpr std::size_t k_tableau_word_align = 4;
+
+
+namespace stabilizer_scalar {
+
+struct ScalarBits {
+  using T = std::uint64_t;
+  static constexpr unsigned width = 1;
+  static T load(const std::uint64_t *p) { return *p; }
+  static void store(std::uint64_t *p, T v) { *p = v; }
+  static T band(T a, T b) { return a & b; }
+  static T bor(T a, T b) { return a | b; }
+  static T bxor(T a, T b) { return a ^ b; }
+  // ~a & b
+  static T andnot(T a, T b) { return ~a & b; }
+};
+
+using Bits = ScalarBits;
+#include "stabilizer_kernels.inc"
+
+} // namespace stabilizer_scalar
+
+
+#ifdef STABILIZER_TABLEAU_X86
+
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+
+namespace stabilizer_avx2 {
+
+struct Avx2Bits {
+  using T = __m256i;
+  static constexpr unsigned width = 4;
+  static T load(const std::uint64_t *p) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+  }
+  static void store(std::uint64_t *p, T v) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(p), v);
+  }
+  static T band(T a, T b) { return _mm256_and_si256(a, b); }
+  static T bor(T a, T b) { return _mm256_or_si256(a, b); }
+  static T bxor(T a, T b) { return _mm256_xor_si256(a, b); }
+  // ~a & b
+  static T andnot(T a, T b) { return _mm256_andnot_si256(a, b); }
+};
+
+using Bits = Avx2Bits;
+#include "stabilizer_kernels.inc"
+
+} // namespace stabilizer_avx2
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+#endif // STABILIZER_TABLEAU_X86
+
+
+// Columns are only a few vectors long, so AVX-512 runs the AVX2 kernels.
+inline const StabilizerKernels &stabilizerKernels(SimdLevel level) {
+#ifdef STABILIZER_TABLEAU_X86
+  if (level != SimdLevel::Scalar)
+    return stabilizer_avx2::kernels;
+#endif
+  return stabilizer_scalar::kernels;
+}
+
+
+class StabilizerTableau {
+public:
+  // |0...0>: destabilizer i is X_i, stabilizer i is Z_i.
+  explicit StabilizerTableau(unsigned num_qubits, SimdLevel level = detectSimdLevel())
+      : num_qubits(num_qubits),
+        words(((2 * num_qubits + 1 + 63) / 64 + k_tableau_word_align - 1) /
+              k_tableau_word_align * k_tableau_word_align),
+        level(std::min(level, SimdLevel::Avx2)), kernels(&stabilizerKernels(level)),
+        x(std::size_t(num_qubits) * words, 0), z(std::size_t(num_qubits) * words, 0),
+        r(words, 0), low(words), high(words), rows(words), selected_words(words) {
+    reset();
+  }
+
+  // Back to |0...0> without reallocating.
+  void reset() {
+    std::fill(x.begin(), x.end(), 0);
+    std::fill(z.begin(), z.end(), 0);
+    std::fill(r.begin(), r.end(), 0);
+    for (unsigned q = 0; q < num_qubits; q++) {
+      setBit(xColumn(q), q, true);
+      setBit(zColumn(q), num_qubits + q, true);
+    }
+  }
+
+  unsigned numQubits() const { return num_qubits; }
+  SimdLevel simdLevel() const { return level; }
+
+  void h(unsigned q) { kernels->hadamard(xColumn(q), zColumn(q), r.data(), words); }
+
+  // diag(1, i)
+  void s(unsigned q) { kernels->phase(xColumn(q), zColumn(q), r.data(), words); }
+
+  void pauliX(unsigned q) { kernels->xor_column(r.data(), zColumn(q), words); }
+  void pauliZ(unsigned q) { kernels->xor_column(r.data(), xColumn(q), words); }
+  void pauliY(unsigned q) {
+    pauliX(q);
+    pauliZ(q);
+  }
+
+  void cnot(unsigned control, unsigned target) {
+    kernels->cnot(xColumn(control), zColumn(control), xColumn(target), zColumn(target),
+                  r.data(), words);
+  }
+
+  void cz(unsigned a, unsigned b) {
+    kernels->cz(xColumn(a), zColumn(a), xColumn(b), zColumn(b), r.data(), words);
+  }
+
+  void swap(unsigned a, unsigned b) {
+    kernels->swap(xColumn(a), zColumn(a), xColumn(b), zColumn(b), words);
+  }
+
+  // RZ(turns pi/2), which is S^turns up to a global phase.
+  void rotateZ(unsigned q, unsigned turns) {
+    for (unsigned t = 0; t < turns % 4; t++)
+      s(q);
+  }
+
+  // The gates of a CustomInterface, with the conventions of
+  // custom_backend.cpp: RXY(phi, gamma) = RZ(phi) RX(gamma) RZ(-phi), and
+  // RX(gamma) = H RZ(gamma) H.
+  void applyRotationXY(unsigned q, double phi, double gamma) {
+    const unsigned turns_phi = quarterTurns(phi), turns_gamma = quarterTurns(gamma);
+    if (turns_gamma == 0)
+      return;
+    rotateZ(q, 4 - turns_phi);
+    h(q);
+    rotateZ(q, turns_gamma);
+    h(q);
+    rotateZ(q, turns_phi);
+  }
+
+  void applyRotationZ(unsigned q, double angle) { rotateZ(q, quarterTurns(angle)); }
+
+  void applyCPhase(unsigned a, unsigned b, double angle) {
+    const unsigned turns = quarterTurns(angle);
+    if (turns % 2)
+      throw std::invalid_argument("CPhase(" + std::to_string(angle) + ") is not Clifford");
+    if (turns == 2)
+      cz(a, b);
+  }
+
+  void applySwapA(unsigned a, unsigned b, double angle) {
+    const unsigned turns = quarterTurns(angle);
+    if (turns % 2)
+      throw std::invalid_argument("SwapA(" + std::to_string(angle) + ") is not Clifford");
+    if (turns == 2)
+      swap(a, b);
+  }
+
+  // Whether measuring q in Z has a fixed outcome.
+  bool isDeterministic(unsigned q) const { return stabilizerWithX(q) == 2 * num_qubits; }
+
+  // Measures q in Z and collapses. `random_outcome` is the outcome if it is
+  // not determined by the state; `random`, if given, reports whether it
+  // was.
+  bool measure(unsigned q, bool random_outcome, bool *random = nullptr) {
+    const unsigned scratch = 2 * num_qubits;
+    const unsigned p = stabilizerWithX(q);
+    if (random)
+      *random = p != scratch;
+
+    // Z_q commutes with every stabilizer, so it is +-(the product of the
+    // stabilizers whose destabilizers anticommute with it).
+    if (p == scratch)
+      return stabilizerProduct(xColumn(q));
+
+    // Every other row anticommuting with Z_q absorbs stabilizer p, which
+    // then becomes the destabilizer, and Z_q with the outcome's sign
+    // replaces it.
+    std::copy(xColumn(q), xColumn(q) + words, rows.begin());
+    setBit(rows.data(), p, false);
+    setBit(rows.data(), scratch, false);
+    multiplyInto(rows.data(), p);
+    copyRow(p, p - num_qubits);
+    for (unsigned j = 0; j < num_qubits; j++) {
+      setBit(xColumn(j), p, false);
+      setBit(zColumn(j), p, j == q);
+    }
+    setBit(r.data(), p, random_outcome);
+    return random_outcome;
+  }
+
+  // Measures q and flips it to |0>.
+  void reset(unsigned q, bool random_outcome) {
+    if (measure(q, random_outcome))
+      pauliX(q);
+  }
+
+  // <P> for the Pauli string `paulis` ('I', 'X', 'Y' or 'Z' per entry) on
+  // distinct `qubits`: +1 or -1 if P or -P is a stabilizer, 0 otherwise.
+  // Nothing is collapsed.
+  double expectationValue(const std::vector<unsigned> &qubits, const std::string &paulis) {
+    if (qubits.size() != paulis.size())
+      throw std::invalid_argument("expectationValue: one Pauli per qubit expected");
+    // Bit i: row i anticommutes with P.
+    std::vector<std::uint64_t> anticommuting(words, 0);
+    std::vector<bool> seen(num_qubits, false);
+    for (std::size_t k = 0; k < qubits.size(); k++) {
+      const unsigned q = qubits[k];
+      const char pauli = paulis[k];
+      if (q >= num_qubits || seen[q])
+        throw std::invalid_argument("expectationValue: qubits must be distinct and in range");
+      seen[q] = true;
+      if (pauli != 'I' && pauli != 'X' && pauli != 'Y' && pauli != 'Z')
+        throw std::invalid_argument(std::string("expectationValue: unknown Pauli ") + pauli);
+      if (pauli == 'X' || pauli == 'Y')
+        kernels->xor_column(anticommuting.data(), zColumn(q), words);
+      if (pauli == 'Z' || pauli == 'Y')
+        kernels->xor_column(anticommuting.data(), xColumn(q), words);
+    }
+    for (unsigned row = num_qubits; row < 2 * num_qubits; row++)
+      if (getBit(anticommuting.data(), row))
+        return 0;
+    // As for a deterministic measurement.
+    return stabilizerProduct(anticommuting.data()) ? -1 : 1;
+  }
+
+private:
+  std::uint64_t *xColumn(unsigned q) { return x.data() + std::size_t(q) * words; }
+  std::uint64_t *zColumn(unsigned q) { return z.data() + std::size_t(q) * words; }
+  const std::uint64_t *xColumn(unsigned q) const { return x.data() + std::size_t(q) * words; }
+
+  static bool getBit(const std::uint64_t *v, unsigned row) { return v[row / 64] >> (row % 64) & 1; }
+  static void setBit(std::uint64_t *v, unsigned row, bool value) {
+    const std::uint64_t bit = std::uint64_t(1) << (row % 64);
+    v[row / 64] = value ? v[row / 64] | bit : v[row / 64] & ~bit;
+  }
+
+  // First stabilizer row with an X or Y on q, or 2n if none.
+  unsigned stabilizerWithX(unsigned q) const {
+    for (unsigned row = num_qubits; row < 2 * num_qubits; row++)
+      if (getBit(xColumn(q), row))
+        return row;
+    return 2 * num_qubits;
+  }
+
+  void copyRow(unsigned from, unsigned to) {
+    for (unsigned j = 0; j < num_qubits; j++) {
+      setBit(xColumn(j), to, getBit(xColumn(j), from));
+      setBit(zColumn(j), to, getBit(zColumn(j), from));
+    }
+    setBit(r.data(), to, getBit(r.data(), from));
+  }
+
+  // Sets the scratch row to the product of stabilizer n + i for every
+  // destabilizer i set in `destabilizers` and returns its sign. The
+  // stabilizers commute, so the product is taken qubit by qubit: each
+  // column's selected Paulis are multiplied in row order, adding up the
+  // phase exponents g as multiplyInto does. That reads one word per column
+  // per word of selected rows, plus one step per selected non-identity
+  // entry, where multiplying row by row would sweep every column once per
+  // selected row.
+  bool stabilizerProduct(const std::uint64_t *destabilizers) {
+    const unsigned scratch = 2 * num_qubits;
+    std::fill(rows.begin(), rows.end(), 0);
+    // g mod 4, indexed by xs + 2 zs + 4 x_product + 8 z_product.
+    static constexpr std::uint8_t g[16] = {0, 0, 0, 0, 0, 0, 1, 3, 0, 3, 0, 1, 0, 1, 3, 0};
+    unsigned phase = 0;
+    for (unsigned i = 0; i < num_qubits; i++) {
+      if (getBit(destabilizers, i)) {
+        setBit(rows.data(), num_qubits + i, true);
+        phase += 2 * getBit(r.data(), num_qubits + i);
+      }
+    }
+    // Only the words holding selected rows; usually one or two.
+    std::size_t selected = 0;
+    for (std::size_t w = 0; w < words; w++)
+      if (rows[w])
+        selected_words[selected++] = w;
+    for (unsigned j = 0; j < num_qubits; j++) {
+      std::uint64_t *xj = xColumn(j), *zj = zColumn(j);
+      unsigned product = 0; // x + 2 z
+      for (std::size_t k = 0; k < selected; k++) {
+        const std::size_t w = selected_words[k];
+        std::uint64_t bits = rows[w] & (xj[w] | zj[w]);
+        while (bits) {
+          const unsigned bit = __builtin_ctzll(bits);
+          bits &= bits - 1;
+          const unsigned pauli = (xj[w] >> bit & 1) | (zj[w] >> bit & 1) << 1;
+          phase += g[pauli | product << 2];
+          product ^= pauli;
+        }
+      }
+      setBit(xj, scratch, product & 1);
+      setBit(zj, scratch, product & 2);
+    }
+    const bool negative = phase % 4 == 2;
+    setBit(r.data(), scratch, negative);
+    return negative;
+  }
+
+  // Row h becomes row `source` times row h for every row h set in `mask`
+  // (CHP's rowsum). The phase exponent of each product is 2 r_source +
+  // 2 r_h + sum over qubits of g, which is 0 or 2 mod 4; the g terms are
+  // summed mod 4 in the bit planes `low` and `high`.
+  void multiplyInto(const std::uint64_t *mask, unsigned source) {
+    std::fill(low.begin(), low.end(), 0);
+    std::fill(high.begin(), high.end(), 0);
+    for (unsigned j = 0; j < num_qubits; j++) {
+      const bool xs = getBit(xColumn(j), source), zs = getBit(zColumn(j), source);
+      if (xs || zs)
+        kernels->multiply_column(xColumn(j), zColumn(j), mask, low.data(), high.data(), words,
+                                 xs, zs);
+    }
+    if (getBit(r.data(), source))
+      kernels->xor_column(high.data(), mask, words);
+    for (std::size_t w = 0; w < words; w++)
+      r[w] ^= high[w] & mask[w];
+  }
+
+  unsigned num_qubits;
+  std::size_t words;
+  SimdLevel level;
+  const StabilizerKernels *kernels;
+  std::vector<std::uint64_t> x, z, r;
+  // Scratch columns for measure, stabilizerProduct and multiplyInto.
+  std::vector<std::uint64_t> low, high, rows;
+  std::vector<std::size_t> selected_words;
+};
+
+#endif // STABILIZER_TABLEAU_H
@@ -0,0 +1,114 @@
+#ifndef STATE_POOL_H
+#define STATE_POOL_H
+
+// Amplitude buffers that outlive the state vectors using them.
+//
+// A state vector built for every shot pays for an aligned_alloc and for a
+// page fault on the first write to each page, and at small n with many shots
+// that is most of the run. A StatePool allocates its buffers once, writes
+// every page up front, and hands the same buffers out again and again. A
+// state that gets a pooled buffer is put back to |0...0> with a memset,
+// which glibc vectorizes. Buffers are 64-byte aligned like the SIMD kernels
+// want, and go back to the pool when the StateBuffer holding them is
+// destroyed, so every buffer must be released before its pool is.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+
+constexpr std::size_t k_state_alignment = 64;
+
+class StatePool;
+
+// Returns a buffer to its pool, or frees it if it has none.
+struct StateRelease {
+  StatePool *pool = nullptr;
+  void operator()(double *p) const;
+};
+
+using StateBuffer = std::unique_ptr<double[], StateRelease>;
+
+// `size` doubles, aligned, uninitialized and not pooled.
+inline double *allocateAligned(std::size_t size) {
+  std::size_t bytes = std::max<std::size_t>(size * sizeof(double), k_state_alignment);
+  bytes = (bytes + k_state_alignment - 1) / k_state_alignment * k_state_alignment;
+  double *p = static_cast<double *>(std::aligned_alloc(k_state_alignment, bytes));
+  if (!p)
+    throw std::bad_alloc();
+  return p;
+}
+
+inline StateBuffer allocateState(std::size_t size) { return StateBuffer(allocateAligned(size)); }
+
+
+// Buffers of `bufferSize()` doubles. Thread-safe, so trajectories running on
+// several threads can share one pool.
+class StatePool {
+public:
+  // Allocates `num_buffers` buffers and touches their pages now.
+  explicit StatePool(std::size_t buffer_size, std::size_t num_buffers = 0)
+      : buffer_size(buffer_size) {
+    for (std::size_t b = 0; b < num_buffers; b++) {
+      double *p = allocateAligned(buffer_size);
+      std::memset(p, 0, buffer_size * sizeof(double));
+      free_buffers.push_back(p);
+    }
+    num_allocated = num_buffers;
+  }
+
+  StatePool(const StatePool &) = delete;
+  StatePool &operator=(const StatePool &) = delete;
+
+  ~StatePool() {
+    for (double *p : free_buffers)
+      std::free(p);
+  }
+
+  // A free buffer, or a new one if all are in use. Its contents are
+  // whatever the last user left.
+  StateBuffer acquire() {
+    std::lock_guard<std::mutex> lock(mutex);
+    num_acquired++;
+    if (free_buffers.empty()) {
+      num_allocated++;
+      return StateBuffer(allocateAligned(buffer_size), StateRelease{this});
+    }
+    double *p = free_buffers.back();
+    free_buffers.pop_back();
+    return StateBuffer(p, StateRelease{this});
+  }
+
+  std::size_t bufferSize() const { return buffer_size; }
+  // Buffers allocated over the pool's life and handed out by acquire(); a
+  // pool sized for its peak use allocates nothing after construction.
+  std::size_t numAllocated() const { return num_allocated; }
+  std::size_t numAcquired() const { return num_acquired; }
+
+private:
+  friend struct StateRelease;
+
+  void release(double *p) {
+    std::lock_guard<std::mutex> lock(mutex);
+    free_buffers.push_back(p);
+  }
+
+  std::size_t buffer_size;
+  std::mutex mutex;
+  std::vector<double *> free_buffers;
+  std::size_t num_allocated = 0, num_acquired = 0;
+};
+
+inline void StateRelease::operator()(double *p) const {
+  if (pool)
+    pool->release(p);
+  else
+    std::free(p);
+}
+
+#endif // STATE_POOL_H
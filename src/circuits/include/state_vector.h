@@ -0,0 +1,424 @@
+#ifndef STATE_VECTOR_H
+#define STATE_VECTOR_H
+
+// Standalone state-vector engine with hand-vectorized gate kernels.
+//
+// Amplitudes are stored as separate real and imaginary arrays (SoA), 64-byte
+// aligned, with qubit q on bit q of the index (the IQS convention). The gate
+// kernels in state_vector_kernels.inc are compiled three times, for scalar
+// code, AVX2 + FMA and AVX-512F, and a StateVector picks the widest one the
+// CPU supports when it is constructed. Besides the four gates a
+// CustomInterface receives (RXY, RZ, CPhase, SwapA) and measurement, there
+// are dense blocks of a few qubits (for gate_fusion.h) and diagonal phase
+// polynomials (for diagonal_batch.h); the gate conventions are those of
+// CustomBackend in custom_backend.cpp.
+//
+// The kernels are single-threaded; compare against IQS with
+// OMP_NUM_THREADS=1 for a per-core figure.
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define STATE_VECTOR_X86 1
+#endif
+
+#include "simd_level.h"
+#include "state_pool.h"
+
+
+// Largest dense gate StateVector::applyMatrix takes.
+constexpr unsigned k_max_dense_qubits = 5;
+
+// applyPhasePolynomial sweeps the state in rows of 2^k_phase_row_qubits
+// amplitudes, small enough that a row of phases stays in L1.
+constexpr unsigned k_phase_row_qubits = 10;
+
+// The diagonal gate exp(i phase(b)) on basis state b, with
+//   phase(b) = global + sum linear.angle b_q + sum quadratic.angle b_q b_r,
+// which is what any product of RZ and CPhase gates is.
+struct PhasePolynomial {
+  struct Linear {
+    unsigned q;
+    double angle;
+  };
+  struct Quadratic {
+    unsigned q, r;
+    double angle;
+  };
+  double global = 0;
+  std::vector<Linear> linear;
+  std::vector<Quadratic> quadratic;
+};
+
+// One instruction set's kernels, see state_vector_kernels.inc.
+struct StateVectorKernels {
+  unsigned width;
+  void (*matrix1)(double *re, double *im, std::size_t size, unsigned q,
+                  const std::complex<double> *m);
+  void (*matrix_n)(double *re, double *im, std::size_t size,
+                   const unsigned *qubits, unsigned k,
+                   const std::complex<double> *m);
+  void (*diagonal1)(double *re, double *im, std::size_t size, unsigned q,
+                    std::complex<double> d0, std::complex<double> d1);
+  void (*diagonal_row)(double *re, double *im, std::size_t count,
+                       const double *d_re, const double *d_im,
+                       std::complex<double> c);
+  void (*phase2)(double *re, double *im, std::size_t size, unsigned q1,
+                 unsigned q2, std::complex<double> phase);
+  void (*swap_a)(double *re, double *im, std::size_t size, unsigned q1,
+                 unsigned q2, std::complex<double> diagonal,
+                 std::complex<double> off);
+};
+
+
+namespace state_vector_scalar {
+
+struct ScalarVec {
+  using T = double;
+  static constexpr unsigned width = 1;
+  static T load(const double *p) { return *p; }
+  static void store(double *p, T v) { *p = v; }
+  static T set1(double x) { return x; }
+  static T mul(T a, T b) { return a * b; }
+  static T fmadd(T a, T b, T c) { return a * b + c; }
+  static T fnmadd(T a, T b, T c) { return c - a * b; }
+  // Never called: every qubit bit is at least the width.
+  static T permuteXor(T v, unsigned) { return v; }
+};
+
+using Vec = ScalarVec;
+#include "state_vector_kernels.inc"
+
+} // namespace state_vector_scalar
+
+
+#ifdef STATE_VECTOR_X86
+
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2,fma"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+#endif
+
+namespace state_vector_avx2 {
+
+struct Avx2Vec {
+  using T = __m256d;
+  static constexpr unsigned width = 4;
+  static T load(const double *p) { return _mm256_load_pd(p); }
+  static void store(double *p, T v) { _mm256_store_pd(p, v); }
+  static T set1(double x) { return _mm256_set1_pd(x); }
+  static T mul(T a, T b) { return _mm256_mul_pd(a, b); }
+  static T fmadd(T a, T b, T c) { return _mm256_fmadd_pd(a, b, c); }
+  static T fnmadd(T a, T b, T c) { return _mm256_fnmadd_pd(a, b, c); }
+  // Lane j gets lane j ^ mask.
+  static T permuteXor(T v, unsigned mask) {
+    switch (mask) {
+    case 1: return _mm256_permute_pd(v, 0b0101);
+    case 2: return _mm256_permute4x64_pd(v, 0b01001110);
+    default: return _mm256_permute4x64_pd(v, 0b00011011);
+    }
+  }
+};
+
+using Vec = Avx2Vec;
+#include "state_vector_kernels.inc"
+
+} // namespace state_vector_avx2
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#pragma clang attribute push(__attribute__((target("avx512f"))), apply_to = function)
+#else
+#pragma GCC pop_options
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+#endif
+
+namespace state_vector_avx512 {
+
+struct Avx512Vec {
+  using T = __m512d;
+  static constexpr unsigned width = 8;
+  static T load(const double *p) { return _mm512_load_pd(p); }
+  static void store(double *p, T v) { _mm512_store_pd(p, v); }
+  static T set1(double x) { return _mm512_set1_pd(x); }
+  static T mul(T a, T b) { return _mm512_mul_pd(a, b); }
+  static T fmadd(T a, T b, T c) { return _mm512_fmadd_pd(a, b, c); }
+  static T fnmadd(T a, T b, T c) { return _mm512_fnmadd_pd(a, b, c); }
+  // Lane j gets lane j ^ mask.
+  static T permuteXor(T v, unsigned mask) {
+    __m512i index = _mm512_xor_si512(_mm512_set_epi64(7, 6, 5, 4, 3, 2, 1, 0),
+                                     _mm512_set1_epi64(mask));
+    return _mm512_permutex2var_pd(v, index, v);
+  }
+};
+
+using Vec = Avx512Vec;
+#include "state_vector_kernels.inc"
+
+} // namespace state_vector_avx512
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+#endif // STATE_VECTOR_X86
+
+
+inline const StateVectorKernels &stateVectorKernels(SimdLevel level) {
+#ifdef STATE_VECTOR_X86
+  if (level == SimdLevel::Avx512)
+    return state_vector_avx512::kernels;
+  if (level == SimdLevel::Avx2)
+    return state_vector_avx2::kernels;
+#endif
+  return state_vector_scalar::kernels;
+}
+
+
+class StateVector {
+public:
+  // |0...0>, using `level`'s kernels (narrower ones if the register has
+  // fewer amplitudes than a vector).
+  explicit StateVector(unsigned num_qubits, SimdLevel level = detectSimdLevel())
+      : num_qubits(num_qubits), size(std::size_t(1) << num_qubits),
+        level(level), re(allocateState(size)), im(allocateState(size)) {
+    selectKernels();
+    reset();
+  }
+
+  // |0...0> in two buffers from `pool`, which must hold at least
+  // 2^num_qubits amplitudes each; they go back to the pool with the vector.
+  StateVector(unsigned num_qubits, StatePool &pool, SimdLevel level = detectSimdLevel())
+      : num_qubits(num_qubits), size(std::size_t(1) << num_qubits),
+        level(level), re(pool.acquire()), im(pool.acquire()) {
+    if (pool.bufferSize() < size)
+      throw std::invalid_argument("StateVector: pool buffers too small");
+    selectKernels();
+    reset();
+  }
+
+  // Back to |0...0> without reallocating.
+  void reset() {
+    std::memset(re.get(), 0, size * sizeof(double));
+    std::memset(im.get(), 0, size * sizeof(double));
+    re[0] = 1;
+  }
+
+  unsigned numQubits() const { return num_qubits; }
+  std::size_t numAmplitudes() const { return size; }
+  SimdLevel simdLevel() const { return level; }
+  std::complex<double> operator[](std::size_t i) const { return {re[i], im[i]}; }
+  // The amplitudes themselves, for code that moves them between vectors.
+  double *real() { return re.get(); }
+  double *imag() { return im.get(); }
+
+  // 2x2 unitary `m` (row-major) on qubit q.
+  void applyMatrix(unsigned q, const std::complex<double> m[4]) {
+    kernels->matrix1(re.get(), im.get(), size, q, m);
+  }
+
+  // Dense 2^k x 2^k unitary `m` (row-major) on `qubits`, with qubits[0] the
+  // most significant bit of its index as in noise_channel.h.
+  void applyMatrix(const unsigned *qubits, unsigned k, const std::complex<double> *m) {
+    if (k > k_max_dense_qubits)
+      throw std::invalid_argument("StateVector::applyMatrix: too many qubits");
+    if (k == 1)
+      kernels->matrix1(re.get(), im.get(), size, qubits[0], m);
+    else
+      kernels->matrix_n(re.get(), im.get(), size, qubits, k, m);
+  }
+
+  // exp(-i gamma / 2 (cos(phi) X + sin(phi) Y))
+  void applyRotationXY(unsigned q, double phi, double gamma) {
+    const std::complex<double> i(0, 1);
+    const double c = std::cos(gamma / 2), s = std::sin(gamma / 2);
+    const std::complex<double> m[4] = {c, -i * s * std::exp(-i * phi),
+                                       -i * s * std::exp(i * phi), c};
+    applyMatrix(q, m);
+  }
+
+  // diag(exp(-i angle / 2), exp(i angle / 2))
+  void applyRotationZ(unsigned q, double angle) {
+    std::complex<double> phase = std::polar(1.0, -angle / 2);
+    kernels->diagonal1(re.get(), im.get(), size, q, phase, std::conj(phase));
+  }
+
+  // diag(d0, d1) on qubit q.
+  void applyDiagonal(unsigned q, std::complex<double> d0, std::complex<double> d1) {
+    kernels->diagonal1(re.get(), im.get(), size, q, d0, d1);
+  }
+
+  // Multiplies every amplitude by c.
+  void scale(std::complex<double> c) { applyDiagonal(0, c, c); }
+
+  // Any number of diagonal gates in one sweep. The phases of each row of
+  // 2^k_phase_row_qubits amplitudes are computed once per value of the
+  // higher qubits the polynomial involves, then applied by the SIMD kernel.
+  void applyPhasePolynomial(const PhasePolynomial &p) {
+    const unsigned row_qubits = std::min(num_qubits, k_phase_row_qubits);
+    const std::size_t row_size = std::size_t(1) << row_qubits;
+
+    // Terms on row qubits only go into the base row; terms on higher qubits
+    // only into a per-row scalar; the rest couple a row qubit to a higher one.
+    std::vector<double> angles(row_size, 0);
+    std::vector<PhasePolynomial::Linear> high_linear;
+    std::vector<PhasePolynomial::Quadratic> high_quadratic, cross;
+    std::vector<unsigned> cross_qubits; // row qubits of `cross`
+    std::size_t high_mask = 0;
+    for (const PhasePolynomial::Linear &term : p.linear) {
+      if (term.q < row_qubits) {
+        for (std::size_t j = 0; j < row_size; j++)
+          angles[j] += j >> term.q & 1 ? term.angle : 0;
+      } else {
+        high_linear.push_back(term);
+        high_mask |= std::size_t(1) << term.q;
+      }
+    }
+    for (PhasePolynomial::Quadratic term : p.quadratic) {
+      if (term.q > term.r)
+        std::swap(term.q, term.r);
+      if (term.r < row_qubits) {
+        for (std::size_t j = 0; j < row_size; j++)
+          angles[j] += (j >> term.q & 1) && (j >> term.r & 1) ? term.angle : 0;
+        continue;
+      }
+      high_mask |= std::size_t(1) << term.r;
+      if (term.q >= row_qubits) {
+        high_mask |= std::size_t(1) << term.q;
+        high_quadratic.push_back(term);
+        continue;
+      }
+      cross.push_back(term);
+      if (std::find(cross_qubits.begin(), cross_qubits.end(), term.q) == cross_qubits.end())
+        cross_qubits.push_back(term.q);
+    }
+    // From here on a cross term's q is the index of its row qubit.
+    for (PhasePolynomial::Quadratic &term : cross)
+      term.q = std::find(cross_qubits.begin(), cross_qubits.end(), term.q) - cross_qubits.begin();
+
+    StateBuffer base_re = allocateState(row_size), base_im = allocateState(row_size);
+    for (std::size_t j = 0; j < row_size; j++) {
+      base_re[j] = std::cos(angles[j]);
+      base_im[j] = std::sin(angles[j]);
+    }
+
+    // With cross terms, amplitude j of a row also gets cross_phases[keys[j]],
+    // where keys[j] packs the bits of j on cross_qubits.
+    StateBuffer row_re, row_im;
+    std::vector<unsigned> keys;
+    std::vector<std::complex<double>> cross_phases;
+    if (!cross.empty()) {
+      row_re = allocateState(row_size);
+      row_im = allocateState(row_size);
+      keys.assign(row_size, 0);
+      for (std::size_t j = 0; j < row_size; j++)
+        for (std::size_t k = 0; k < cross_qubits.size(); k++)
+          keys[j] |= unsigned(j >> cross_qubits[k] & 1) << k;
+      cross_phases.resize(std::size_t(1) << cross_qubits.size());
+    }
+    const double *d_re = cross.empty() ? base_re.get() : row_re.get();
+    const double *d_im = cross.empty() ? base_im.get() : row_im.get();
+
+    std::vector<double> cross_angles(cross_qubits.size());
+    std::complex<double> row_scale;
+    for (std::size_t row = 0; row < size; row += row_size) {
+      // Rows that agree on the higher qubits get the same phases.
+      if (row == 0 || ((row ^ (row - row_size)) & high_mask)) {
+        double angle = p.global;
+        for (const PhasePolynomial::Linear &term : high_linear)
+          angle += row >> term.q & 1 ? term.angle : 0;
+        for (const PhasePolynomial::Quadratic &term : high_quadratic)
+          angle += (row >> term.q & 1) && (row >> term.r & 1) ? term.angle : 0;
+        row_scale = std::polar(1.0, angle);
+
+        if (!cross.empty()) {
+          std::fill(cross_angles.begin(), cross_angles.end(), 0);
+          for (const PhasePolynomial::Quadratic &term : cross)
+            if (row >> term.r & 1)
+              cross_angles[term.q] += term.angle;
+          cross_phases[0] = 1;
+          for (std::size_t k = 0; k < cross_qubits.size(); k++) {
+            const std::size_t half = std::size_t(1) << k;
+            const std::complex<double> phase = std::polar(1.0, cross_angles[k]);
+            for (std::size_t key = 0; key < half; key++)
+              cross_phases[half | key] = cross_phases[key] * phase;
+          }
+          // Spelled out: std::complex's operator* goes through a NaN-checking
+          // library call.
+          for (std::size_t j = 0; j < row_size; j++) {
+            const std::complex<double> c = cross_phases[keys[j]];
+            row_re[j] = base_re[j] * c.real() - base_im[j] * c.imag();
+            row_im[j] = base_re[j] * c.imag() + base_im[j] * c.real();
+          }
+        }
+      }
+      kernels->diagonal_row(re.get() + row, im.get() + row, row_size, d_re, d_im, row_scale);
+    }
+  }
+
+  // |11> gets exp(-i angle), as ApplyCPhaseRotation(ctrl, target, -angle).
+  void applyCPhase(unsigned ctrl, unsigned target, double angle) {
+    kernels->phase2(re.get(), im.get(), size, ctrl, target, std::polar(1.0, -angle));
+  }
+
+  // The ISwapRotation matrix CustomBackend builds for SwapA.
+  void applySwapA(unsigned q1, unsigned q2, double angle) {
+    std::complex<double> diagonal = {0.5 * (1.0 + std::cos(angle)), 0.5 * std::sin(angle)};
+    std::complex<double> off = {0.5 * (1.0 - std::cos(angle)), -0.5 * std::sin(angle)};
+    kernels->swap_a(re.get(), im.get(), size, q1, q2, diagonal, off);
+  }
+
+  // Probability of measuring q in |1>.
+  double getProbability(unsigned q) const {
+    const std::size_t bit = std::size_t(1) << q;
+    double sum = 0;
+    for (std::size_t base = bit; base < size; base += 2 * bit)
+      for (std::size_t i = base; i < base + bit; i++)
+        sum += re[i] * re[i] + im[i] * im[i];
+    return sum;
+  }
+
+  // Projects q onto |value>, which must have probability `probability`, and
+  // renormalizes.
+  void collapse(unsigned q, bool value, double probability) {
+    const std::size_t bit = std::size_t(1) << q;
+    const double norm = 1 / std::sqrt(probability);
+    for (std::size_t i = 0; i < size; i++) {
+      bool keep = bool(i & bit) == value;
+      re[i] = keep ? re[i] * norm : 0;
+      im[i] = keep ? im[i] * norm : 0;
+    }
+  }
+
+private:
+  // Narrower kernels if the register has fewer amplitudes than a vector.
+  void selectKernels() {
+    while (stateVectorKernels(level).width > size)
+      level = SimdLevel(int(level) - 1);
+    kernels = &stateVectorKernels(level);
+  }
+
+  unsigned num_qubits;
+  std::size_t size;
+  SimdLevel level;
+  StateBuffer re, im;
+  const StateVectorKernels *kernels;
+};
+
+#endif // STATE_VECTOR_H
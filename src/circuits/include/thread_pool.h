@@ -0,0 +1,196 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+// Persistent worker threads pinned to NUMA nodes.
+//
+// numaNodes() reads the node -> CPU map from sysfs, restricted to the CPUs
+// this process may run on, so no libnuma is needed; without sysfs the
+// machine is one node with every CPU. A ThreadPool starts its workers once,
+// in contiguous blocks per node, pins each to its node's CPUs, and then runs
+// one job at a time on all of them: run(job) calls job(worker) on every
+// worker and returns when all are done. Because the threads and their
+// pinning persist, memory a worker touches first is placed on its node
+// (Linux first-touch) and stays local to it for every later job.
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+struct NumaNode {
+  unsigned id;
+  std::vector<unsigned> cpus;
+};
+
+// "0-3,8,10-11" -> {0, 1, 2, 3, 8, 10, 11}
+inline std::vector<unsigned> parseCpuList(const std::string &list) {
+  std::vector<unsigned> cpus;
+  std::stringstream ranges(list);
+  std::string range;
+  while (std::getline(ranges, range, ',')) {
+    if (range.find_first_of("0123456789") == std::string::npos)
+      continue;
+    std::size_t dash = range.find('-');
+    unsigned first = std::stoul(range.substr(0, dash));
+    unsigned last = dash == std::string::npos ? first : std::stoul(range.substr(dash + 1));
+    for (unsigned cpu = first; cpu <= last; cpu++)
+      cpus.push_back(cpu);
+  }
+  return cpus;
+}
+
+// Nodes with at least one CPU this process may use, by id.
+inline std::vector<NumaNode> numaNodes() {
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  bool have_mask = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+  auto usable = [&](unsigned cpu) {
+    return !have_mask || (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed));
+  };
+
+  std::vector<NumaNode> nodes;
+  std::error_code error;
+  for (const auto &entry : std::filesystem::directory_iterator("/sys/devices/system/node", error)) {
+    std::string name = entry.path().filename();
+    if (name.rfind("node", 0) != 0 || name.find_first_not_of("0123456789", 4) != std::string::npos)
+      continue;
+    std::ifstream cpulist(entry.path() / "cpulist");
+    std::string list;
+    std::getline(cpulist, list);
+    NumaNode node{unsigned(std::stoul(name.substr(4))), {}};
+    for (unsigned cpu : parseCpuList(list))
+      if (usable(cpu))
+        node.cpus.push_back(cpu);
+    if (!node.cpus.empty())
+      nodes.push_back(node);
+  }
+  std::sort(nodes.begin(), nodes.end(),
+            [](const NumaNode &a, const NumaNode &b) { return a.id < b.id; });
+
+  if (nodes.empty()) {
+    nodes.push_back({0, {}});
+    unsigned num_cpus = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned cpu = 0; cpu < num_cpus; cpu++)
+      if (usable(cpu))
+        nodes[0].cpus.push_back(cpu);
+  }
+  return nodes;
+}
+
+inline unsigned numUsableCpus(const std::vector<NumaNode> &nodes) {
+  std::size_t count = 0;
+  for (const NumaNode &node : nodes)
+    count += node.cpus.size();
+  return std::max<std::size_t>(count, 1);
+}
+
+
+class ThreadPool {
+public:
+  using Job = std::function<void(unsigned worker)>;
+
+  // Worker w runs on node nodeOf(w); nodes get equal contiguous blocks of
+  // workers (with fewer workers than nodes, the first nodes get one each).
+  explicit ThreadPool(unsigned num_workers, std::vector<NumaNode> nodes = numaNodes())
+      : numa_nodes(std::move(nodes)) {
+    num_workers = std::max(num_workers, 1u);
+    if (numa_nodes.size() > num_workers)
+      numa_nodes.resize(num_workers);
+    for (unsigned w = 0; w < num_workers; w++)
+      node_of.push_back(std::uint64_t(w) * numa_nodes.size() / num_workers);
+    for (unsigned w = 0; w < num_workers; w++)
+      threads.emplace_back(&ThreadPool::work, this, w);
+  }
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    started.notify_all();
+    for (std::thread &thread : threads)
+      thread.join();
+  }
+
+  unsigned numWorkers() const { return threads.size(); }
+  unsigned numNodes() const { return numa_nodes.size(); }
+  // Index into nodes() of the node worker w is pinned to.
+  unsigned nodeOf(unsigned worker) const { return node_of[worker]; }
+  const std::vector<NumaNode> &nodes() const { return numa_nodes; }
+
+  // Calls job(w) on every worker w and waits for all of them. The first
+  // exception a worker throws is rethrown here.
+  void run(const Job &job) {
+    std::unique_lock<std::mutex> lock(mutex);
+    current = &job;
+    pending = threads.size();
+    failure = nullptr;
+    generation++;
+    started.notify_all();
+    finished.wait(lock, [&] { return pending == 0; });
+    current = nullptr;
+    if (failure)
+      std::rethrow_exception(failure);
+  }
+
+private:
+  void work(unsigned worker) {
+    // Best effort: without permission the thread just floats.
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    for (unsigned cpu : numa_nodes[node_of[worker]].cpus)
+      if (cpu < CPU_SETSIZE)
+        CPU_SET(cpu, &cpus);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+
+    std::uint64_t seen = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+      started.wait(lock, [&] { return stopping || generation != seen; });
+      if (stopping)
+        return;
+      seen = generation;
+      const Job *job = current;
+      lock.unlock();
+      std::exception_ptr error;
+      try {
+        (*job)(worker);
+      } catch (...) {
+        error = std::current_exception();
+      }
+      lock.lock();
+      if (error && !failure)
+        failure = error;
+      if (--pending == 0)
+        finished.notify_one();
+    }
+  }
+
+  std::vector<NumaNode> numa_nodes;
+  std::vector<unsigned> node_of;
+  std::vector<std::thread> threads;
+  std::mutex mutex;
+  std::condition_variable started, finished;
+  const Job *current = nullptr;
+  std::uint64_t generation = 0;
+  std::size_t pending = 0;
+  bool stopping = false;
+  std::exception_ptr failure;
+};
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,93 @@
+#ifndef TRAJECTORY_SHARDS_H
+#define TRAJECTORY_SHARDS_H
+
+// Sharded trajectory mode for noisy sampling.
+//
+// Under a "custom" (or "depolarizing") noise config every shot is an
+// independent trajectory, so shots can be spread over several simulator
+// instances. Each worker owns one asynchronous simulator, seeded from its own
+// stream of a single master seed, and its own row of result cbits. The SDK
+// runs every asynchronous device on its own backend thread, so launching one
+// kernel per worker and then waiting on all of them keeps every core busy.
+//
+// Shot `s` always runs as the `s / num_workers`-th trajectory of worker
+// `s % num_workers`, and rows are handed back in shot order, so the output is
+// bit-identical for a given master seed and worker count.
+//
+// `collect` may return a bool; returning false stops the run early. Shots
+// still in flight are then waited for and dropped.
+
+#include <algorithm>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#include <quantum.hpp>
+
+
+// SplitMix64 finalizer: maps (master seed, stream) to well-separated seeds so
+// neighbouring workers do not start from correlated RNG states.
+inline std::uint64_t deriveSeed(std::uint64_t master_seed, unsigned stream) {
+  std::uint64_t z = master_seed + 0x9E3779B97F4A7C15ull * (stream + 1ull);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+
+template <typename Collect>
+bool collectShot(Collect &collect, unsigned shot, unsigned worker) {
+  if constexpr (std::is_same_v<decltype(collect(shot, worker)), bool>) {
+    return collect(shot, worker);
+  } else {
+    collect(shot, worker);
+    return true;
+  }
+}
+
+
+// Runs `num_shots` trajectories round-robin over `sims`, which must already
+// be initialized with `synchronous = false`.
+//   launch(worker)        - issues the kernel writing into that worker's cbits
+//   collect(shot, worker) - reads the finished shot back out of those cbits;
+//                           may return false to stop early
+// A worker is relaunched as soon as its shot is collected, so no device idles
+// while the others finish. Returns false as soon as a simulator fails to
+// become ready.
+template <typename Simulator, typename Launch, typename Collect>
+bool runShardedTrajectories(std::vector<Simulator> &sims, unsigned num_shots,
+                            Launch launch, Collect collect) {
+  const unsigned num_workers = sims.size();
+  if (num_workers == 0)
+    return num_shots == 0;
+
+  auto start = [&](unsigned w) {
+    // ready() selects worker `w` as the target of the next kernel call.
+    if (iqsdk::QRT_ERROR_SUCCESS != sims[w].ready())
+      return false;
+    launch(w);
+    return true;
+  };
+
+  for (unsigned w = 0; w < std::min(num_workers, num_shots); w++) {
+    if (!start(w))
+      return false;
+  }
+
+  for (unsigned shot = 0; shot < num_shots; shot++) {
+    unsigned w = shot % num_workers;
+    sims[w].wait();
+    if (!collectShot(collect, shot, w)) {
+      unsigned in_flight_end = std::min(num_shots, shot + num_workers);
+      for (unsigned s = shot + 1; s < in_flight_end; s++)
+        sims[s % num_workers].wait();
+      return true;
+    }
+
+    if (shot + num_workers < num_shots && !start(w))
+      return false;
+  }
+  return true;
+}
+
+#endif // TRAJECTORY_SHARDS_H
@@ -0,0 +1,237 @@
+#include <clang/Quantum/quintrinsics.h>
+
+#include <quantum_custom_backend.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "include/benchmark.h"
+#include "include/numa_state_vector.h"
+#include "include/state_vector.h"
+
+
+// CustomInterface on the multi-threaded, NUMA-partitioned state vector of
+// include/numa_state_vector.h, run on GHZ and QFT kernels of up to 32 qubits
+// with a per-node bandwidth report.
+
+const int max_qubits = 32;
+qbit qubit_register[max_qubits];
+
+// Partitions of every NumaBackend, 0 for defaultPartitions; set from the
+// command line before the first device is created.
+unsigned num_partitions = 0;
+
+
+template <unsigned n> quantum_kernel void ghzNuma() {
+  for (int i = 0; i < n; i++)
+    PrepZ(qubit_register[i]);
+  H(qubit_register[0]);
+  for (int i = 0; i < n - 1; i++)
+    CNOT(qubit_register[i], qubit_register[i + 1]);
+}
+
+// Same structure as qft_error.cpp, without the final swaps.
+template <unsigned n> quantum_kernel void qftNuma() {
+  for (int i = 0; i < n; i++)
+    PrepZ(qubit_register[i]);
+  for (int index = 0; index < n; index++) {
+    H(qubit_register[index]);
+    for (int index_r = 1; index_r < n - index; index_r++) {
+      double angle = 2 * (1 / M_1_PI) / std::pow(2, index_r + 1);
+      CPhase(qubit_register[index + index_r], qubit_register[index], angle);
+    }
+  }
+}
+
+struct NumaKernel {
+  const char *name;
+  unsigned num_qubits;
+  void (*run)();
+};
+
+template <unsigned n> void addKernels(std::vector<NumaKernel> &kernels) {
+  kernels.push_back({"ghz", n, [] { ghzNuma<n>(); }});
+  kernels.push_back({"qft", n, [] { qftNuma<n>(); }});
+}
+
+// Qubit counts compiled in; the command line picks a range.
+template <unsigned... sizes> std::vector<NumaKernel> allKernels() {
+  std::vector<NumaKernel> kernels;
+  (addKernels<sizes>(kernels), ...);
+  return kernels;
+}
+
+
+class NumaBackend : public iqsdk::CustomInterface {
+public:
+  NumaStateVector psi;
+  std::mt19937_64 rng;
+  std::uniform_real_distribution<double> uniform;
+
+  NumaBackend(int num_qubits, std::uint64_t seed = 0)
+      : psi(num_qubits, num_partitions), rng(seed) {}
+
+  void RXY(qbit q, double phi, double gamma) { psi.applyRotationXY(q, phi, gamma); }
+
+  void RZ(qbit q, double angle) { psi.applyRotationZ(q, angle); }
+
+  void CPhase(qbit ctrl, qbit target, double angle) { psi.applyCPhase(ctrl, target, angle); }
+
+  void SwapA(qbit q1, qbit q2, double angle) { psi.applySwapA(q1, q2, angle); }
+
+  // Measure, then flip |1> back to |0>.
+  void PrepZ(qbit q) {
+    static const std::complex<double> x[4] = {0, 1, 1, 0};
+    if (MeasZ(q))
+      psi.applyMatrix(q, x);
+  }
+
+  cbit MeasZ(qbit q) {
+    double probability = psi.getProbability(q);
+    bool measurement = uniform(rng) <= probability;
+    psi.collapse(q, measurement, measurement ? probability : 1 - probability);
+    return measurement;
+  }
+};
+
+
+// Largest amplitude difference to the single-threaded StateVector after
+// `num_gates` random gates on `num_qubits` qubits in `partitions`
+// partitions, so global qubits, exchanges and remapping are all exercised,
+// plus the largest single-qubit probability difference.
+double crossCheck(unsigned num_qubits, unsigned partitions, unsigned num_gates,
+                  std::uint64_t seed) {
+  std::mt19937_64 rng(seed);
+  std::uniform_real_distribution<double> angle(0, 2 * M_PI);
+  StateVector reference(num_qubits);
+  NumaStateVector psi(num_qubits, partitions);
+  for (unsigned g = 0; g < num_gates; g++) {
+    unsigned q1 = rng() % num_qubits, q2 = (q1 + 1 + rng() % (num_qubits - 1)) % num_qubits;
+    double a = angle(rng), b = angle(rng);
+    // A layer of rotations first, so the state is dense.
+    switch (g < num_qubits ? 0 : rng() % 4) {
+    case 0:
+      q1 = g < num_qubits ? g : q1;
+      reference.applyRotationXY(q1, a, b);
+      psi.applyRotationXY(q1, a, b);
+      break;
+    case 1:
+      reference.applyRotationZ(q1, a);
+      psi.applyRotationZ(q1, a);
+      break;
+    case 2:
+      reference.applyCPhase(q1, q2, a);
+      psi.applyCPhase(q1, q2, a);
+      break;
+    default:
+      reference.applySwapA(q1, q2, a);
+      psi.applySwapA(q1, q2, a);
+      break;
+    }
+  }
+
+  double error = 0;
+  for (std::size_t i = 0; i < reference.numAmplitudes(); i++)
+    error = std::max(error, std::abs(psi[i] - reference[i]));
+  for (unsigned q = 0; q < num_qubits; q++)
+    error = std::max(error, std::abs(psi.getProbability(q) - reference.getProbability(q)));
+  return error;
+}
+
+
+// Usage: numa_backend [output_csv] [min_qubits] [max_qubits] [num_partitions]
+// Cross-checks NumaStateVector against StateVector, then runs GHZ and QFT
+// on a NumaBackend device for every compiled qubit count in
+// [min_qubits, max_qubits] and writes one CSV row per (kernel, qubits, NUMA
+// node): bytes moved, time, achieved bandwidth and its fraction of the
+// node's peak, measured with a streaming pass over the same partitions just
+// before the kernel. num_partitions defaults to the usable CPUs (a power of
+// two); 32 qubits need 64 GiB.
+int main(int argc, char *argv[]) {
+  std::string output = argc > 1 ? argv[1] : "results/numa_backend/bandwidth.csv";
+  unsigned min_qubits = argc > 2 ? std::atoi(argv[2]) : 24;
+  unsigned max_qubits_run = argc > 3 ? std::atoi(argv[3]) : 28;
+  num_partitions = argc > 4 ? std::atoi(argv[4]) : 0;
+
+  for (const NumaNode &node : numaNodes())
+    std::cout << "NUMA node " << node.id << ": " << node.cpus.size() << " CPUs" << std::endl;
+
+  double error = crossCheck(14, 8, 400, 12345);
+  std::cout << "Max difference to StateVector: " << error << std::endl;
+  if (error > 1e-10) {
+    std::cerr << "Error: NumaStateVector disagrees with StateVector" << std::endl;
+    return 1;
+  }
+
+  std::filesystem::path parent = std::filesystem::path(output).parent_path();
+  if (!parent.empty())
+    std::filesystem::create_directories(parent);
+  std::ofstream report(output);
+  if (!report) {
+    std::cerr << "Error: Unable to open " << output << std::endl;
+    return 1;
+  }
+  report << "kernel,num_qubits,num_partitions,node,num_workers,bytes,seconds,"
+            "bytes_per_second,peak_bytes_per_second,utilization,wall_seconds,status\n";
+
+  std::cout << "kernel\tqubits\tpartitions\tnode\tworkers\tGB/s\tpeak GB/s\tutilization" << std::endl;
+  for (const NumaKernel &kernel : allKernels<24, 25, 26, 27, 28, 29, 30, 31, 32>()) {
+    if (kernel.num_qubits < min_qubits || kernel.num_qubits > max_qubits_run)
+      continue;
+    iqsdk::CustomSimulator *custom_simulator =
+        iqsdk::CustomSimulator::createSimulator<NumaBackend>("numa_custom_device", kernel.num_qubits);
+    iqsdk::QRT_ERROR_T status = custom_simulator->ready();
+    assert(status == iqsdk::QRT_ERROR_SUCCESS);
+    NumaBackend *backend = dynamic_cast<NumaBackend *>(custom_simulator->getCustomBackend());
+    assert(backend != nullptr);
+    NumaStateVector &psi = backend->psi;
+
+    std::vector<NodeBandwidth> peak = psi.measurePeakBandwidth();
+    Stopwatch stopwatch;
+    kernel.run();
+    double wall_seconds = stopwatch.seconds();
+
+    // GHZ ends in (|0...0> + |1...1>) / sqrt(2), the QFT of |0...0> in the
+    // uniform superposition.
+    const std::size_t last = (std::size_t(1) << kernel.num_qubits) - 1;
+    bool ok = std::string(kernel.name) == "ghz"
+                  ? std::abs(std::norm(psi[0]) - 0.5) < 1e-9 && std::abs(std::norm(psi[last]) - 0.5) < 1e-9
+                  : std::abs(std::norm(psi[0]) * (last + 1) - 1) < 1e-6 &&
+                        std::abs(std::norm(psi[last]) * (last + 1) - 1) < 1e-6;
+
+    std::vector<NodeBandwidth> nodes = psi.bandwidth();
+    for (std::size_t n = 0; n < nodes.size(); n++) {
+      const NodeBandwidth &node = nodes[n];
+      double utilization = peak[n].bytesPerSecond() > 0
+                               ? node.bytesPerSecond() / peak[n].bytesPerSecond() : 0;
+      char numbers[160];
+      std::snprintf(numbers, sizeof(numbers), "%.6e,%.6e,%.6e,%.6e,%.4f,%.6e", node.bytes,
+                    node.seconds, node.bytesPerSecond(), peak[n].bytesPerSecond(),
+                    utilization, wall_seconds);
+      report << kernel.name << ',' << kernel.num_qubits << ',' << psi.numPartitions() << ','
+             << node.node << ',' << node.num_workers << ',' << numbers << ','
+             << (ok ? "ok" : "wrong_state") << '\n';
+      std::cout << kernel.name << "\t" << kernel.num_qubits << "\t" << psi.numPartitions()
+                << "\t" << node.node << "\t" << node.num_workers << "\t"
+                << node.bytesPerSecond() * 1e-9 << "\t" << peak[n].bytesPerSecond() * 1e-9
+                << "\t" << utilization << std::endl;
+    }
+    delete custom_simulator;
+    if (!ok) {
+      std::cerr << "Error: " << kernel.name << " on " << kernel.num_qubits
+                << " qubits gave the wrong state" << std::endl;
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,243 @@
+#include <clang/Quantum/quintrinsics.h>
+
+#include <quantum_custom_backend.h>
+#include <qureg.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "include/benchmark.h"
+#include "include/precision.h"
+
+
+// Speed and accuracy of single- and mixed-precision IQS custom backends
+// (precision.h) against double precision, on the same kernels.
+
+const int max_qubits = 28;
+qbit qubit_register[max_qubits];
+
+// Layers of the hardware-efficient kernel.
+const int k_layers = 20;
+
+
+// Rotation layers and alternating CZ bricks, with angles that differ per
+// qubit and layer so no gate is trivial.
+template <unsigned n> quantum_kernel void layeredPrecision() {
+  for (int i = 0; i < n; i++)
+    PrepZ(qubit_register[i]);
+  for (int layer = 0; layer < k_layers; layer++) {
+    for (int i = 0; i < n; i++) {
+      RY(qubit_register[i], 0.3 + 0.17 * i + 0.41 * layer);
+      RZ(qubit_register[i], 1.1 - 0.23 * i + 0.07 * layer);
+    }
+    for (int i = layer % 2; i + 1 < n; i += 2)
+      CZ(qubit_register[i], qubit_register[i + 1]);
+  }
+}
+
+// Same structure as qft_error.cpp, without the final swaps, on a product
+// state so the result is not uniform.
+template <unsigned n> quantum_kernel void qftPrecision() {
+  for (int i = 0; i < n; i++) {
+    PrepZ(qubit_register[i]);
+    RY(qubit_register[i], 0.2 + 0.31 * i);
+  }
+  for (int index = 0; index < n; index++) {
+    H(qubit_register[index]);
+    for (int index_r = 1; index_r < n - index; index_r++) {
+      double angle = 2 * (1 / M_1_PI) / std::pow(2, index_r + 1);
+      CPhase(qubit_register[index + index_r], qubit_register[index], angle);
+    }
+  }
+}
+
+struct PrecisionKernel {
+  const char *name;
+  unsigned num_qubits;
+  void (*run)();
+};
+
+template <unsigned n> void addKernels(std::vector<PrecisionKernel> &kernels) {
+  kernels.push_back({"layered", n, [] { layeredPrecision<n>(); }});
+  kernels.push_back({"qft", n, [] { qftPrecision<n>(); }});
+}
+
+// Qubit counts compiled in; the command line picks a range.
+template <unsigned... sizes> std::vector<PrecisionKernel> allKernels() {
+  std::vector<PrecisionKernel> kernels;
+  (addKernels<sizes>(kernels), ...);
+  return kernels;
+}
+
+
+// What the benchmark reads from a backend of either precision.
+class PrecisionDevice : public iqsdk::CustomInterface {
+public:
+  virtual std::size_t numAmplitudes() = 0;
+  virtual std::complex<double> amplitude(std::size_t i) = 0;
+  virtual double probability(unsigned q) = 0;
+};
+
+// Gates go straight to IQS, one sweep each, so the timing is the storage
+// type's. Type is ComplexDP or ComplexSP.
+template <typename Type> class PrecisionBackend : public PrecisionDevice {
+public:
+  iqs::QubitRegister<Type> psi;
+  iqs::RandomNumberGenerator<double> rng;
+  bool accumulate_in_double;
+
+  PrecisionBackend(int num_qubits, bool accumulate_in_double)
+      : psi(num_qubits, "base", 0), accumulate_in_double(accumulate_in_double) {
+    rng.SetSeedStreamPtrs(0);
+  }
+
+  void RXY(qbit q, double phi, double gamma) { psi.ApplyRotationXY(q, phi, gamma); }
+
+  void RZ(qbit q, double angle) { psi.ApplyRotationZ(q, angle); }
+
+  void CPhase(qbit ctrl, qbit target, double angle) {
+    psi.ApplyCPhaseRotation(ctrl, target, -angle);
+  }
+
+  void SwapA(qbit q1, qbit q2, double angle) {
+    iqs::TinyMatrix<Type, 2, 2, 32> gate_matrix;
+    gate_matrix(0, 0) = gate_matrix(1, 1) = Type(0.5 * (1.0 + std::cos(angle)), 0.5 * std::sin(angle));
+    gate_matrix(0, 1) = gate_matrix(1, 0) = Type(0.5 * (1.0 - std::cos(angle)), -0.5 * std::sin(angle));
+    psi.ApplyISwapRotation(q1, q2, gate_matrix);
+  }
+
+  // Measure, then flip |1> back to |0>.
+  void PrepZ(qbit q) {
+    if (MeasZ(q))
+      psi.ApplyPauliX(q);
+  }
+
+  cbit MeasZ(qbit q) {
+    double rand_value;
+    double probability = qubitProbability(psi, q, accumulate_in_double);
+    rng.UniformRandomNumbers(&rand_value, 1, 0, 1, "state");
+    bool measurement = rand_value <= probability;
+    psi.CollapseQubit(q, measurement);
+    normalizeState(psi, accumulate_in_double);
+    return measurement;
+  }
+
+  std::size_t numAmplitudes() { return psi.LocalSize(); }
+  std::complex<double> amplitude(std::size_t i) { return std::complex<double>(psi[i]); }
+  double probability(unsigned q) { return qubitProbability(psi, q, accumulate_in_double); }
+};
+
+
+struct PrecisionRun {
+  double seconds;
+  std::vector<std::complex<double>> amplitudes;
+  std::vector<double> probabilities;
+};
+
+// Runs `kernel` `repetitions` times on a fresh device of `precision`; the
+// kernel prepares its qubits, so every run starts from |0...0>. Returns the
+// fastest time and the final state.
+PrecisionRun runKernel(const PrecisionKernel &kernel, Precision precision, unsigned repetitions) {
+  iqsdk::CustomSimulator *custom_simulator =
+      precision == Precision::Double
+          ? iqsdk::CustomSimulator::createSimulator<PrecisionBackend<ComplexDP>>(
+                "precision_custom_device", kernel.num_qubits, false)
+          : iqsdk::CustomSimulator::createSimulator<PrecisionBackend<ComplexSP>>(
+                "precision_custom_device", kernel.num_qubits, precision == Precision::Mixed);
+  iqsdk::QRT_ERROR_T status = custom_simulator->ready();
+  assert(status == iqsdk::QRT_ERROR_SUCCESS);
+  PrecisionDevice *device = dynamic_cast<PrecisionDevice *>(custom_simulator->getCustomBackend());
+  assert(device != nullptr);
+
+  PrecisionRun run{0, {}, {}};
+  for (unsigned r = 0; r < repetitions; r++) {
+    Stopwatch stopwatch;
+    kernel.run();
+    double seconds = stopwatch.seconds();
+    run.seconds = r == 0 ? seconds : std::min(run.seconds, seconds);
+  }
+  for (std::size_t i = 0; i < device->numAmplitudes(); i++)
+    run.amplitudes.push_back(device->amplitude(i));
+  for (unsigned q = 0; q < kernel.num_qubits; q++)
+    run.probabilities.push_back(device->probability(q));
+  delete custom_simulator;
+  return run;
+}
+
+// 1 - |<reference|psi>|^2, summed in double over the normalized states.
+double fidelityError(const std::vector<std::complex<double>> &reference,
+                     const std::vector<std::complex<double>> &psi) {
+  std::complex<double> overlap = 0;
+  double norm_reference = 0, norm_psi = 0;
+  for (std::size_t i = 0; i < reference.size(); i++) {
+    overlap += std::conj(reference[i]) * psi[i];
+    norm_reference += std::norm(reference[i]);
+    norm_psi += std::norm(psi[i]);
+  }
+  return std::max(0.0, 1 - std::norm(overlap) / (norm_reference * norm_psi));
+}
+
+
+// Usage: precision_benchmark [output_csv] [min_qubits] [max_qubits] [repetitions]
+// Runs every compiled kernel in [min_qubits, max_qubits] on double, single
+// and mixed precision backends and writes one CSV row per (kernel, qubits,
+// precision): state bytes, best time, speedup over double, infidelity
+// against the double result, and the largest single-qubit probability
+// error, which also shows what double accumulation buys.
+int main(int argc, char *argv[]) {
+  std::string output = argc > 1 ? argv[1] : "results/precision_benchmark/precision.csv";
+  unsigned min_qubits = argc > 2 ? std::atoi(argv[2]) : 12;
+  unsigned max_qubits_run = argc > 3 ? std::atoi(argv[3]) : 24;
+  unsigned repetitions = argc > 4 ? std::max(1, std::atoi(argv[4])) : 3;
+
+  std::filesystem::path parent = std::filesystem::path(output).parent_path();
+  if (!parent.empty())
+    std::filesystem::create_directories(parent);
+  std::ofstream report(output);
+  if (!report) {
+    std::cerr << "Error: Unable to open " << output << std::endl;
+    return 1;
+  }
+  report << "kernel,num_qubits,precision,state_bytes,seconds,speedup,fidelity_error,"
+            "max_probability_error\n";
+
+  std::cout << "kernel\tqubits\tprecision\tseconds\tspeedup\tinfidelity\tmax prob error"
+            << std::endl;
+  for (const PrecisionKernel &kernel : allKernels<8, 12, 16, 20, 22, 24, 26, 28>()) {
+    if (kernel.num_qubits < min_qubits || kernel.num_qubits > max_qubits_run)
+      continue;
+    PrecisionRun reference = runKernel(kernel, Precision::Double, repetitions);
+    for (Precision precision : {Precision::Double, Precision::Single, Precision::Mixed}) {
+      PrecisionRun run = precision == Precision::Double
+                             ? reference : runKernel(kernel, precision, repetitions);
+      double probability_error = 0;
+      for (unsigned q = 0; q < kernel.num_qubits; q++)
+        probability_error = std::max(probability_error,
+                                     std::abs(run.probabilities[q] - reference.probabilities[q]));
+      const double state_bytes = double(run.amplitudes.size()) *
+                                 (precision == Precision::Double ? sizeof(ComplexDP) : sizeof(ComplexSP));
+      const double speedup = reference.seconds / run.seconds;
+      const double infidelity = fidelityError(reference.amplitudes, run.amplitudes);
+
+      char numbers[128];
+      std::snprintf(numbers, sizeof(numbers), "%.0f,%.6e,%.4f,%.6e,%.6e", state_bytes,
+                    run.seconds, speedup, infidelity, probability_error);
+      report << kernel.name << ',' << kernel.num_qubits << ',' << precisionName(precision) << ','
+             << numbers << '\n';
+      std::cout << kernel.name << "\t" << kernel.num_qubits << "\t" << precisionName(precision)
+                << "\t" << run.seconds << "\t" << speedup << "\t" << infidelity << "\t"
+                << probability_error << std::endl;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,596 @@
+#include <clang/Quantum/quintrinsics.h>
+
+#include <quantum_custom_backend.h>
+#include <qureg.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "include/benchmark.h"
+#include "include/diagonal_batch.h"
+#include "include/gate_fusion.h"
+#include "include/state_pool.h"
+#include "include/state_vector.h"
+
+
+// CustomInterface on the SIMD state vector of include/state_vector.h, plus
+// a per-gate benchmark of its kernels against iqs::QubitRegister, the engine
+// CustomBackend in custom_backend.cpp delegates to, and a benchmark of
+// random circuits and a QFT with and without gate fusion
+// (include/gate_fusion.h) and diagonal batching (include/diagonal_batch.h),
+// and of per-shot state setup: a fresh allocation, a pooled buffer
+// (include/state_pool.h) or a reset of the same one.
+
+const int N = 3;
+qbit q[N];
+cbit c[N];
+
+// Same circuit as custom_backend.cpp.
+quantum_kernel void mbl_q3_1ts() {
+  for (int i = 0; i < N; i++) {
+    PrepZ(q[i]);
+  }
+
+  X(q[0]);
+  X(q[2]);
+
+  CNOT(q[0], q[1]);
+  RZ(q[0], 9.563581772879);
+  RZ(q[1], 8.0);
+  H(q[0]);
+  CNOT(q[0], q[1]);
+  RZ(q[0], 8.0);
+  RZ(q[1], -8.0);
+  CNOT(q[0], q[1]);
+  H(q[0]);
+  CNOT(q[0], q[1]);
+
+  RZ(q[2], 1.415202001624);
+  CNOT(q[1], q[2]);
+  RZ(q[1], 7.070381830323);
+  RZ(q[2], 8.0);
+  H(q[1]);
+  CNOT(q[1], q[2]);
+  RZ(q[1], 8.0);
+  RZ(q[2], -8.0);
+  CNOT(q[1], q[2]);
+  H(q[1]);
+  CNOT(q[1], q[2]);
+
+  RX(q[0], 4.94709917593);
+  RX(q[1], 5.041840372001);
+  RX(q[2], 2.56278001524);
+}
+
+
+const unsigned k_fusion_qubits = 2;
+
+// Registers and shots of the per-shot setup benchmark.
+const unsigned k_shot_qubits[] = {4, 8, 12, 16};
+const unsigned k_shots = 2000;
+
+void applyBlock(StateVector &psi, const std::vector<unsigned> &qubits, const ComplexMatrix &m) {
+  psi.applyMatrix(qubits.data(), qubits.size(), m.data());
+}
+
+// Gates reach psi through two queues: `fusion` multiplies gates into dense
+// blocks of up to fusion_qubits qubits, and `diagonal` collects RZ and
+// CPhase into one phase polynomial. The pending state is psi after the
+// fused block and then the batch, so a diagonal gate can always join the
+// batch (it joins the block instead if that does not make the block flush),
+// while a non-diagonal gate flushes the batch only if it shares a qubit
+// with it.
+// Measurement commutes with the batch and only flushes the block. Call
+// flush() before reading psi.
+//
+// A qubit no non-diagonal gate has touched since construction or reset()
+// is still |0>, so PrepZ and MeasZ on it skip the sweeps: a shot that
+// starts with reset() prepares its register for the cost of one memset.
+class SimdBackend : public iqsdk::CustomInterface {
+public:
+  StateVector psi;
+  GateFusion fusion;
+  DiagonalBatch diagonal;
+  bool batch_diagonal;
+  std::mt19937_64 rng;
+  std::uniform_real_distribution<double> uniform;
+
+  // With a `pool`, psi's buffers come from it and go back to it.
+  SimdBackend(int num_qubits, std::uint64_t seed = 0, SimdLevel level = detectSimdLevel(),
+              unsigned fusion_qubits = k_fusion_qubits, bool batch_diagonal = true,
+              StatePool *pool = nullptr)
+      : psi(pool ? StateVector(num_qubits, *pool, level) : StateVector(num_qubits, level)),
+        fusion([this](const std::vector<unsigned> &qubits,
+                      const ComplexMatrix &m) { applyBlock(psi, qubits, m); },
+               fusion_qubits),
+        diagonal([this](const PhasePolynomial &p) { psi.applyPhasePolynomial(p); }),
+        batch_diagonal(batch_diagonal), rng(seed), prepared(num_qubits, true) {}
+
+  // Back to |0...0> for the next shot, dropping pending gates.
+  void reset() {
+    fusion.clear();
+    diagonal.clear();
+    psi.reset();
+    prepared.assign(prepared.size(), true);
+  }
+
+  void RXY(qbit q, double phi, double gamma) { addGate(q, rotationXYMatrix(phi, gamma)); }
+
+  void RZ(qbit q, double angle) {
+    if (batch_diagonal && !fits(q, q))
+      diagonal.addRotationZ(q, angle);
+    else
+      fusion.add(q, rotationZMatrix(angle));
+  }
+
+  void CPhase(qbit ctrl, qbit target, double angle) {
+    if (batch_diagonal && !fits(ctrl, target))
+      diagonal.addCPhase(ctrl, target, angle);
+    else
+      fusion.add(ctrl, target, cphaseMatrix(angle));
+  }
+
+  void SwapA(qbit q1, qbit q2, double angle) { addGate(q1, q2, swapAMatrix(angle)); }
+
+  // Measure, then flip |1> back to |0>.
+  void PrepZ(qbit q) {
+    static const ComplexMatrix x = {0, 1, 1, 0};
+    // One draw either way, as MeasZ below would make.
+    if (prepared[q]) {
+      uniform(rng);
+      return;
+    }
+    if (MeasZ(q))
+      addGate(q, x);
+    prepared[q] = true;
+  }
+
+  cbit MeasZ(qbit q) {
+    // Draw anyway, so the random stream does not depend on the shortcut
+    // (here or in PrepZ).
+    if (prepared[q]) {
+      uniform(rng);
+      return false;
+    }
+    fusion.flush();
+    double probability = psi.getProbability(q);
+    bool measurement = uniform(rng) <= probability;
+    psi.collapse(q, measurement, measurement ? probability : 1 - probability);
+    return measurement;
+  }
+
+  void flush() {
+    fusion.flush();
+    diagonal.flush();
+  }
+
+private:
+  // Whether a gate on q1 and q2 (equal for one qubit) joins the pending
+  // block without flushing it.
+  bool fits(unsigned q1, unsigned q2) const {
+    const std::vector<unsigned> &pending = fusion.pendingQubits();
+    auto added = [&](unsigned q) {
+      return std::find(pending.begin(), pending.end(), q) == pending.end();
+    };
+    return pending.size() + added(q1) + (q2 != q1 && added(q2)) <= fusion.maxQubits();
+  }
+
+  // A non-diagonal gate.
+  void addGate(unsigned q, const ComplexMatrix &m) {
+    if (diagonal.touches(q))
+      flush();
+    fusion.add(q, m);
+    prepared[q] = false;
+  }
+
+  void addGate(unsigned q1, unsigned q2, const ComplexMatrix &m) {
+    if (diagonal.touches(q1) || diagonal.touches(q2))
+      flush();
+    fusion.add(q1, q2, m);
+    prepared[q1] = prepared[q2] = false;
+  }
+
+  // Whether each qubit is known to be |0>.
+  std::vector<bool> prepared;
+};
+
+
+//===----------------------------------------------------------------------===//
+// Per-gate benchmark
+
+enum class GateKind { RotationXY, RotationZ, CPhase, SwapA };
+const char *const k_gate_names[] = {"rxy", "rz", "cphase", "swapa"};
+
+struct GateCase {
+  GateKind kind;
+  unsigned q1, q2;
+  double angle;
+};
+
+void applyGate(iqs::QubitRegister<ComplexDP> &psi, const GateCase &gate) {
+  switch (gate.kind) {
+  case GateKind::RotationXY:
+    psi.ApplyRotationXY(gate.q1, gate.angle, 0.5 * gate.angle);
+    break;
+  case GateKind::RotationZ:
+    psi.ApplyRotationZ(gate.q1, gate.angle);
+    break;
+  case GateKind::CPhase:
+    psi.ApplyCPhaseRotation(gate.q1, gate.q2, -gate.angle);
+    break;
+  case GateKind::SwapA: {
+    iqs::TinyMatrix<ComplexDP, 2, 2, 32> gate_matrix;
+    gate_matrix(0, 0) = gate_matrix(1, 1) = {0.5 * (1.0 + std::cos(gate.angle)),
+                                             0.5 * std::sin(gate.angle)};
+    gate_matrix(0, 1) = gate_matrix(1, 0) = {0.5 * (1.0 - std::cos(gate.angle)),
+                                             -0.5 * std::sin(gate.angle)};
+    psi.ApplyISwapRotation(gate.q1, gate.q2, gate_matrix);
+    break;
+  }
+  }
+}
+
+void applyGate(StateVector &psi, const GateCase &gate) {
+  switch (gate.kind) {
+  case GateKind::RotationXY:
+    psi.applyRotationXY(gate.q1, gate.angle, 0.5 * gate.angle);
+    break;
+  case GateKind::RotationZ:
+    psi.applyRotationZ(gate.q1, gate.angle);
+    break;
+  case GateKind::CPhase:
+    psi.applyCPhase(gate.q1, gate.q2, gate.angle);
+    break;
+  case GateKind::SwapA:
+    psi.applySwapA(gate.q1, gate.q2, gate.angle);
+    break;
+  }
+}
+
+// Through the queues of the backend; flush() before reading its state.
+void applyGate(SimdBackend &backend, const GateCase &gate) {
+  switch (gate.kind) {
+  case GateKind::RotationXY:
+    backend.RXY(gate.q1, gate.angle, 0.5 * gate.angle);
+    break;
+  case GateKind::RotationZ:
+    backend.RZ(gate.q1, gate.angle);
+    break;
+  case GateKind::CPhase:
+    backend.CPhase(gate.q1, gate.q2, gate.angle);
+    break;
+  case GateKind::SwapA:
+    backend.SwapA(gate.q1, gate.q2, gate.angle);
+    break;
+  }
+}
+
+// A layer of rotations, so the state is dense, then uniformly random gates.
+std::vector<GateCase> randomGates(unsigned num_qubits, unsigned num_gates, std::mt19937_64 &rng) {
+  std::uniform_real_distribution<double> angle(0, 2 * M_PI);
+  std::vector<GateCase> gates;
+  for (unsigned g = 0; g < num_gates; g++) {
+    unsigned q1 = rng() % num_qubits, q2 = (q1 + 1 + rng() % (num_qubits - 1)) % num_qubits;
+    GateKind kind = g < num_qubits ? GateKind::RotationXY : GateKind(rng() % 4);
+    gates.push_back({kind, g < num_qubits ? g : q1, q2, angle(rng)});
+  }
+  return gates;
+}
+
+// Runs of 4 to 8 random gates on one neighbouring pair at a time, the shape
+// of the Trotter steps in mbl_q3_1ts.
+std::vector<GateCase> pairRuns(unsigned num_qubits, unsigned num_gates, std::mt19937_64 &rng) {
+  std::uniform_real_distribution<double> angle(0, 2 * M_PI);
+  std::vector<GateCase> gates;
+  while (gates.size() < num_gates) {
+    unsigned q = rng() % (num_qubits - 1);
+    for (unsigned length = 4 + rng() % 5; length > 0 && gates.size() < num_gates; length--) {
+      GateKind kind = GateKind(rng() % 4);
+      unsigned q1 = q + rng() % 2;
+      gates.push_back({kind, q1, q1 == q ? q + 1 : q, angle(rng)});
+    }
+  }
+  return gates;
+}
+
+// The QFT without the final swaps: a rotation on each qubit, then a CPhase
+// from every higher qubit, by pi / 2^distance.
+std::vector<GateCase> qftGates(unsigned num_qubits) {
+  std::vector<GateCase> gates;
+  for (unsigned i = 0; i < num_qubits; i++) {
+    gates.push_back({GateKind::RotationXY, i, i, M_PI});
+    for (unsigned j = i + 1; j < num_qubits; j++)
+      gates.push_back({GateKind::CPhase, j, i, std::ldexp(M_PI, -int(j - i))});
+  }
+  return gates;
+}
+
+// One measured GHZ shot through the CustomInterface methods, H being RZ(pi)
+// then RY(pi / 2) and CNOT being H CZ H on the target. Returns whether all
+// outcomes agree, as they must.
+bool ghzShot(SimdBackend &backend, unsigned num_qubits) {
+  auto h = [&](unsigned q) {
+    backend.RZ(q, M_PI);
+    backend.RXY(q, M_PI / 2, M_PI / 2);
+  };
+  for (unsigned q = 0; q < num_qubits; q++)
+    backend.PrepZ(q);
+  h(0);
+  for (unsigned q = 1; q < num_qubits; q++) {
+    h(q);
+    backend.CPhase(q - 1, q, M_PI);
+    h(q);
+  }
+  unsigned ones = 0;
+  for (unsigned q = 0; q < num_qubits; q++)
+    ones += backend.MeasZ(q);
+  return ones == 0 || ones == num_qubits;
+}
+
+// Largest amplitude difference between the two engines after `gates`, for
+// every SIMD level, applied gate by gate and through SimdBackend with every
+// fusion size, with and without diagonal batching.
+double crossCheck(unsigned num_qubits, const std::vector<GateCase> &gates) {
+  iqs::QubitRegister<ComplexDP> reference(num_qubits, "base", 0);
+  for (const GateCase &gate : gates)
+    applyGate(reference, gate);
+
+  double error = 0;
+  auto compare = [&](const StateVector &psi) {
+    for (std::size_t i = 0; i < psi.numAmplitudes(); i++)
+      error = std::max(error, std::abs(psi[i] - std::complex<double>(reference[i])));
+  };
+  for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::Avx2, SimdLevel::Avx512}) {
+    if (level > detectSimdLevel())
+      continue;
+    StateVector psi(num_qubits, level);
+    for (const GateCase &gate : gates)
+      applyGate(psi, gate);
+    compare(psi);
+
+    for (unsigned fusion_qubits = 1; fusion_qubits <= 3; fusion_qubits++)
+      for (bool batch_diagonal : {false, true}) {
+        SimdBackend backend(num_qubits, 0, level, fusion_qubits, batch_diagonal);
+        for (const GateCase &gate : gates)
+          applyGate(backend, gate);
+        backend.flush();
+        compare(backend.psi);
+      }
+  }
+  return error;
+}
+
+// Target qubits: the three lowest (which share a SIMD vector with their
+// partner amplitudes), the middle and the highest one.
+std::vector<GateCase> gateCases(unsigned num_qubits) {
+  std::vector<unsigned> targets = {0, 1, 2, num_qubits / 2, num_qubits - 1};
+  std::sort(targets.begin(), targets.end());
+  targets.erase(std::unique(targets.begin(), targets.end()), targets.end());
+
+  std::vector<GateCase> cases;
+  for (GateKind kind : {GateKind::RotationXY, GateKind::RotationZ, GateKind::CPhase, GateKind::SwapA}) {
+    for (unsigned target : targets) {
+      if (target >= num_qubits)
+        continue;
+      // Two-qubit gates pair the target with its neighbour.
+      unsigned partner = target + 1 < num_qubits ? target + 1 : target - 1;
+      cases.push_back({kind, target, partner, 0.37});
+    }
+  }
+  return cases;
+}
+
+template <typename Engine>
+BenchmarkRecord timeGate(Engine &psi, const GateCase &gate, unsigned repetitions) {
+  BenchmarkRecord record;
+  record.num_gates = repetitions;
+  record.num_shots = 1;
+  applyGate(psi, gate); // warm-up
+  Stopwatch stopwatch;
+  for (unsigned r = 0; r < repetitions; r++)
+    applyGate(psi, gate);
+  record.wall_seconds = stopwatch.seconds();
+  return record;
+}
+
+
+// Usage: simd_backend [output_csv] [min_qubits] [max_qubits] [repetitions]
+// Runs mbl_q3_1ts on the SIMD custom backend, cross-checks the kernels
+// against QubitRegister, then writes one CSV row per (gate and target,
+// engine, qubit count) with the time of `repetitions` applications, so
+// gates_per_second is the per-gate throughput. Then times `repetitions`
+// gates of pairRuns and a QFT on the widest kernels, gate by gate
+// ("pair_runs", "qft") and through SimdBackend with blocks of up to k qubits
+// ("<circuit>_fused<k>"), plus diagonal batching ("<circuit>_fused2_batched").
+// Last, k_shots measured GHZ shots on a few small registers, each on a
+// freshly allocated backend ("ghz_shots_fresh"), on one built from a
+// StatePool ("ghz_shots_pooled"), and on one backend reset between shots
+// ("ghz_shots_reset").
+// Set OMP_NUM_THREADS=1 to compare single cores; the SIMD kernels do not
+// thread.
+int main(int argc, char *argv[]) {
+  std::string output = argc > 1 ? argv[1] : "results/simd_backend/gates.csv";
+  unsigned min_qubits = argc > 2 ? std::atoi(argv[2]) : 20;
+  unsigned max_qubits = argc > 3 ? std::atoi(argv[3]) : 26;
+  unsigned repetitions = argc > 4 ? std::atoi(argv[4]) : 20;
+
+  iqsdk::CustomSimulator *custom_simulator =
+      iqsdk::CustomSimulator::createSimulator<SimdBackend>("simd_custom_device", N);
+  iqsdk::QRT_ERROR_T status = custom_simulator->ready();
+  assert(status == iqsdk::QRT_ERROR_SUCCESS);
+  SimdBackend *simd_backend = dynamic_cast<SimdBackend *>(custom_simulator->getCustomBackend());
+  assert(simd_backend != nullptr);
+  mbl_q3_1ts();
+  simd_backend->flush();
+
+  std::cout << "Single qubit probabilities (" << simdLevelName(simd_backend->psi.simdLevel())
+            << " kernels, " << simd_backend->fusion.numGates() << " gates in "
+            << simd_backend->fusion.numBlocks() << " fused blocks, "
+            << simd_backend->diagonal.numGates() << " in "
+            << simd_backend->diagonal.numSweeps() << " diagonal sweeps)" << std::endl;
+  for (int i = 0; i < N; ++i)
+    std::cout << "q[" << i << "] = " << simd_backend->psi.getProbability(i) << std::endl;
+  delete custom_simulator;
+
+  std::mt19937_64 rng(12345);
+  double error = std::max({crossCheck(10, randomGates(10, 500, rng)),
+                           crossCheck(10, pairRuns(10, 500, rng)),
+                           crossCheck(12, qftGates(12))});
+  std::cout << "Max amplitude difference to QubitRegister: " << error << std::endl;
+  if (error > 1e-10) {
+    std::cerr << "Error: SIMD kernels disagree with QubitRegister" << std::endl;
+    return 1;
+  }
+
+  BenchmarkReport report(output);
+  if (!report.isOpen()) {
+    std::cerr << "Error: Unable to open " << output << std::endl;
+    return 1;
+  }
+
+  std::cout << "gate\tqubits\ttarget\tqubit_register_ns\tsimd_ns\tspeedup" << std::endl;
+  for (unsigned n = min_qubits; n <= max_qubits; n++) {
+    std::vector<GateCase> cases = gateCases(n);
+    std::vector<double> baseline(cases.size()), best(cases.size(), INFINITY);
+
+    // One engine alive at a time: at 30 qubits each takes 16 GiB.
+    auto add = [&](BenchmarkRecord record, std::size_t i, const std::string &backend) {
+      const GateCase &gate = cases[i];
+      record.label = "simd_backend";
+      record.kernel = std::string(k_gate_names[int(gate.kind)]) + "_q" + std::to_string(gate.q1);
+      record.backend = backend;
+      record.num_qubits = n;
+      report.add(record);
+      return record.wall_seconds / repetitions;
+    };
+    {
+      iqs::QubitRegister<ComplexDP> psi(n, "base", 0);
+      for (std::size_t i = 0; i < cases.size(); i++)
+        baseline[i] = add(timeGate(psi, cases[i], repetitions), i, "qubit_register");
+    }
+    for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::Avx2, SimdLevel::Avx512}) {
+      if (level > detectSimdLevel())
+        continue;
+      StateVector psi(n, level);
+      std::string backend = std::string("simd_") + simdLevelName(level);
+      for (std::size_t i = 0; i < cases.size(); i++)
+        best[i] = std::min(best[i], add(timeGate(psi, cases[i], repetitions), i, backend));
+    }
+
+    for (std::size_t i = 0; i < cases.size(); i++)
+      std::cout << k_gate_names[int(cases[i].kind)] << "\t" << n << "\t" << cases[i].q1
+                << "\t" << baseline[i] * 1e9 << "\t" << best[i] * 1e9 << "\t"
+                << baseline[i] / best[i] << std::endl;
+  }
+
+  // Whole circuits through SimdBackend, against the same gates applied one
+  // by one to a bare StateVector.
+  struct Variant {
+    std::string name;
+    unsigned fusion_qubits;
+    bool batch_diagonal;
+  };
+  const Variant variants[] = {
+      {"fused1", 1, false}, {"fused2", 2, false}, {"fused3", 3, false}, {"fused2_batched", 2, true}};
+  std::cout << "circuit\tqubits\tgate_by_gate_ns";
+  for (const Variant &variant : variants)
+    std::cout << "\t" << variant.name << "_ns";
+  std::cout << "\tsweeps/gates (" << variants[3].name << ")" << std::endl;
+  for (unsigned n = min_qubits; n <= max_qubits; n++) {
+    for (std::string circuit : {"pair_runs", "qft"}) {
+      std::vector<GateCase> gates = circuit == "qft" ? qftGates(n) : pairRuns(n, repetitions, rng);
+      auto add = [&](double seconds, const std::string &kernel, SimdLevel level) {
+        BenchmarkRecord record;
+        record.label = "simd_backend";
+        record.kernel = kernel;
+        record.backend = std::string("simd_") + simdLevelName(level);
+        record.num_qubits = n;
+        record.num_gates = gates.size();
+        record.num_shots = 1;
+        record.wall_seconds = seconds;
+        report.add(record);
+        return seconds / gates.size();
+      };
+
+      {
+        StateVector psi(n);
+        Stopwatch stopwatch;
+        for (const GateCase &gate : gates)
+          applyGate(psi, gate);
+        std::cout << circuit << "\t" << n << "\t"
+                  << add(stopwatch.seconds(), circuit, psi.simdLevel()) * 1e9;
+      }
+      std::size_t sweeps = 0;
+      for (const Variant &variant : variants) {
+        SimdBackend backend(n, 0, detectSimdLevel(), variant.fusion_qubits, variant.batch_diagonal);
+        Stopwatch stopwatch;
+        for (const GateCase &gate : gates)
+          applyGate(backend, gate);
+        backend.flush();
+        double seconds = stopwatch.seconds();
+        std::cout << "\t" << add(seconds, circuit + "_" + variant.name, backend.psi.simdLevel()) * 1e9;
+        sweeps = backend.fusion.numBlocks() + backend.diagonal.numSweeps();
+      }
+      std::cout << "\t" << sweeps << "/" << gates.size() << std::endl;
+    }
+  }
+
+  // Per-shot setup, which dominates small registers.
+  std::cout << "shots\tqubits\tfresh_ns\tpooled_ns\treset_ns" << std::endl;
+  bool shots_ok = true;
+  for (unsigned n : k_shot_qubits) {
+    auto add = [&](double seconds, const std::string &variant, SimdLevel level) {
+      BenchmarkRecord record;
+      record.label = "simd_backend";
+      record.kernel = "ghz_shots_" + variant;
+      record.backend = std::string("simd_") + simdLevelName(level);
+      record.num_qubits = n;
+      record.num_gates = 2 * n;
+      record.num_shots = k_shots;
+      record.wall_seconds = seconds;
+      report.add(record);
+      return seconds / k_shots;
+    };
+    std::cout << k_shots << "\t" << n;
+    {
+      Stopwatch stopwatch;
+      for (unsigned s = 0; s < k_shots; s++) {
+        SimdBackend backend(n, s);
+        shots_ok &= ghzShot(backend, n);
+      }
+      std::cout << "\t" << add(stopwatch.seconds(), "fresh", detectSimdLevel()) * 1e9;
+    }
+    {
+      StatePool pool(std::size_t(1) << n, 2);
+      Stopwatch stopwatch;
+      for (unsigned s = 0; s < k_shots; s++) {
+        SimdBackend backend(n, s, detectSimdLevel(), k_fusion_qubits, true, &pool);
+        shots_ok &= ghzShot(backend, n);
+      }
+      std::cout << "\t" << add(stopwatch.seconds(), "pooled", detectSimdLevel()) * 1e9;
+    }
+    {
+      SimdBackend backend(n);
+      Stopwatch stopwatch;
+      for (unsigned s = 0; s < k_shots; s++) {
+        backend.reset();
+        shots_ok &= ghzShot(backend, n);
+      }
+      std::cout << "\t" << add(stopwatch.seconds(), "reset", backend.psi.simdLevel()) * 1e9
+                << std::endl;
+    }
+  }
+  if (!shots_ok) {
+    std::cerr << "Error: a GHZ shot gave disagreeing outcomes" << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,380 @@
+#include <clang/Quantum/quintrinsics.h>
+
+#include <quantum.hpp>
+#include <quantum_clifford_simulator_backend.h>
+#include <quantum_custom_backend.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "include/benchmark.h"
+#include "include/stabilizer_tableau.h"
+#include "include/state_vector.h"
+
+
+// CustomInterface on the bit-packed stabilizer tableau of
+// include/stabilizer_tableau.h, cross-checked against the state vector of
+// include/state_vector.h and benchmarked against the SDK's Clifford
+// simulator on GHZ and repetition-code kernels of up to 255 qubits.
+
+const int max_qubits = 255;
+qbit qubit_register[max_qubits];
+cbit cbit_register[max_qubits];
+
+
+//===----------------------------------------------------------------------===//
+// Kernels, as in benchmark.cpp.
+
+template <unsigned n> quantum_kernel void ghzState() {
+  for (int i = 0; i < n; i++)
+    PrepZ(qubit_register[i]);
+  H(qubit_register[0]);
+  for (int i = 0; i < n - 1; i++)
+    CNOT(qubit_register[i], qubit_register[i + 1]);
+}
+
+template <unsigned n> quantum_kernel void ghzStabilizer() {
+  ghzState<n>();
+  for (int i = 0; i < n; i++)
+    MeasZ(qubit_register[i], cbit_register[i]);
+}
+
+constexpr unsigned ghzGates(unsigned n) { return n + 1 + (n - 1) + n; }
+
+// Repetition code of rep_code_clifford.cpp: distance (n + 1) / 2 on
+// 2 * distance - 1 qubits, data qubits first, then the ancillas.
+template <unsigned n> quantum_kernel void repCodeStabilizer() {
+  const int distance = (n + 1) / 2;
+  for (int i = 0; i < distance; i++)
+    PrepZ(qubit_register[i]);
+  for (int i = 0; i < distance - 1; i++) {
+    PrepZ(qubit_register[distance + i]);
+    H(qubit_register[distance + i]);
+  }
+  for (int i = 0; i < distance - 1; i++)
+    CZ(qubit_register[i], qubit_register[distance + i]);
+  for (int i = 0; i < distance - 1; i++)
+    CZ(qubit_register[i + 1], qubit_register[distance + i]);
+  for (int i = 0; i < distance - 1; i++) {
+    H(qubit_register[distance + i]);
+    MeasZ(qubit_register[distance + i], cbit_register[distance + i]);
+  }
+  for (int i = 0; i < distance; i++)
+    MeasZ(qubit_register[i], cbit_register[i]);
+}
+
+constexpr unsigned repCodeQubits(unsigned n) { return 2 * ((n + 1) / 2) - 1; }
+constexpr unsigned repCodeGates(unsigned n) {
+  return (n + 1) / 2 * 2 + ((n + 1) / 2 - 1) * 6;
+}
+
+struct StabilizerKernel {
+  const char *name;
+  unsigned num_qubits;
+  unsigned num_gates;
+  void (*run)();
+};
+
+template <unsigned n> void addKernels(std::vector<StabilizerKernel> &kernels) {
+  kernels.push_back({"ghz", n, ghzGates(n), [] { ghzStabilizer<n>(); }});
+  kernels.push_back({"rep_code", repCodeQubits(n), repCodeGates(n),
+                     [] { repCodeStabilizer<n>(); }});
+}
+
+// Qubit counts compiled in; the command line picks a range.
+template <unsigned... sizes> std::vector<StabilizerKernel> allKernels() {
+  std::vector<StabilizerKernel> kernels;
+  (addKernels<sizes>(kernels), ...);
+  return kernels;
+}
+
+
+//===----------------------------------------------------------------------===//
+// Backend
+
+// Random measurement outcomes are fair coin flips from rng.
+class StabilizerBackend : public iqsdk::CustomInterface {
+public:
+  StabilizerTableau tableau;
+  std::mt19937_64 rng;
+
+  StabilizerBackend(int num_qubits, std::uint64_t seed = 0, SimdLevel level = detectSimdLevel())
+      : tableau(num_qubits, level), rng(seed) {}
+
+  void RXY(qbit q, double phi, double gamma) { tableau.applyRotationXY(q, phi, gamma); }
+
+  void RZ(qbit q, double angle) { tableau.applyRotationZ(q, angle); }
+
+  void CPhase(qbit ctrl, qbit target, double angle) { tableau.applyCPhase(ctrl, target, angle); }
+
+  void SwapA(qbit q1, qbit q2, double angle) { tableau.applySwapA(q1, q2, angle); }
+
+  void PrepZ(qbit q) { tableau.reset(q, rng() & 1); }
+
+  cbit MeasZ(qbit q) { return tableau.measure(q, rng() & 1); }
+
+  // As FullStateSimulator::getExpectationValue, on qubit indices: one of
+  // 'I', 'X', 'Y', 'Z' per qubit. +1 or -1 for a stabilizer, else 0.
+  double getExpectationValue(const std::vector<unsigned> &qubits, const std::string &pauli_string) {
+    return tableau.expectationValue(qubits, pauli_string);
+  }
+};
+
+
+//===----------------------------------------------------------------------===//
+// Cross-check
+
+enum class GateKind { RotationXY, RotationZ, CPhase, SwapA, Measure };
+
+struct GateCase {
+  GateKind kind;
+  unsigned q1, q2;
+  double angle1, angle2;
+};
+
+// Random Clifford gates and mid-circuit measurements, with angles that are
+// multiples of pi/2 (of pi for the two-qubit gates) up to 4 pi.
+std::vector<GateCase> randomCliffordGates(unsigned num_qubits, unsigned num_gates,
+                                          std::mt19937_64 &rng) {
+  auto quarter = [&] { return (int(rng() % 16) - 8) * M_PI_2; };
+  std::vector<GateCase> gates;
+  for (unsigned g = 0; g < num_gates; g++) {
+    GateKind kind = GateKind(rng() % 5);
+    unsigned q1 = rng() % num_qubits;
+    unsigned q2 = (q1 + 1 + rng() % (num_qubits - 1)) % num_qubits;
+    gates.push_back({kind, q1, q2, quarter(), quarter()});
+  }
+  return gates;
+}
+
+// <P> on psi, by summing conj(psi[P i]) phase psi[i].
+double pauliExpectation(const StateVector &psi, const std::vector<unsigned> &qubits,
+                        const std::string &paulis) {
+  std::complex<double> sum = 0;
+  for (std::size_t i = 0; i < psi.numAmplitudes(); i++) {
+    std::size_t j = i;
+    std::complex<double> phase = 1;
+    for (std::size_t k = 0; k < qubits.size(); k++) {
+      const std::size_t bit = std::size_t(1) << qubits[k];
+      if (paulis[k] == 'X' || paulis[k] == 'Y')
+        j ^= bit;
+      if (paulis[k] == 'Y')
+        phase *= (i & bit) ? std::complex<double>(0, -1) : std::complex<double>(0, 1);
+      if (paulis[k] == 'Z' && (i & bit))
+        phase = -phase;
+    }
+    sum += std::conj(psi[j]) * phase * psi[i];
+  }
+  return sum.real();
+}
+
+// Runs `gates` on a tableau at every SIMD level and on a state vector,
+// which takes the tableau's measurement outcomes, and compares outcome
+// determinism and the expectation values of random Pauli strings. Returns
+// the number of disagreements.
+unsigned crossCheck(unsigned num_qubits, const std::vector<GateCase> &gates, std::mt19937_64 &rng) {
+  unsigned mismatches = 0;
+  for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::Avx2}) {
+    if (level > detectSimdLevel())
+      continue;
+    StabilizerTableau tableau(num_qubits, level);
+    StateVector psi(num_qubits);
+    for (const GateCase &gate : gates) {
+      switch (gate.kind) {
+      case GateKind::RotationXY:
+        tableau.applyRotationXY(gate.q1, gate.angle1, gate.angle2);
+        psi.applyRotationXY(gate.q1, gate.angle1, gate.angle2);
+        break;
+      case GateKind::RotationZ:
+        tableau.applyRotationZ(gate.q1, gate.angle1);
+        psi.applyRotationZ(gate.q1, gate.angle1);
+        break;
+      case GateKind::CPhase:
+        tableau.applyCPhase(gate.q1, gate.q2, 2 * gate.angle1);
+        psi.applyCPhase(gate.q1, gate.q2, 2 * gate.angle1);
+        break;
+      case GateKind::SwapA:
+        tableau.applySwapA(gate.q1, gate.q2, 2 * gate.angle1);
+        psi.applySwapA(gate.q1, gate.q2, 2 * gate.angle1);
+        break;
+      case GateKind::Measure: {
+        const double probability = psi.getProbability(gate.q1);
+        bool random;
+        const bool outcome = tableau.measure(gate.q1, rng() & 1, &random);
+        if (random != (std::abs(probability - 0.5) < 1e-9) ||
+            (!random && outcome != (probability > 0.5)))
+          mismatches++;
+        psi.collapse(gate.q1, outcome, outcome ? probability : 1 - probability);
+        break;
+      }
+      }
+    }
+    for (unsigned trial = 0; trial < 100; trial++) {
+      std::vector<unsigned> qubits;
+      std::string paulis;
+      for (unsigned q = 0; q < num_qubits; q++) {
+        if (rng() % 2) {
+          qubits.push_back(q);
+          paulis += "IXYZ"[rng() % 4];
+        }
+      }
+      if (std::abs(tableau.expectationValue(qubits, paulis) -
+                   pauliExpectation(psi, qubits, paulis)) > 1e-9)
+        mismatches++;
+    }
+  }
+  return mismatches;
+}
+
+
+//===----------------------------------------------------------------------===//
+// Benchmark
+
+const std::vector<std::string> k_backends = {"stabilizer_scalar", "stabilizer_avx2", "clifford"};
+
+// Times `record.num_shots` shots of `kernel` on a fresh device; only the
+// shots are timed.
+void runPoint(const StabilizerKernel &kernel, BenchmarkRecord &record, std::uint64_t seed) {
+  resetPeakRss();
+  if (record.backend == "clifford") {
+    iqsdk::CliffordSimulator sim;
+    iqsdk::CliffordSimulatorConfig config(seed);
+    sim.initialize(config);
+    if (iqsdk::QRT_ERROR_SUCCESS != sim.ready()) {
+      record.status = "not_ready";
+      return;
+    }
+    Stopwatch stopwatch;
+    for (std::uint64_t shot = 0; shot < record.num_shots; shot++)
+      kernel.run();
+    record.wall_seconds = stopwatch.seconds();
+  } else {
+    const SimdLevel level = record.backend == "stabilizer_scalar" ? SimdLevel::Scalar
+                                                                  : SimdLevel::Avx2;
+    if (level > detectSimdLevel()) {
+      record.status = "unsupported_cpu";
+      return;
+    }
+    iqsdk::CustomSimulator *custom_simulator =
+        iqsdk::CustomSimulator::createSimulator<StabilizerBackend>(
+            "stabilizer_custom_device", kernel.num_qubits, seed, level);
+    if (iqsdk::QRT_ERROR_SUCCESS != custom_simulator->ready()) {
+      record.status = "not_ready";
+      delete custom_simulator;
+      return;
+    }
+    Stopwatch stopwatch;
+    for (std::uint64_t shot = 0; shot < record.num_shots; shot++)
+      kernel.run();
+    record.wall_seconds = stopwatch.seconds();
+    delete custom_simulator;
+  }
+  record.peak_rss_bytes = peakRssBytes();
+}
+
+
+// Usage: stabilizer_backend [output_csv] [min_qubits] [max_qubits] [shots]
+// Cross-checks the tableau against the state vector on random Clifford
+// circuits, prints GHZ expectation values from both the stabilizer backend
+// and the Clifford simulator, then writes one CSV row per (kernel, backend,
+// qubits) with the time of `shots` measured shots, see include/benchmark.h.
+int main(int argc, char *argv[]) {
+  std::string output = argc > 1 ? argv[1] : "results/stabilizer_backend/shots.csv";
+  unsigned min_qubits = argc > 2 ? std::atoi(argv[2]) : 15;
+  unsigned max_qubits_run = argc > 3 ? std::atoi(argv[3]) : max_qubits;
+  std::uint64_t shots = argc > 4 ? std::atoll(argv[4]) : 100;
+
+  std::mt19937_64 rng(12345);
+  unsigned mismatches = 0;
+  for (unsigned trial = 0; trial < 20; trial++)
+    mismatches += crossCheck(10, randomCliffordGates(10, 300, rng), rng);
+  std::cout << "Disagreements with StateVector: " << mismatches << std::endl;
+  if (mismatches) {
+    std::cerr << "Error: stabilizer tableau disagrees with StateVector" << std::endl;
+    return 1;
+  }
+
+  // GHZ on 8 qubits: ZZ on neighbours and X...X are +1, Y...Y is +1 since
+  // n is a multiple of 4, and a single Z or X...XY is 0.
+  const unsigned ghz_qubits = 8;
+  std::vector<unsigned> qubits(ghz_qubits);
+  std::vector<std::reference_wrapper<qbit>> qids;
+  for (unsigned q = 0; q < ghz_qubits; q++) {
+    qubits[q] = q;
+    qids.push_back(std::ref(qubit_register[q]));
+  }
+  const std::vector<std::string> pauli_strings = {"ZZIIIIII", "XXXXXXXX", "YYYYYYYY",
+                                                  "ZIIIIIII", "XXXXXXXY"};
+
+  iqsdk::CustomSimulator *custom_simulator =
+      iqsdk::CustomSimulator::createSimulator<StabilizerBackend>("stabilizer_custom_device",
+                                                                ghz_qubits);
+  iqsdk::QRT_ERROR_T status = custom_simulator->ready();
+  assert(status == iqsdk::QRT_ERROR_SUCCESS);
+  StabilizerBackend *backend =
+      dynamic_cast<StabilizerBackend *>(custom_simulator->getCustomBackend());
+  assert(backend != nullptr);
+  ghzState<ghz_qubits>();
+  std::vector<double> expectations;
+  for (const std::string &paulis : pauli_strings)
+    expectations.push_back(backend->getExpectationValue(qubits, paulis));
+  delete custom_simulator;
+
+  iqsdk::CliffordSimulator clifford_sim;
+  iqsdk::CliffordSimulatorConfig clifford_config(1);
+  clifford_sim.initialize(clifford_config);
+  status = clifford_sim.ready();
+  assert(status == iqsdk::QRT_ERROR_SUCCESS);
+  ghzState<ghz_qubits>();
+  std::cout << "pauli\tstabilizer\tclifford" << std::endl;
+  for (std::size_t i = 0; i < pauli_strings.size(); i++) {
+    std::string paulis = pauli_strings[i];
+    std::cout << paulis << "\t" << expectations[i] << "\t"
+              << clifford_sim.getExpectationValue(qids, paulis) << std::endl;
+  }
+
+  BenchmarkReport report(output);
+  if (!report.isOpen()) {
+    std::cerr << "Error: Unable to open " << output << std::endl;
+    return 1;
+  }
+
+  std::cout << "kernel\tqubits\tbackend\tshots_per_second\tspeedup" << std::endl;
+  for (const StabilizerKernel &kernel : allKernels<15, 31, 63, 127, 255>()) {
+    if (kernel.num_qubits < min_qubits || kernel.num_qubits > max_qubits_run)
+      continue;
+    std::vector<double> seconds;
+    for (const std::string &backend_name : k_backends) {
+      BenchmarkRecord record;
+      record.label = "stabilizer_backend";
+      record.kernel = kernel.name;
+      record.backend = backend_name;
+      record.num_qubits = kernel.num_qubits;
+      record.num_gates = kernel.num_gates;
+      record.num_shots = shots;
+      runPoint(kernel, record, 1);
+      report.add(record);
+      seconds.push_back(record.status == "ok" ? record.wall_seconds : 0);
+    }
+    // Speedups are over the Clifford simulator.
+    for (std::size_t b = 0; b < k_backends.size(); b++) {
+      if (seconds[b] == 0)
+        continue;
+      std::cout << kernel.name << "\t" << kernel.num_qubits << "\t" << k_backends[b] << "\t"
+                << shots / seconds[b] << "\t";
+      if (seconds.back() > 0)
+        std::cout << seconds.back() / seconds[b];
+      std::cout << std::endl;
+    }
+  }
+  return 0;
+}
@@ -2,7 +2,7 @@ import intelqsdk.cbindings as iqsdk
 import pandas as pd
 
 from run import SDKManager
-from state import cbits_to_state, bucket_state_n
+from state import count_bucket_shots
 
 from globals import RESULTS_FOLDER
 
@@ -32,18 +32,19 @@ def depolarizing_rate(
 	for num_qubits in range(1, max_qubits + 1):
 		print(f"{num_qubits}-Qubit Samples...")
 		iqs_config.num_qubits = num_qubits
-		bucket_states = bucket_state_n(num_qubits)
 
 		for depolarizing_rate in depolarizing_rates:
 			print(f"{depolarizing_rate * 100}%")
 			iqs_config.depolarizing_rate = depolarizing_rate
 			sdk_manager.configure(iqs_config)
 
-			count = 0
-			for _ in range(num_samples):
-				sdk_manager.run(f"ghzM_{num_qubits}")
-				state = cbits_to_state(sdk_manager.cbits, num_qubits)
-				count += state in bucket_states
+			shots = sdk_manager.run_batch(f"ghzM_{num_qubits}", num_samples)
+			if shots is None:
+				raise RuntimeError(
+					f"{sdk_name}: device not ready for {num_qubits} qubits"
+					f" at depolarizing rate {depolarizing_rate}"
+				)
+			count = count_bucket_shots(shots, num_qubits)
 
 			yield {
 				"num_qubits": num_qubits,
@@ -1,6 +1,6 @@
 import intelqsdk.cbindings as iqsdk
 
-from prep import compileAndLoad
+from prep import compileAndLoad, library
 
 
 SDK_NAME = "ghz"
@@ -24,7 +24,9 @@ iqs_device = iqsdk.FullStateSimulator(iqs_config)
 iqs_device.ready()
 
 
-iqsdk.callCppFunction(f"ghz_{iqs_config.num_qubits}", SDK_NAME)
+# ghz.cpp builds the state for any size up to its TOTAL_QUBITS at run time
+if library(SDK_NAME).ghzRun(iqs_config.num_qubits, 0) != 0:
+    raise ValueError(f"{SDK_NAME} has no {iqs_config.num_qubits}-qubit GHZ state")
 
 
 qbit_ref = iqsdk.RefVec()
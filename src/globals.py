@@ -1,7 +1,9 @@
 # prep.py
 COMPILER_PATH = "/opt/intel/quantum-sdk/latest/intel-quantum-compiler"
 CIRCUITS_FOLDER = "src/circuits"
+INCLUDE_FOLDER = "include"
 OUTPUT_FOLDER = "qbuild"
+CACHE_FOLDER = "cache" # inside OUTPUT_FOLDER
 VISUALIZATION_FOLDER = "Visualization"
 VISUALIZATION_OPTIONS = {"console", "tex", "json"}
 
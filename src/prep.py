@@ -1,11 +1,29 @@
-from os import path, mkdir, remove, getcwd, chdir
-from shutil import rmtree, copyfile
+from concurrent.futures import ProcessPoolExecutor, as_completed
+from contextlib import contextmanager
+from ctypes import CDLL
+from fcntl import flock, LOCK_EX, LOCK_UN
+from functools import cache
+from hashlib import sha256
+from glob import glob
+from os import path, mkdir, makedirs, remove, rename, getcwd, chdir, getpid, stat, walk, cpu_count, replace as replace_file
+from shutil import rmtree, copyfile, copytree
+from sys import argv
+from tempfile import mkdtemp
+from time import perf_counter, time
 
 from intelqsdk.cbindings import compileProgram, loadSdk
 
-from globals import COMPILER_PATH, CIRCUITS_FOLDER, OUTPUT_FOLDER, VISUALIZATION_FOLDER, VISUALIZATION_OPTIONS
+from globals import COMPILER_PATH, CIRCUITS_FOLDER, INCLUDE_FOLDER, OUTPUT_FOLDER, CACHE_FOLDER, VISUALIZATION_FOLDER, VISUALIZATION_OPTIONS
 
 
+# Compiled programs are cached in OUTPUT_FOLDER/CACHE_FOLDER/<key>/, where
+# the key hashes everything that can change the build (see cacheKey), so an
+# unchanged circuit is reloaded without calling the compiler and an edited one
+# gets its own entry. Entries are published with an atomic rename, and a build
+# holds the lock of its entry and of its .so in OUTPUT_FOLDER (the same locks
+# as compileAll), so several processes can share the cache. replace=True
+# rebuilds and refreshes the entry; use_cache=False restores the old behaviour
+# (replace=False then reuses whatever .so is in qbuild).
 def compileAndLoad(
 		sdk_name: str,
 		/,
@@ -15,13 +33,15 @@ def compileAndLoad(
 		*,
 		clear_qbuild: bool = False,
 		clear_visualizations: bool = True,
-		replace: bool = True,
+		replace: bool = False,
+		use_cache: bool = True,
 		copy_compile: bool = True,
 		visualization: str = "json"
 	):
 	file_name = f"{sdk_name}.cpp"
 	shared_object_name = f"{sdk_name}.so"
 	file_path = path.join(circuits_folder, file_name)
+	include_path = path.join(circuits_folder, INCLUDE_FOLDER)
 	shared_object_path = path.join(output_folder, shared_object_name)
 
 	def if_exists(check_path: str, function, *args, inverse: bool = False, **kwargs):
@@ -34,14 +54,134 @@ def compileAndLoad(
 	if clear_visualizations:
 		if_exists(visualization_folder, rmtree, ignore_errors=True)
 
-	if not replace and path.exists(shared_object_path):
+	flags = compilerFlags(output_folder, visualization)
+
+	if not use_cache and not replace and path.exists(shared_object_path):
 		load(sdk_name, output_folder)
 		return
 
+	def build():
+		nonlocal file_path
+		if copy_compile:
+			file_path = copyfile(file_path, path.join(output_folder, file_name))
+			# Circuits include shared headers relative to themselves
+			if path.exists(include_path):
+				copytree(include_path, path.join(output_folder, INCLUDE_FOLDER), dirs_exist_ok=True)
+
+		# iqc -o qbuild src/circuits/
+		compileProgram(COMPILER_PATH, file_path, flags, sdk_name)
+
+		# TODO: Move latex files to visualization folder
+
+		if copy_compile:
+			remove(file_path)
+			if_exists(path.join(output_folder, INCLUDE_FOLDER), rmtree, ignore_errors=True)
+		else:
+			print("Ignore \"Failed to load program!\" warning above")
+			load(sdk_name)
+
 	if_exists(output_folder, mkdir, inverse=True)
-	if copy_compile:
-		file_path = copyfile(file_path, path.join(output_folder, file_name))
+	# The folder lock only keeps these builds, which share the include/ copied
+	# into output_folder, apart; compileOne stages its builds elsewhere
+	with fileLock(path.join(output_folder, ".lock")):
+		if not use_cache:
+			with sharedObjectLock(output_folder, sdk_name):
+				build()
+			return
+
+		entry = cacheEntry(file_path, include_path, output_folder, visualization)
+		makedirs(path.dirname(entry), exist_ok=True)
+		with fileLock(f"{entry}.lock"), sharedObjectLock(output_folder, sdk_name):
+			if not replace and restoreEntry(entry, shared_object_name, output_folder, visualization_folder):
+				load(sdk_name, output_folder)
+				return
+
+			# compileProgram does not raise when the compiler fails, so the stale
+			# .so of an earlier build must not be mistaken for this one's
+			if_exists(shared_object_path, remove)
+			started = time()
+			build()
+			if not path.exists(shared_object_path):
+				raise RuntimeError(f"{sdk_name}: the compiler produced no {shared_object_path}")
+			storeEntry(entry, shared_object_path, visualization_folder if "-P" in flags else None, started)
+
+# Compiles every circuit in `circuits_folder` with up to `max_workers`
+# compiler processes and returns {sdk_name: (seconds, status)}, where status
+# is "cached", "compiled" or the error. Unlike compileAndLoad nothing is
+# loaded into this process: each build runs in a private staging folder, so
+# builds never see each other's copies of include/, and its .so is moved into
+# `output_folder` atomically. Visualizations are off by default because
+# concurrent builds would write them into the same folder.
+def compileAll(
+		circuits_folder: str = CIRCUITS_FOLDER,
+		output_folder: str = OUTPUT_FOLDER,
+		*,
+		max_workers: int | None = None,
+		replace: bool = False,
+		visualization: str | None = None,
+		verbose: bool = True
+	) -> dict:
+	sdk_names = sorted(
+		path.splitext(path.basename(file_path))[0]
+		for file_path in glob(path.join(circuits_folder, "*.cpp"))
+	)
+	max_workers = max_workers or min(len(sdk_names), cpu_count() or 1) or 1
+	makedirs(output_folder, exist_ok=True)
+
+	started = perf_counter()
+	timings = {}
+	with ProcessPoolExecutor(max_workers=max_workers) as executor:
+		futures = {
+			executor.submit(compileOne, sdk_name, circuits_folder, output_folder, replace, visualization): sdk_name
+			for sdk_name in sdk_names
+		}
+		for future in as_completed(futures):
+			sdk_name = futures[future]
+			try:
+				timings[sdk_name] = future.result()
+			except Exception as error:
+				timings[sdk_name] = (0.0, f"error: {error}")
+			if verbose:
+				seconds, status = timings[sdk_name]
+				print(f"{sdk_name:<24}{seconds:8.2f} s  {status}")
+
+	if verbose:
+		print(f"{len(sdk_names)} circuits in {perf_counter() - started:.2f} s with {max_workers} workers")
+	return timings
+
+def compileOne(sdk_name: str, circuits_folder: str, output_folder: str, replace: bool, visualization: str | None, /) -> tuple:
+	started = perf_counter()
+	file_name = f"{sdk_name}.cpp"
+	shared_object_name = f"{sdk_name}.so"
+	file_path = path.join(circuits_folder, file_name)
+	include_path = path.join(circuits_folder, INCLUDE_FOLDER)
+
+	entry = cacheEntry(file_path, include_path, output_folder, visualization)
+	makedirs(path.dirname(entry), exist_ok=True)
+	# Only one process builds a given key; the others wait and then hit. The
+	# .so lock is the one compileAndLoad holds while it writes qbuild/<name>.so
+	with fileLock(f"{entry}.lock"), sharedObjectLock(output_folder, sdk_name):
+		if not replace and restoreEntry(entry, shared_object_name, output_folder, VISUALIZATION_FOLDER):
+			return perf_counter() - started, "cached"
 
+		staging_folder = mkdtemp(prefix=f".{sdk_name}.", dir=output_folder)
+		try:
+			staged_file_path = copyfile(file_path, path.join(staging_folder, file_name))
+			if path.exists(include_path):
+				copytree(include_path, path.join(staging_folder, INCLUDE_FOLDER))
+			build_started = time()
+			compileProgram(COMPILER_PATH, staged_file_path, compilerFlags(staging_folder, visualization), sdk_name)
+			staged_object_path = path.join(staging_folder, shared_object_name)
+			if not path.exists(staged_object_path):
+				return perf_counter() - started, "error: no shared object produced"
+			storeEntry(entry, staged_object_path, VISUALIZATION_FOLDER if visualization in VISUALIZATION_OPTIONS else None, build_started)
+			# Same filesystem, so this is an atomic rename
+			replace_file(staged_object_path, path.join(output_folder, shared_object_name))
+		finally:
+			rmtree(staging_folder, ignore_errors=True)
+	return perf_counter() - started, "compiled"
+
+def compilerFlags(output_folder: str | None, visualization: str | None, /) -> str:
 	flags = {
 		"o": output_folder,
 		"P": visualization if visualization in VISUALIZATION_OPTIONS else None
@@ -49,24 +189,121 @@ def compileAndLoad(
 	}
 	flags = [f"-{key} {value}" for (key, value) in flags.items() if value]
 	flags.append("-s")
-	flags = " ".join(flags)
+	return " ".join(flags)
+
+def cacheEntry(file_path: str, include_path: str, output_folder: str, visualization: str | None, /) -> str:
+	# The output folder does not change the build, so it is left out of the key
+	return path.join(output_folder, CACHE_FOLDER, cacheKey(file_path, include_path, compilerFlags(None, visualization)))
+
+def cacheKey(file_path: str, include_path: str, flags: str, /, compiler_path: str = COMPILER_PATH) -> str:
+	digest = sha256()
+	def add(data: bytes):
+		digest.update(len(data).to_bytes(8, "little"))
+		digest.update(data)
+
+	# The circuit and every shared header it might include
+	add(path.basename(file_path).encode())
+	with open(file_path, "rb") as file:
+		add(file.read())
+	if path.exists(include_path):
+		for root, folders, files in walk(include_path):
+			folders.sort()
+			for name in sorted(files):
+				header_path = path.join(root, name)
+				add(path.relpath(header_path, include_path).encode())
+				with open(header_path, "rb") as file:
+					add(file.read())
+
+	# The resolved path names the SDK release ("latest" is a symlink); size and
+	# mtime catch a release installed over the old one
+	compiler = path.realpath(compiler_path)
+	add(compiler.encode())
+	if path.exists(compiler):
+		compiler_stat = stat(compiler)
+		add(f"{compiler_stat.st_size} {compiler_stat.st_mtime_ns}".encode())
+
+	add(flags.encode())
+	return digest.hexdigest()
 
-	# iqc -o qbuild src/circuits/
-	compileProgram(COMPILER_PATH, file_path, flags, sdk_name)
+@contextmanager
+def fileLock(lock_path: str, /):
+	with open(lock_path, "a") as lock_file:
+		flock(lock_file, LOCK_EX)
+		try:
+			yield
+		finally:
+			flock(lock_file, LOCK_UN)
 
-	# TODO: Move latex files to visualization folder
+# Held by whoever writes output_folder/<sdk_name>.so, after the entry lock
+def sharedObjectLock(output_folder: str, sdk_name: str, /):
+	return fileLock(path.join(output_folder, f".{sdk_name}.so.lock"))
 
-	if copy_compile:
-		remove(file_path)
+def atomicCopy(source: str, destination: str, /):
+	# Readers (and processes that already loaded the old file) never see a
+	# partially written copy
+	temporary_path = f"{destination}.{getpid()}.tmp"
+	copyfile(source, temporary_path)
+	replace_file(temporary_path, destination)
+
+def restoreEntry(entry: str, shared_object_name: str, output_folder: str, visualization_folder: str, /) -> bool:
+	cached_object_path = path.join(entry, shared_object_name)
+	if not path.exists(cached_object_path):
+		return False
+	atomicCopy(cached_object_path, path.join(output_folder, shared_object_name))
+	cached_visualization_path = path.join(entry, VISUALIZATION_FOLDER)
+	if path.exists(cached_visualization_path):
+		copytree(cached_visualization_path, visualization_folder, dirs_exist_ok=True)
+	return True
+
+def storeEntry(entry: str, shared_object_path: str, visualization_folder: str | None, started: float, /):
+	temporary_entry = f"{entry}.{getpid()}.tmp"
+	if path.exists(temporary_entry):
+		rmtree(temporary_entry)
+	makedirs(temporary_entry)
+	try:
+		copyfile(shared_object_path, path.join(temporary_entry, path.basename(shared_object_path)))
+
+		# Keep the visualizations this build wrote, so a hit can restore them
+		if visualization_folder and path.exists(visualization_folder):
+			for root, _, files in walk(visualization_folder):
+				for name in files:
+					visualization_path = path.join(root, name)
+					if stat(visualization_path).st_mtime < started:
+						continue
+					cached_path = path.join(temporary_entry, VISUALIZATION_FOLDER, path.relpath(visualization_path, visualization_folder))
+					makedirs(path.dirname(cached_path), exist_ok=True)
+					copyfile(visualization_path, cached_path)
+	except BaseException:
+		rmtree(temporary_entry, ignore_errors=True)
+		raise
+
+	# A reader sees the old entry, no entry (a miss) or the new one, never a
+	# partial one
+	if path.exists(entry):
+		old_entry = f"{entry}.{getpid()}.old"
+		rename(entry, old_entry)
+		rename(temporary_entry, entry)
+		rmtree(old_entry, ignore_errors=True)
 	else:
-		print("Ignore \"Failed to load program!\" warning above")
-		load(sdk_name)
+		rename(temporary_entry, entry)
 
 def load(sdk_name: str, /, output_folder: str = OUTPUT_FOLDER):
 	shared_object_name = f"{sdk_name}.so"
 	shared_object_path = path.join(output_folder, shared_object_name)
 	loadSdk(shared_object_path, sdk_name)
 
+@cache
+def library(sdk_name: str, /, output_folder: str = OUTPUT_FOLDER) -> CDLL:
+	# dlopen hands back the copy loadSdk already mapped, so C entry points
+	# (e.g. include/shot_batch.h) share state with the kernels it runs
+	shared_object_name = f"{sdk_name}.so"
+	shared_object_path = path.join(output_folder, shared_object_name)
+	return CDLL(path.abspath(shared_object_path))
+
 
 if __name__ == "__main__":
-	compileAndLoad("example", visualization="json")
+	# python src/prep.py all [max_workers]
+	if len(argv) > 1 and argv[1] == "all":
+		compileAll(max_workers=int(argv[2]) if len(argv) > 2 else None)
+	else:
+		compileAndLoad("example", visualization="json")
@@ -0,0 +1,76 @@
+from os import path
+
+import numpy as np
+import pandas as pd
+
+
+# Mirrors ColumnarHeader in src/circuits/include/result_sink.h
+COLUMNAR_EXTENSION = ".qbc"
+COLUMNAR_MAGIC = b"QBSHOTS\0"
+COLUMNAR_HEADER = np.dtype([
+	("magic", "S8"),
+	("version", "<u4"),
+	("num_qubits", "<u4"),
+	("seed", "<u8"),
+	("chunk_shots", "<u8"),
+	("num_shots", "<u8"),
+	("noise_config", "S88")
+])
+
+
+def read_columnar_header(file_path: str) -> dict:
+	header = np.fromfile(file_path, dtype=COLUMNAR_HEADER, count=1)[0]
+	if header["magic"] != COLUMNAR_MAGIC.rstrip(b"\0"):
+		raise ValueError(f"{file_path} is not a columnar result file")
+	return {
+		"version": int(header["version"]),
+		"num_qubits": int(header["num_qubits"]),
+		"seed": int(header["seed"]),
+		"chunk_shots": int(header["chunk_shots"]),
+		"num_shots": int(header["num_shots"]),
+		"noise_config": header["noise_config"].decode()
+	}
+
+def read_columnar(file_path: str) -> tuple[dict, np.ndarray]:
+	"""Memory-maps a columnar result file; returns its header and a
+	(num_qubits, num_shots) uint8 array of outcomes"""
+	header = read_columnar_header(file_path)
+	num_qubits, chunk_shots, num_shots = header["num_qubits"], header["chunk_shots"], header["num_shots"]
+	if num_qubits == 0 or num_shots == 0:
+		return header, np.zeros((num_qubits, num_shots), dtype=np.uint8)
+
+	num_chunks = -(-num_shots // chunk_shots)
+	chunks = np.memmap(
+		file_path,
+		dtype="<u8",
+		mode="r",
+		offset=COLUMNAR_HEADER.itemsize,
+		shape=(num_chunks, num_qubits, chunk_shots // 64)
+	)
+	# (chunk, qubit, bytes) -> (qubit, chunk, bits) -> (qubit, shot)
+	bits = np.unpackbits(chunks.view(np.uint8), axis=2, bitorder="little")
+	columns = bits.transpose(1, 0, 2).reshape(num_qubits, num_chunks * chunk_shots)
+	return header, columns[:, :num_shots]
+
+def read_results(file_path: str) -> pd.DataFrame:
+	"""Reads results written by a ResultSink (or any results CSV), given
+	with or without extension; a columnar file wins over a CSV of the
+	same name"""
+	base_path, extension = path.splitext(file_path)
+	if extension not in {COLUMNAR_EXTENSION, ".csv"}:
+		base_path = file_path
+		extension = COLUMNAR_EXTENSION if path.exists(f"{file_path}{COLUMNAR_EXTENSION}") else ".csv"
+
+	if extension == ".csv":
+		return pd.read_csv(f"{base_path}.csv")
+
+	_, columns = read_columnar(f"{base_path}{COLUMNAR_EXTENSION}")
+	return pd.DataFrame({f"qubit_{i}": column for i, column in enumerate(columns)})
+
+
+if __name__ == "__main__":
+	from sys import argv
+	for file_path in argv[1:]:
+		if file_path.endswith(COLUMNAR_EXTENSION):
+			print(read_columnar_header(file_path))
+		print(read_results(file_path))
@@ -1,6 +1,10 @@
+from ctypes import POINTER, c_char_p, c_int, c_size_t, c_uint, c_uint64
+
 import intelqsdk.cbindings as iqsdk
+import numpy as np
 
-from prep import load
+from prep import load, library
+from state import shots_to_state
 
 
 class SDKManager:
@@ -49,6 +53,50 @@ class SDKManager:
 			iqsdk.callCppFunction(function_name, self.sdk_name)
 			self.iqs_device.wait()
 
+	def run_batch(self, function_name: str, num_shots: int, /, copy: bool = True):
+		"""Runs a kernel registered in include/shot_batch.h `num_shots` times
+		natively; returns a (num_shots, words_per_shot) uint64 array of packed
+		cbits, or None if the device is not ready
+
+		With copy=False the array is a zero-copy view of the C++ ShotMatrix,
+		only valid until the next batch on this SDK"""
+		if not (self.valid and self.iqs_device.ready() == iqsdk.QRT_ERROR_T.QRT_ERROR_SUCCESS):
+			return None
+
+		shot_library = library(self.sdk_name)
+		shot_library.shotBatchRun.argtypes = [c_char_p, c_uint]
+		shot_library.shotBatchRun.restype = c_int
+		shot_library.shotBatchData.restype = POINTER(c_uint64)
+		shot_library.shotBatchWordsPerShot.restype = c_uint
+
+		if shot_library.shotBatchRun(function_name.encode(), num_shots) != 0:
+			raise KeyError(f"{function_name} is not registered for batched runs in {self.sdk_name}")
+		self.iqs_device.wait()
+
+		words_per_shot = shot_library.shotBatchWordsPerShot()
+		if num_shots == 0 or words_per_shot == 0:
+			return np.zeros((num_shots, words_per_shot), dtype=np.uint64)
+		shots = np.ctypeslib.as_array(
+			shot_library.shotBatchData(), shape=(num_shots, words_per_shot)
+		)
+		return shots.copy() if copy else shots
+
+	def batch_histogram(self) -> dict[int, int]:
+		"""Histogram of the last run_batch, built by ShotMatrix in C++; maps
+		the index of the first shot with each outcome to its count"""
+		shot_library = library(self.sdk_name)
+		shot_library.shotBatchHistogram.argtypes = [POINTER(c_uint64), POINTER(c_uint), c_size_t]
+		shot_library.shotBatchHistogram.restype = c_size_t
+
+		num_outcomes = shot_library.shotBatchHistogram(None, None, 0)
+		first_shots = np.zeros(num_outcomes, dtype=np.uint64)
+		counts = np.zeros(num_outcomes, dtype=np.uintc)
+		shot_library.shotBatchHistogram(
+			first_shots.ctypes.data_as(POINTER(c_uint64)),
+			counts.ctypes.data_as(POINTER(c_uint)),
+			num_outcomes
+		)
+		return dict(zip(first_shots.tolist(), counts.tolist()))
 
 if __name__ == "__main__":
 	N = 10
@@ -58,3 +106,6 @@ if __name__ == "__main__":
 		dm.run(f"ghzM_{N}")
 		state = ["1" if dm.cbits[i].value() else "0" for i in range(N)]
 		print("|" + "".join(state) + ">")
+	shots = dm.run_batch(f"ghzM_{N}", 1000, copy=False)
+	for shot, count in dm.batch_histogram().items():
+		print(shots_to_state(shots[shot], N), count)
@@ -1,3 +1,4 @@
+import numpy as np
 from intelqsdk.cbindings import CbitRef
 
 def cbits_to_state(
@@ -12,6 +13,13 @@ def cbits_to_state(
 	state = f"|{state}>"
 	return label_state(state) if label_states else state
 
+def shots_to_state(shot: np.ndarray, n: int, /, label_states: bool = False) -> str:
+	"""Same as cbits_to_state for one packed row of SDKManager.run_batch"""
+	bits = np.unpackbits(shot.view(np.uint8), bitorder="little")[:n]
+	state = "".join("1" if bit else "0" for bit in bits)
+	state = f"|{state}>"
+	return label_state(state) if label_states else state
+
 def label_state(state: str) -> str:
 	return state if state[1] == "0" else complement_state(state)
 
@@ -24,6 +32,18 @@ def complement_state(state: str) -> str:
 def bucket_state_n(n: int) -> tuple[str, str]:
 	return ["|" + n * "0" + ">", "|" + n * "1" + ">"]
 
+def count_bucket_shots(shots: np.ndarray, n: int) -> int:
+	"""Counts packed shots (see SDKManager.run_batch) whose first n bits are
+	all 0 or all 1, i.e. that fall in bucket_state_n(n)"""
+	masks = np.zeros(shots.shape[1], dtype=np.uint64)
+	masks[:n // 64] = np.uint64(0xFFFFFFFFFFFFFFFF)
+	if n % 64:
+		masks[n // 64] = np.uint64((1 << (n % 64)) - 1)
+	shots = shots & masks
+	all_zero = (shots == 0).all(axis=1)
+	all_one = (shots == masks).all(axis=1)
+	return int((all_zero | all_one).sum())
+
 
 if __name__ == "__main__":
 	for state in ["|0000>", "|1111>", "|0101>", "|1010>"]:
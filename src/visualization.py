@@ -1,8 +1,8 @@
-import pandas as pd
 import matplotlib.pyplot as plt
 import seaborn as sns
 
 from globals import RESULTS_FOLDER
+from results import read_results
 
 
 def visualize(
@@ -21,7 +21,7 @@ def visualize(
 
 
 def depolarizing_rate(input_path: str, output_path: str):
-    df = pd.read_csv(f"{input_path}.csv")
+    df = read_results(input_path)
 
     plt.figure(figsize=(10, 6))
 
@@ -38,7 +38,7 @@ def depolarizing_rate(input_path: str, output_path: str):
 
 
 def correlation(input_path: str, output_path: str):
-    df = pd.read_csv(f"{input_path}.csv")
+    df = read_results(input_path)
 
     plt.figure(figsize=(10, 6))
 
@@ -53,7 +53,7 @@ def correlation_fidelity(
         num_samples: int = 100,
         sample_size: int = 100
 ):
-    df = pd.read_csv(f"{input_path}.csv")
+    df = read_results(input_path)
 
     correlation = []
     fidelity = []